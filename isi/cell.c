@@ -0,0 +1,95 @@
+/*
+ * This file is GPLv2
+ * Copyright (C) 2010 Sebastian Reichel
+ */
+#include <string.h>
+
+#include "cell.h"
+#include "helper.h"
+
+static struct isi_cell_record* cell_record(struct isi_cell_stream *stream, guint32 number) {
+	return &stream->records[number % ISI_CELL_STREAM_SIZE];
+}
+
+/* the record number is still in the ring */
+static gboolean cell_valid(struct isi_cell_stream *stream, guint32 number) {
+	return number && number <= stream->head && stream->head - number < ISI_CELL_STREAM_SIZE;
+}
+
+static gboolean cell_same(const struct isi_cell_record *a, const struct isi_cell_record *b) {
+	return a->cid == b->cid && a->lac == b->lac && a->rat == b->rat &&
+		(!a->mcc || !b->mcc || (a->mcc == b->mcc && a->mnc == b->mnc));
+}
+
+struct isi_cell_stream* isi_cell_stream_create(void) {
+	return g_try_new0(struct isi_cell_stream, 1);
+}
+
+void isi_cell_stream_destroy(struct isi_cell_stream *stream) {
+	g_free(stream);
+}
+
+void isi_cell_stream_subscribe(struct isi_cell_stream *stream, isi_cell_record_cb cb, void *user_data) {
+	stream->cb = cb;
+	stream->user_data = user_data;
+}
+
+void isi_cell_stream_unsubscribe(struct isi_cell_stream *stream) {
+	stream->cb = NULL;
+	stream->user_data = NULL;
+}
+
+void isi_cell_stream_push(struct isi_cell_stream *stream, const struct isi_cell_record *record) {
+	guint32 last = stream->last[record->source & 1];
+	guint32 other = stream->last[!(record->source & 1)];
+	struct isi_cell_record *rec;
+	guint64 now = isi_now_ms();
+
+	if(cell_valid(stream, last) && cell_same(cell_record(stream, last), record)) {
+		rec = cell_record(stream, last);
+		rec->last_seen = now;
+		if(record->strength)
+			rec->strength = record->strength;
+		return;
+	}
+
+	rec = cell_record(stream, ++stream->head);
+	*rec = *record;
+	rec->first_seen = rec->last_seen = now;
+
+	/* registration status has no operator code, GPS no signal strength */
+	if(cell_valid(stream, other)) {
+		struct isi_cell_record *o = cell_record(stream, other);
+
+		if(o->cid == rec->cid && o->rat == rec->rat) {
+			if(!rec->mcc) {
+				rec->mcc = o->mcc;
+				rec->mnc = o->mnc;
+			}
+			if(!rec->lac)
+				rec->lac = o->lac;
+			if(!rec->strength)
+				rec->strength = o->strength;
+		}
+	}
+
+	stream->last[record->source & 1] = stream->head;
+
+	if(stream->cb)
+		stream->cb(rec, stream->head, stream->user_data);
+}
+
+unsigned isi_cell_stream_read(struct isi_cell_stream *stream, guint32 *since, struct isi_cell_record *out, unsigned max) {
+	guint32 number = *since + 1;
+	unsigned count = 0;
+
+	if(stream->head >= ISI_CELL_STREAM_SIZE && number <= stream->head - ISI_CELL_STREAM_SIZE)
+		number = stream->head - ISI_CELL_STREAM_SIZE + 1;
+
+	for(; number <= stream->head && count < max; number++)
+		out[count++] = *cell_record(stream, number);
+
+	if(count)
+		*since = number - 1;
+	return count;
+}
@@ -0,0 +1,62 @@
+#include <glib.h>
+#include <stdint.h>
+
+#ifndef _ISI_CELL_H
+#define _ISI_CELL_H
+
+/* number of records kept, a power of two */
+#define ISI_CELL_STREAM_SIZE 64
+
+enum isi_cell_source {
+	ISI_CELL_SOURCE_NETWORK,	/* registration status */
+	ISI_CELL_SOURCE_GPS		/* cell info of a GPS fix */
+};
+
+enum isi_cell_rat {
+	ISI_CELL_RAT_GSM,
+	ISI_CELL_RAT_WCDMA
+};
+
+/* one observation of the serving cell, mcc and mnc are 0 if unknown and
+ * lac is 0 for WCDMA cells reported by GPS */
+struct isi_cell_record {
+	guint64 first_seen;	/* monotonic milliseconds */
+	guint64 last_seen;
+	guint32 cid;		/* UCID for WCDMA */
+	guint16 mcc;
+	guint16 mnc;
+	guint16 lac;
+	guint8 rat;
+	guint8 source;
+	guint8 strength;	/* network signal strength in percent, 0 if unknown */
+};
+
+typedef void (*isi_cell_record_cb)(const struct isi_cell_record *record, guint32 number, void *user_data);
+
+/* measurements of all sources in order, numbered from 1. Repeated reports
+ * of the same cell by the same source only refresh the latest record. */
+struct isi_cell_stream {
+	struct isi_cell_record records[ISI_CELL_STREAM_SIZE];
+	guint32 head;		/* number of the latest record, 0 if none */
+	guint32 last[2];	/* latest record per source */
+
+	isi_cell_record_cb cb;
+	void *user_data;
+};
+
+struct isi_cell_stream* isi_cell_stream_create(void);
+void isi_cell_stream_destroy(struct isi_cell_stream *stream);
+
+/* called for every new record, not for refreshed ones */
+void isi_cell_stream_subscribe(struct isi_cell_stream *stream, isi_cell_record_cb cb, void *user_data);
+void isi_cell_stream_unsubscribe(struct isi_cell_stream *stream);
+
+/* add an observation, time and mcc/mnc of the other source are filled in */
+void isi_cell_stream_push(struct isi_cell_stream *stream, const struct isi_cell_record *record);
+
+/* copy up to max records newer than since, returns the number copied and
+ * stores the number of the last one in since. Records already
+ * overwritten are skipped. */
+unsigned isi_cell_stream_read(struct isi_cell_stream *stream, guint32 *since, struct isi_cell_record *out, unsigned max);
+
+#endif
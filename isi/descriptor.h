@@ -0,0 +1,195 @@
+/*
+ * This file is GPLv2
+ * Copyright (C) 2010 Sebastian Reichel
+ */
+
+/*
+ * Declarative layouts for ISI messages and sub-blocks.
+ *
+ * A layout is an X-macro next to the opcodes, listing every field as
+ * F(X, name, type, offset) and every fixed byte as C(X, type, offset, value):
+ *
+ *	#define NET_RSSI_CURRENT_LAYOUT(F, C, X) \
+ *		F(X, rssi, byte, 2)
+ *
+ *	ISI_SB_DEFINE(net_rssi_current, NET_RSSI_CURRENT_LAYOUT, 3)
+ *	ISI_MSG_DEFINE(net_rssi_get_req, NET_RSSI_GET_REQ,
+ *			NET_RSSI_GET_REQ_LAYOUT, 3)
+ *
+ * ISI_SB_DEFINE generates struct net_rssi_current and
+ * net_rssi_current_decode(iter, out), which checks the sub-block length
+ * once and then loads every field at a constant offset. ISI_MSG_DEFINE
+ * additionally generates net_rssi_get_req_pack(buf, in) and the
+ * net_rssi_get_req_len constant. Every offset is checked against the
+ * declared length at compile time, so a field that does not fit fails
+ * the build instead of reading past the sub-block.
+ */
+
+#ifndef __ISI_DESCRIPTOR_H
+#define __ISI_DESCRIPTOR_H
+
+#include <stdint.h>
+#include <string.h>
+#include <glib.h>
+
+#include "gisi/iter.h"
+
+struct isi_oper_code {
+	char mcc[4];
+	char mnc[4];
+};
+
+static inline void isi_bcd_to_oper_code(const uint8_t *bcd, struct isi_oper_code *code) {
+	code->mcc[0] = '0' + (bcd[0] & 0x0F);
+	code->mcc[1] = '0' + ((bcd[0] & 0xF0) >> 4);
+	code->mcc[2] = '0' + (bcd[1] & 0x0F);
+	code->mcc[3] = '\0';
+
+	code->mnc[0] = '0' + (bcd[2] & 0x0F);
+	code->mnc[1] = '0' + ((bcd[2] & 0xF0) >> 4);
+	code->mnc[2] = (bcd[1] & 0xF0) == 0xF0 ? '\0' : '0' + ((bcd[1] & 0xF0) >> 4);
+	code->mnc[3] = '\0';
+}
+
+static inline void isi_oper_code_to_bcd(const struct isi_oper_code *code, uint8_t *bcd) {
+	bcd[0] = (code->mcc[0] - '0') | (code->mcc[1] - '0') << 4;
+	bcd[1] = (code->mcc[2] - '0');
+	bcd[1] |= (code->mnc[2] == '\0' ? 0x0f : (code->mnc[2] - '0')) << 4;
+	bcd[2] = (code->mnc[0] - '0') | (code->mnc[1] - '0') << 4;
+}
+
+/* Field types: C declaration, size on the wire, load and store */
+#define ISI_TYPE_byte_DECL(n)		uint8_t n
+#define ISI_TYPE_byte_SIZE		1
+#define ISI_TYPE_byte_LOAD(v, p)	((v) = (p)[0])
+#define ISI_TYPE_byte_STORE(p, v)	((p)[0] = (uint8_t)(v))
+#define ISI_TYPE_byte_INIT(pos, v)	[(pos)] = (uint8_t)(v),
+
+#define ISI_TYPE_word_DECL(n)		uint16_t n
+#define ISI_TYPE_word_SIZE		2
+#define ISI_TYPE_word_LOAD(v, p)	((v) = (uint16_t)((p)[0] << 8 | (p)[1]))
+#define ISI_TYPE_word_STORE(p, v)	((p)[0] = (uint16_t)(v) >> 8, \
+					 (p)[1] = (uint8_t)(v))
+#define ISI_TYPE_word_INIT(pos, v)	[(pos)] = (uint8_t)((v) >> 8), \
+					[(pos) + 1] = (uint8_t)(v),
+
+#define ISI_TYPE_dword_DECL(n)		uint32_t n
+#define ISI_TYPE_dword_SIZE		4
+#define ISI_TYPE_dword_LOAD(v, p)	((v) = (uint32_t)(p)[0] << 24 | \
+					 (uint32_t)(p)[1] << 16 | \
+					 (uint32_t)(p)[2] << 8 | (p)[3])
+#define ISI_TYPE_dword_STORE(p, v)	((p)[0] = (uint32_t)(v) >> 24, \
+					 (p)[1] = (uint32_t)(v) >> 16, \
+					 (p)[2] = (uint32_t)(v) >> 8, \
+					 (p)[3] = (uint8_t)(v))
+#define ISI_TYPE_dword_INIT(pos, v)	[(pos)] = (uint8_t)((v) >> 24), \
+					[(pos) + 1] = (uint8_t)((v) >> 16), \
+					[(pos) + 2] = (uint8_t)((v) >> 8), \
+					[(pos) + 3] = (uint8_t)(v),
+
+/* MCC and MNC packed into three BCD bytes */
+#define ISI_TYPE_oper_DECL(n)		struct isi_oper_code n
+#define ISI_TYPE_oper_SIZE		3
+#define ISI_TYPE_oper_LOAD(v, p)	isi_bcd_to_oper_code((p), &(v))
+#define ISI_TYPE_oper_STORE(p, v)	isi_oper_code_to_bcd(&(v), (p))
+
+/* PIN or PUK code, NUL padded ASCII in an 11 byte field */
+#define ISI_TYPE_code_DECL(n)		const char *n
+#define ISI_TYPE_code_SIZE		11
+#define ISI_TYPE_code_LOAD(v, p)	((v) = (const char *)(p))
+#define ISI_TYPE_code_STORE(p, v)	strncpy((char *)(p), (v), ISI_TYPE_code_SIZE)
+
+#define ISI_STATIC_ASSERT(name, cond) \
+	typedef char isi_static_assert_##name[(cond) ? 1 : -1]
+
+#define ISI_FIELD_DECL(X, n, t, pos) \
+	ISI_TYPE_##t##_DECL(n);
+#define ISI_FIELD_LOAD(X, n, t, pos) \
+	ISI_TYPE_##t##_LOAD(out->n, p + (pos));
+#define ISI_FIELD_STORE(X, n, t, pos) \
+	ISI_TYPE_##t##_STORE(buf + (pos), in->n);
+#define ISI_FIELD_CHECK(X, n, t, pos) \
+	ISI_STATIC_ASSERT(X##_##n, (pos) + ISI_TYPE_##t##_SIZE <= X##_len);
+
+#define ISI_FIELD_INIT(X, n, t, pos) \
+	ISI_TYPE_##t##_INIT(pos, X##_##n)
+#define ISI_CONST_SKIP(X, t, pos, value)
+#define ISI_CONST_INIT(X, t, pos, value) \
+	ISI_TYPE_##t##_INIT(pos, value)
+#define ISI_CONST_STORE(X, t, pos, value) \
+	ISI_TYPE_##t##_STORE(buf + (pos), (value));
+#define ISI_CONST_CHECK(X, t, pos, value) \
+	ISI_STATIC_ASSERT(X##_const_##pos, (pos) + ISI_TYPE_##t##_SIZE <= X##_len);
+
+/* Layouts without any variable field still need a struct member */
+#define ISI_LAYOUT_STRUCT(name, LAYOUT) \
+	struct name { \
+		char _unused; \
+		LAYOUT(ISI_FIELD_DECL, ISI_CONST_SKIP, name) \
+	}
+
+/*
+ * Sub-block of at least @minlen bytes, header included. Offsets are
+ * relative to the start of the sub-block.
+ */
+#define ISI_SB_DEFINE(name, LAYOUT, minlen) \
+	enum { name##_len = (minlen) }; \
+	ISI_LAYOUT_STRUCT(name, LAYOUT); \
+	LAYOUT(ISI_FIELD_CHECK, ISI_CONST_CHECK, name) \
+	static inline gboolean name##_decode(const GIsiSubBlockIter *iter, \
+						struct name *out) \
+	{ \
+		const void *raw; \
+		const uint8_t *p; \
+		if (!g_isi_sb_iter_get_struct(iter, &raw, name##_len, 0)) \
+			return FALSE; \
+		p = raw; \
+		(void)p; \
+		LAYOUT(ISI_FIELD_LOAD, ISI_CONST_SKIP, name) \
+		return TRUE; \
+	}
+
+/*
+ * Message with id @id and @size bytes of fixed part, counting from the
+ * message id (the transaction id is handled by GIsiClient).
+ */
+#define ISI_MSG_DEFINE(name, id, LAYOUT, size) \
+	enum { name##_len = (size) }; \
+	ISI_STATIC_ASSERT(name##_id, (size) >= 1); \
+	ISI_LAYOUT_STRUCT(name, LAYOUT); \
+	LAYOUT(ISI_FIELD_CHECK, ISI_CONST_CHECK, name) \
+	static inline size_t name##_pack(uint8_t buf[name##_len], \
+					const struct name *in) \
+	{ \
+		memset(buf, 0, name##_len); \
+		buf[0] = (id); \
+		(void)in; \
+		LAYOUT(ISI_FIELD_STORE, ISI_CONST_STORE, name) \
+		return name##_len; \
+	} \
+	static inline gboolean name##_decode(const void *data, size_t len, \
+						struct name *out) \
+	{ \
+		const uint8_t *p = data; \
+		if (!p || len < name##_len || p[0] != (id)) \
+			return FALSE; \
+		LAYOUT(ISI_FIELD_LOAD, ISI_CONST_SKIP, name) \
+		return TRUE; \
+	}
+
+/*
+ * Read-only request of @size bytes built at compile time, sent as is
+ * with sizeof(name). Every field of the layout takes its value from a
+ * constant name_field, which has to be declared before:
+ *
+ *	enum { info_serial_read_req_type = INFO_SN_IMEI_PLAIN };
+ *	ISI_MSG_TEMPLATE(info_serial_read_req, INFO_SERIAL_NUMBER_READ_REQ,
+ *			INFO_SERIAL_NUMBER_READ_REQ_LAYOUT, 2)
+ */
+#define ISI_MSG_TEMPLATE(name, id, LAYOUT, size) \
+	static const uint8_t name[(size)] = { \
+		(id), \
+		LAYOUT(ISI_FIELD_INIT, ISI_CONST_INIT, name) \
+	};
+
+#endif /* __ISI_DESCRIPTOR_H */
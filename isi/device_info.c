@@ -11,8 +11,23 @@
 #include "modem.h"
 #include "debug.h"
 #include "gisi/iter.h"
+#include "descriptor.h"
 #include "helper.h"
 
+/* every query is a fixed request, sent from read-only memory */
+enum {
+	info_manufacturer_read_req_type = INFO_PRODUCT_MANUFACTURER,
+	info_model_read_req_type = INFO_PRODUCT_NAME,
+	info_revision_read_req_type = INFO_MCUSW,
+	info_serial_read_req_type = INFO_SN_IMEI_PLAIN
+};
+
+ISI_MSG_TEMPLATE(info_manufacturer_read_req, INFO_PRODUCT_INFO_READ_REQ, INFO_PRODUCT_INFO_READ_REQ_LAYOUT, INFO_PRODUCT_INFO_READ_REQ_LEN)
+ISI_MSG_TEMPLATE(info_model_read_req, INFO_PRODUCT_INFO_READ_REQ, INFO_PRODUCT_INFO_READ_REQ_LAYOUT, INFO_PRODUCT_INFO_READ_REQ_LEN)
+ISI_MSG_TEMPLATE(info_revision_read_req, INFO_VERSION_READ_REQ, INFO_VERSION_READ_REQ_LAYOUT, INFO_VERSION_READ_REQ_LEN)
+ISI_MSG_TEMPLATE(info_serial_read_req, INFO_SERIAL_NUMBER_READ_REQ, INFO_SERIAL_NUMBER_READ_REQ_LAYOUT, INFO_SERIAL_NUMBER_READ_REQ_LEN)
+ISI_SB_DEFINE(info_sb_string, INFO_SB_STRING_LAYOUT, INFO_SB_STRING_LEN)
+
 void device_info_reachable_cb(GIsiClient *client, gboolean alive, uint16_t object, void *user_data) {
 	struct isi_cb_data *cbd = user_data;
 	isi_subsystem_reachable_cb cb = cbd->callback;
@@ -39,7 +54,7 @@ struct isi_device_info* isi_device_info_create(struct isi_modem *modem, isi_subs
 	if(!nd || !cbd || !modem->idx)
 		goto error;
 
-	nd->client = g_isi_client_create(modem->idx, PN_PHONE_INFO);
+	nd->client = isi_modem_client_create(modem, PN_PHONE_INFO);
 	if(!nd->client)
 		goto error;
 
@@ -68,15 +83,15 @@ static gboolean isi_device_info_resp_cb(GIsiClient *client, const void *restrict
 	isi_device_info_cb cb = cbd->callback;
 
 	GIsiSubBlockIter iter;
+	struct info_sb_string sb;
 	char *info = NULL;
-	guint8 chars;
 
 	if (!msg) {
 		g_debug("ISI client error: %d", g_isi_client_error(client));
 		goto error;
 	}
 
-	if (len < 3) {
+	if (len < INFO_RESP_LEN) {
 		g_debug("truncated message");
 		return FALSE;
 	}
@@ -90,7 +105,7 @@ static gboolean isi_device_info_resp_cb(GIsiClient *client, const void *restrict
 		goto error;
 	}
 
-	for (g_isi_sb_iter_init(&iter, msg, len, 3);
+	for (g_isi_sb_iter_init(&iter, msg, len, INFO_RESP_LEN);
 		g_isi_sb_iter_is_valid(&iter);
 		g_isi_sb_iter_next(&iter)) {
 
@@ -101,16 +116,15 @@ static gboolean isi_device_info_resp_cb(GIsiClient *client, const void *restrict
 		case INFO_SB_MCUSW_VERSION:
 		case INFO_SB_SN_IMEI_PLAIN:
 
-			if (g_isi_sb_iter_get_len(&iter) < 5
-				|| !g_isi_sb_iter_get_byte(&iter, &chars, 3)
+			if (!info_sb_string_decode(&iter, &sb)
 				|| !g_isi_sb_iter_get_latin_tag(&iter,
-							&info, chars, 4))
+							&info, sb.chars, info_sb_string_len))
 				goto error;
 
 			cb(FALSE, info, cbd->data);
 			g_free(info);
 
-			g_free(cbd);
+			isi_cb_data_free(cbd);
 			return TRUE;
 
 		default:
@@ -120,84 +134,71 @@ static gboolean isi_device_info_resp_cb(GIsiClient *client, const void *restrict
 	}
 
 error:
+	g_isi_response_uncacheable(client);
 	cb(TRUE, "", cbd->data);
-	g_free(cbd);
+	isi_cb_data_free(cbd);
 	return TRUE;
 }
 
 void isi_device_info_query_manufacturer(struct isi_device_info *nd, isi_device_info_cb cb, void *user_data) {
 	struct isi_cb_data *cbd = isi_cb_data_new(nd, cb, user_data);
 
-	const unsigned char msg[] = {
-		INFO_PRODUCT_INFO_READ_REQ,
-		INFO_PRODUCT_MANUFACTURER
-	};
-
 	if (!cbd)
 		goto error;
 
-	if (g_isi_request_make(nd->client, msg, sizeof(msg), INFO_TIMEOUT, isi_device_info_resp_cb, cbd))
+	if (g_isi_request_make(nd->client, info_manufacturer_read_req, sizeof(info_manufacturer_read_req), INFO_TIMEOUT, isi_device_info_resp_cb, cbd))
 		return;
 
 error:
 	cb(TRUE, "", user_data);
-	g_free(cbd);
+	isi_cb_data_free(cbd);
 }
 
 void isi_device_info_query_model(struct isi_device_info *nd, isi_device_info_cb cb, void *user_data) {
 	struct isi_cb_data *cbd = isi_cb_data_new(nd, cb, user_data);
 
-	const unsigned char msg[] = {
-		INFO_PRODUCT_INFO_READ_REQ,
-		INFO_PRODUCT_NAME
-	};
-
 	if (!cbd)
 		goto error;
 
-	if (g_isi_request_make(nd->client, msg, sizeof(msg), INFO_TIMEOUT, isi_device_info_resp_cb, cbd))
+	if (g_isi_request_make(nd->client, info_model_read_req, sizeof(info_model_read_req), INFO_TIMEOUT, isi_device_info_resp_cb, cbd))
 		return;
 
 error:
 	cb(TRUE, "", user_data);
-	g_free(cbd);
+	isi_cb_data_free(cbd);
 }
 
 void isi_device_info_query_revision(struct isi_device_info *nd, isi_device_info_cb cb, void *user_data) {
 	struct isi_cb_data *cbd = isi_cb_data_new(nd, cb, user_data);
 
-	const unsigned char msg[] = {
-		INFO_VERSION_READ_REQ,
-		0x00, INFO_MCUSW,
-		0x00, 0x00, 0x00, 0x00
-	};
-
 	if (!cbd)
 		goto error;
 
-	if (g_isi_request_make(nd->client, msg, sizeof(msg), INFO_TIMEOUT, isi_device_info_resp_cb, cbd))
+	if (g_isi_request_make(nd->client, info_revision_read_req, sizeof(info_revision_read_req), INFO_TIMEOUT, isi_device_info_resp_cb, cbd))
 		return;
 
 error:
 	cb(TRUE, "", user_data);
-	g_free(cbd);
+	isi_cb_data_free(cbd);
 }
 
 void isi_device_info_query_serial(struct isi_device_info *nd, isi_device_info_cb cb, void *user_data) {
 	struct isi_cb_data *cbd = isi_cb_data_new(nd, cb, user_data);
 
-	const unsigned char msg[] = {
-		INFO_SERIAL_NUMBER_READ_REQ,
-		INFO_SN_IMEI_PLAIN
-	};
-
 	if (!cbd)
 		goto error;
 
-	if (g_isi_request_make(nd->client, msg, sizeof(msg), INFO_TIMEOUT, isi_device_info_resp_cb, cbd))
+	if (g_isi_request_make(nd->client, info_serial_read_req, sizeof(info_serial_read_req), INFO_TIMEOUT, isi_device_info_resp_cb, cbd))
 		return;
 
 error:
 	cb(TRUE, "", user_data);
-	g_free(cbd);
+	isi_cb_data_free(cbd);
+}
+
+void isi_device_info_set_cache_ttl(struct isi_device_info *nd, unsigned ttl) {
+	g_isi_cache_set_ttl(nd->client, INFO_PRODUCT_INFO_READ_REQ, ttl);
+	g_isi_cache_set_ttl(nd->client, INFO_VERSION_READ_REQ, ttl);
+	g_isi_cache_set_ttl(nd->client, INFO_SERIAL_NUMBER_READ_REQ, ttl);
+	g_isi_cache_set_ttl(nd->client, INFO_COMMON_MESSAGE, ttl);
 }
@@ -23,4 +23,7 @@ void isi_device_info_query_model(struct isi_device_info *nd, isi_device_info_cb
 void isi_device_info_query_revision(struct isi_device_info *nd, isi_device_info_cb cb, void *user_data);
 void isi_device_info_query_serial(struct isi_device_info *nd, isi_device_info_cb cb, void *user_data);
 
+/* answer repeated queries from a cache for ttl seconds, 0 disables it */
+void isi_device_info_set_cache_ttl(struct isi_device_info *nd, unsigned ttl);
+
 #endif
@@ -27,6 +27,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <search.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/uio.h>
@@ -36,6 +37,7 @@
 
 #include "socket.h"
 #include "client.h"
+#include "iothread.h"
 
 #define PN_COMMGR			0x10
 #define PNS_SUBSCRIBED_RESOURCES_IND	0x10
@@ -49,11 +51,53 @@ struct _GIsiRequest {
 	unsigned int id; /* don't move, see g_isi_cmp */
 	GIsiClient *client;
 	guint timeout;
+	GSource *io_timeout; /* held, run by the I/O thread */
 	GIsiResponseFunc func;
 	void *data;
 	GDestroyNotify notify;
+
+	/* Request payload while waiting for a cacheable or coalescable
+	 * response, or the cached response itself for requests answered
+	 * from the cache */
+	uint8_t resource;
+	uint16_t object;
+	uint8_t *payload;
+	size_t payload_len;
+
+	/* Coalescing: requests that joined this transaction, or the
+	 * transaction this request has joined */
+	GSList *joined;
+	GIsiRequest *primary;
+	gboolean busy; /* dispatching to the joined requests */
+
+	GIsiSlab *slab; /* allocated from, NULL for the heap */
 };
 
+struct _GIsiCacheEntry {
+	uint8_t resource;
+	uint16_t object;
+	time_t expires;
+	size_t req_len;
+	size_t resp_len;
+	uint8_t data[]; /* request followed by response */
+};
+typedef struct _GIsiCacheEntry GIsiCacheEntry;
+
+struct _GIsiCache {
+	GHashTable *entries;
+	unsigned ttl[256]; /* seconds, by request message ID */
+	GSList *invalidators;
+	GSList *hits; /* requests answered from the cache */
+	gboolean skip;
+};
+typedef struct _GIsiCache GIsiCache;
+
+struct _GIsiCacheInvalidator {
+	unsigned int ind;
+	uint8_t type;
+};
+typedef struct _GIsiCacheInvalidator GIsiCacheInvalidator;
+
 struct _GIsiIndication {
 	unsigned int type; /* don't move, see g_isi_cmp */
 	GIsiIndicationFunc func;
@@ -61,6 +105,52 @@ struct _GIsiIndication {
 };
 typedef struct _GIsiIndication GIsiIndication;
 
+/* Indication socket shared by all clients of one modem */
+struct _GIsiIndHub {
+	GIsiModem *modem;
+	int fd;
+	guint source;
+	unsigned refs;
+	GSList *clients;
+	gboolean dispatching;
+	GMainContext *context;
+};
+typedef struct _GIsiIndHub GIsiIndHub;
+
+/* Reference to a client from work queued for the application context,
+ * which may outlive the client */
+struct _GIsiClientToken {
+	volatile gint refs;
+	GIsiClient *client; /* NULL once the client is destroyed */
+};
+typedef struct _GIsiClientToken GIsiClientToken;
+
+enum {
+	G_ISI_HANDOFF_RESPONSE,
+	G_ISI_HANDOFF_INDICATION,
+	G_ISI_HANDOFF_TIMEOUT,
+};
+
+/* Message or expired timeout handed over by the I/O thread */
+struct _GIsiHandoffMsg {
+	GIsiClientToken *token;
+	int type;
+	unsigned int id;	/* transaction of a timeout */
+	GSource *source;	/* the expired timeout, held */
+	uint16_t obj;
+	uint8_t res;
+	size_t len;
+	uint8_t msg[];
+};
+typedef struct _GIsiHandoffMsg GIsiHandoffMsg;
+
+struct _GIsiIOTimeout {
+	GIsiClientToken *token;
+	GIsiIOThread *io;
+	unsigned int id;
+};
+typedef struct _GIsiIOTimeout GIsiIOTimeout;
+
 struct _GIsiClient {
 	uint8_t resource;
 	uint16_t server_obj;
@@ -70,6 +160,12 @@ struct _GIsiClient {
 	} version;
 	GIsiModem *modem;
 	int error;
+	GIsiSlab *slab; /* for requests, may be NULL */
+	GMainContext *context; /* all sources, NULL for the default */
+
+	/* Sockets and timeouts served by an I/O thread, NULL if not */
+	GIsiIOThread *io;
+	GIsiClientToken *token;
 
 	/* Requests */
 	struct {
@@ -77,6 +173,8 @@ struct _GIsiClient {
 		guint source;
 		unsigned int last; /* last used transaction ID */
 		void *pending;
+		GSList *flights; /* pending requests open for joining */
+		uint32_t coalesce[256 / 32]; /* message IDs to coalesce */
 	} reqs;
 
 	/* Indications */
@@ -85,8 +183,12 @@ struct _GIsiClient {
 		guint source;
 		unsigned int count;
 		void *subs;
+		GIsiIndHub *hub; /* shared socket, instead of fd */
 	} inds;
 
+	/* Response cache, NULL unless enabled */
+	GIsiCache *cache;
+
 	/* Debugging */
 	GIsiDebugFunc debug_func;
 	void *debug_data;
@@ -95,20 +197,161 @@ struct _GIsiClient {
 static gboolean g_isi_callback(GIOChannel *channel, GIOCondition cond,
 				gpointer data);
 static gboolean g_isi_timeout(gpointer data);
+static GIsiClient *g_isi_client_new(GIsiModem *modem, uint8_t resource,
+					GMainContext *context,
+					GIsiIOThread *io);
+static GSource *g_isi_io_timeout_add(GIsiClient *client, unsigned seconds,
+					unsigned int id);
+static void g_isi_handoff(GIsiClientToken *token, GIsiIOThread *io,
+				int type, uint8_t res, uint16_t obj,
+				const uint8_t *msg, size_t len);
+static void g_isi_token_unref(GIsiClientToken *token);
+static void g_isi_dispatch_indication(GIsiClient *client, uint8_t res,
+					uint16_t obj, uint8_t *msg,
+					size_t len);
 
-static void g_isi_vdebug(const struct iovec *__restrict iov,
-				size_t iovlen, size_t total_len,
-				GIsiDebugFunc func, void *data)
+static GIsiRequest *g_isi_request_alloc(GIsiClient *client)
+{
+	GIsiRequest *req;
+
+	if (!client->slab)
+		return g_try_new0(GIsiRequest, 1);
+
+	req = g_isi_slab_alloc(client->slab);
+	if (!req)
+		return NULL;
+
+	memset(req, 0, sizeof(*req));
+	req->slab = client->slab;
+	return req;
+}
+
+static void g_isi_request_release(GIsiRequest *req)
+{
+	if (req && req->slab)
+		g_isi_slab_free(req->slab, req);
+	else
+		g_free(req);
+}
+
+/* Context the callbacks of @client are run from */
+static GMainContext *g_isi_client_app_context(GIsiClient *client)
+{
+	if (client->io)
+		return g_isi_io_thread_get_app_context(client->io);
+
+	return client->context;
+}
+
+/* Context the timeout of @req is attached to */
+static GMainContext *g_isi_request_context(GIsiRequest *req)
+{
+	/* answers from the cache are delivered from an idle callback */
+	if (req->id == 0)
+		return g_isi_client_app_context(req->client);
+
+	return req->client->context;
+}
+
+/* The I/O thread may be finalizing its timeout, so that one is held
+ * rather than removed by ID */
+static void g_isi_request_untime(GIsiRequest *req)
+{
+	if (req->timeout > 0)
+		g_isi_source_remove(g_isi_request_context(req), req->timeout);
+	req->timeout = 0;
+	g_isi_source_drop(&req->io_timeout);
+}
+
+/* Modems may be driven from different threads, these are shared */
+G_LOCK_DEFINE_STATIC(modems);
+static GHashTable *ind_hubs;	/* GIsiModem -> GIsiIndHub */
+static GHashTable *modem_sockets; /* GIsiModem -> Phonet sockets in use */
+
+static void g_isi_socket_account_locked(GIsiModem *modem, int delta)
+{
+	unsigned count;
+
+	if (!modem_sockets)
+		modem_sockets = g_hash_table_new(g_direct_hash,
+							g_direct_equal);
+
+	count = GPOINTER_TO_UINT(g_hash_table_lookup(modem_sockets, modem));
+	count += delta;
+
+	if (count)
+		g_hash_table_insert(modem_sockets, modem,
+					GUINT_TO_POINTER(count));
+	else
+		g_hash_table_remove(modem_sockets, modem);
+}
+
+static void g_isi_socket_account(GIsiModem *modem, int delta)
+{
+	G_LOCK(modems);
+	g_isi_socket_account_locked(modem, delta);
+	G_UNLOCK(modems);
+}
+
+/**
+ * Size of the objects a slab passed to g_isi_client_set_slab() has to
+ * provide.
+ * @return request object size
+ */
+size_t g_isi_request_size(void)
+{
+	return sizeof(GIsiRequest);
+}
+
+/**
+ * Allocate the requests of @a client from @a slab, e.g. one slab shared
+ * by all clients of a modem. The slab has to outlive the client.
+ * Requests already pending are not affected.
+ * @param client client
+ * @param slab slab of g_isi_request_size() objects, NULL for the heap
+ */
+void g_isi_client_set_slab(GIsiClient *client, GIsiSlab *slab)
+{
+	client->slab = slab;
+}
+
+/**
+ * Count the Phonet sockets GIsiClient instances and the indication hub
+ * currently hold for @a modem.
+ * @param modem modem
+ * @return number of open sockets.
+ */
+unsigned g_isi_modem_sockets(GIsiModem *modem)
+{
+	unsigned count = 0;
+
+	G_LOCK(modems);
+	if (modem_sockets)
+		count = GPOINTER_TO_UINT(g_hash_table_lookup(modem_sockets,
+								modem));
+	G_UNLOCK(modems);
+
+	return count;
+}
+
+static void g_isi_iov_copy(uint8_t *dst, const struct iovec *__restrict iov,
+				size_t iovlen)
 {
-	uint8_t debug[total_len];
-	uint8_t *ptr = debug;
 	size_t i;
 
 	for (i = 0; i < iovlen; i++) {
-		memcpy(ptr, iov[i].iov_base, iov[i].iov_len);
-		ptr += iov[i].iov_len;
+		memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+		dst += iov[i].iov_len;
 	}
+}
+
+static void g_isi_vdebug(const struct iovec *__restrict iov,
+				size_t iovlen, size_t total_len,
+				GIsiDebugFunc func, void *data)
+{
+	uint8_t debug[total_len];
 
+	g_isi_iov_copy(debug, iov, iovlen);
 	func(debug, total_len, data);
 }
 
@@ -121,12 +364,515 @@ static int g_isi_cmp(const void *a, const void *b)
 	return *ua - *ub;
 }
 
+static time_t g_isi_now(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+		return 0;
+
+	return ts.tv_sec;
+}
+
+static guint g_isi_cache_hash(gconstpointer key)
+{
+	const GIsiCacheEntry *entry = key;
+	guint hash = 5381 + entry->resource;
+	size_t i;
+
+	for (i = 0; i < entry->req_len; i++)
+		hash = (hash << 5) + hash + entry->data[i];
+
+	return hash;
+}
+
+static gboolean g_isi_cache_equal(gconstpointer a, gconstpointer b)
+{
+	const GIsiCacheEntry *ea = a;
+	const GIsiCacheEntry *eb = b;
+
+	return ea->resource == eb->resource && ea->req_len == eb->req_len
+		&& memcmp(ea->data, eb->data, ea->req_len) == 0;
+}
+
+static size_t g_isi_iov_len(const struct iovec *__restrict iov,
+				size_t iovlen)
+{
+	size_t i, len = 0;
+
+	for (i = 0; i < iovlen; i++)
+		len += iov[i].iov_len;
+
+	return len;
+}
+
+static gboolean g_isi_cache_deliver(gpointer data)
+{
+	GIsiRequest *req = data;
+
+	req->timeout = 0;
+	req->func(req->client, req->payload, req->payload_len, req->object,
+			req->data);
+	g_isi_request_cancel(req);
+
+	return FALSE;
+}
+
+/* Answer a request from the cache, if a fresh response is available */
+static GIsiRequest *g_isi_cache_lookup(GIsiClient *client, uint8_t resource,
+					const struct iovec *__restrict iov,
+					size_t iovlen, GIsiResponseFunc cb,
+					void *opaque, GDestroyNotify notify)
+{
+	GIsiCache *cache = client->cache;
+	size_t len = g_isi_iov_len(iov, iovlen);
+	uint64_t buf[(sizeof(GIsiCacheEntry) + len + 7) / 8];
+	GIsiCacheEntry *key = (GIsiCacheEntry *)buf;
+	GIsiCacheEntry *entry;
+	GIsiRequest *req;
+
+	if (len == 0 || iov[0].iov_len == 0)
+		return NULL;
+
+	if (cache->ttl[*(uint8_t *)iov[0].iov_base] == 0)
+		return NULL;
+
+	key->resource = resource;
+	key->req_len = len;
+	g_isi_iov_copy(key->data, iov, iovlen);
+
+	entry = g_hash_table_lookup(cache->entries, key);
+	if (!entry)
+		return NULL;
+
+	if (entry->expires <= g_isi_now()) {
+		g_hash_table_remove(cache->entries, entry);
+		return NULL;
+	}
+
+	req = g_isi_request_alloc(client);
+	if (!req)
+		return NULL;
+
+	req->payload = g_try_malloc(entry->resp_len);
+	if (!req->payload) {
+		g_isi_request_release(req);
+		return NULL;
+	}
+
+	memcpy(req->payload, entry->data + entry->req_len, entry->resp_len);
+	req->payload_len = entry->resp_len;
+	req->object = entry->object;
+	req->resource = resource;
+	req->client = client;
+	req->id = 0;
+	req->func = cb;
+	req->data = opaque;
+	req->notify = notify;
+	req->timeout = g_isi_idle_add(g_isi_client_app_context(client),
+					g_isi_cache_deliver, req);
+
+	cache->hits = g_slist_prepend(cache->hits, req);
+	return req;
+}
+
+static gboolean g_isi_cacheable(GIsiClient *client, GIsiRequest *req)
+{
+	return client->cache && req->payload &&
+		client->cache->ttl[req->payload[0]] > 0;
+}
+
+static inline gboolean g_isi_coalesces(const GIsiClient *client,
+					uint8_t msg_id)
+{
+	return (client->reqs.coalesce[msg_id / 32] >> (msg_id % 32)) & 1;
+}
+
+/* Remember the payload of a request whose response may be cached or
+ * shared with identical requests */
+static gboolean g_isi_save_payload(GIsiClient *client, GIsiRequest *req,
+					const struct iovec *__restrict iov,
+					size_t iovlen)
+{
+	size_t len = g_isi_iov_len(iov, iovlen);
+
+	if (len == 0 || iov[0].iov_len == 0)
+		return TRUE;
+
+	if (!g_isi_coalesces(client, *(uint8_t *)iov[0].iov_base) &&
+			(!client->cache ||
+			client->cache->ttl[*(uint8_t *)iov[0].iov_base] == 0))
+		return TRUE;
+
+	req->payload = g_try_malloc(len);
+	if (!req->payload)
+		return FALSE;
+
+	g_isi_iov_copy(req->payload, iov, iovlen);
+	req->payload_len = len;
+	return TRUE;
+}
+
+static void g_isi_cache_store(GIsiClient *client, GIsiRequest *req,
+				uint16_t obj, const uint8_t *msg, size_t len)
+{
+	GIsiCache *cache = client->cache;
+	GIsiCacheEntry *entry;
+
+	entry = g_try_malloc(sizeof(GIsiCacheEntry) + req->payload_len + len);
+	if (!entry)
+		return;
+
+	entry->resource = req->resource;
+	entry->object = obj;
+	entry->expires = g_isi_now() + cache->ttl[req->payload[0]];
+	entry->req_len = req->payload_len;
+	entry->resp_len = len;
+	memcpy(entry->data, req->payload, req->payload_len);
+	memcpy(entry->data + req->payload_len, msg, len);
+
+	g_hash_table_replace(cache->entries, entry, entry);
+}
+
+static gboolean g_isi_cache_match_type(gpointer key, gpointer value,
+					gpointer data)
+{
+	const GIsiCacheEntry *entry = value;
+
+	return entry->data[0] == *(uint8_t *)data;
+}
+
+static void g_isi_cache_invalidate_by(GIsiClient *client, unsigned int ind)
+{
+	GSList *l;
+
+	for (l = client->cache->invalidators; l; l = l->next) {
+		GIsiCacheInvalidator *inv = l->data;
+
+		if (inv->ind == ind)
+			g_hash_table_foreach_remove(client->cache->entries,
+							g_isi_cache_match_type,
+							&inv->type);
+	}
+}
+
+static gboolean g_isi_cache_watches(GIsiClient *client, unsigned int ind)
+{
+	GSList *l;
+
+	if (!client->cache)
+		return FALSE;
+
+	for (l = client->cache->invalidators; l; l = l->next) {
+		GIsiCacheInvalidator *inv = l->data;
+
+		if (inv->ind == ind)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static GIsiCache *g_isi_cache_get(GIsiClient *client)
+{
+	if (client->cache)
+		return client->cache;
+
+	client->cache = g_try_new0(GIsiCache, 1);
+	if (!client->cache)
+		return NULL;
+
+	client->cache->entries = g_hash_table_new_full(g_isi_cache_hash,
+							g_isi_cache_equal,
+							NULL, g_free);
+	return client->cache;
+}
+
+/**
+ * Cache responses to requests of the given message type for @a ttl
+ * seconds. Later requests with identical payload to the same resource
+ * are answered from the cache, asynchronously, without contacting the
+ * modem. A response is cached once the response callback accepts it,
+ * unless the callback calls g_isi_response_uncacheable().
+ * @param client ISI client (from g_isi_client_create())
+ * @param type request message ID
+ * @param ttl lifetime of cached responses in seconds, 0 disables caching
+ * @return 0 on success, a system error code otherwise.
+ */
+int g_isi_cache_set_ttl(GIsiClient *client, uint8_t type, unsigned ttl)
+{
+	GIsiCache *cache;
+
+	if (!client)
+		return -EINVAL;
+
+	cache = g_isi_cache_get(client);
+	if (!cache)
+		return -ENOMEM;
+
+	cache->ttl[type] = ttl;
+	if (ttl == 0)
+		g_hash_table_foreach_remove(cache->entries,
+						g_isi_cache_match_type, &type);
+	return 0;
+}
+
+/**
+ * Drop cached responses to requests of message type @a type whenever
+ * the indication @a ind_type is received from the resource of @a client.
+ * The indication is subscribed if necessary.
+ * @param client ISI client (from g_isi_client_create())
+ * @param ind_type indication message ID
+ * @param type request message ID
+ * @return 0 on success, a system error code otherwise.
+ */
+int g_isi_cache_invalidate_on(GIsiClient *client, uint8_t ind_type,
+				uint8_t type)
+{
+	GIsiCacheInvalidator *inv;
+	GIsiIndication *ind;
+	GIsiIndication **old;
+	GIsiCache *cache;
+
+	if (!client)
+		return -EINVAL;
+
+	cache = g_isi_cache_get(client);
+	if (!cache)
+		return -ENOMEM;
+
+	inv = g_try_new0(GIsiCacheInvalidator, 1);
+	ind = g_try_new0(GIsiIndication, 1);
+	if (!inv || !ind) {
+		g_free(inv);
+		g_free(ind);
+		return -ENOMEM;
+	}
+
+	inv->ind = (client->resource << 8) | ind_type;
+	inv->type = type;
+	ind->type = inv->ind;
+
+	old = tsearch(ind, &client->inds.subs, g_isi_cmp);
+	if (!old) {
+		g_free(inv);
+		g_free(ind);
+		return -ENOMEM;
+	}
+
+	if (*old != ind)
+		g_free(ind);
+	else
+		client->inds.count++;
+
+	cache->invalidators = g_slist_prepend(cache->invalidators, inv);
+	return g_isi_commit_subscriptions(client);
+}
+
+/**
+ * Drop all cached responses of @a client.
+ * @param client ISI client (from g_isi_client_create())
+ */
+void g_isi_cache_flush(GIsiClient *client)
+{
+	if (!client || !client->cache)
+		return;
+
+	g_hash_table_remove_all(client->cache->entries);
+}
+
+/**
+ * Keep the response currently being processed out of the cache, e.g.
+ * because it reports an error. Only meaningful from within a response
+ * callback.
+ * @param client ISI client (from g_isi_client_create())
+ */
+void g_isi_response_uncacheable(GIsiClient *client)
+{
+	if (!client || !client->cache)
+		return;
+
+	client->cache->skip = TRUE;
+}
+
+static gboolean g_isi_iov_equal(const uint8_t *data, size_t len,
+				const struct iovec *__restrict iov,
+				size_t iovlen)
+{
+	size_t i, off = 0;
+
+	for (i = 0; i < iovlen; i++) {
+		if (off + iov[i].iov_len > len)
+			return FALSE;
+		if (memcmp(data + off, iov[i].iov_base, iov[i].iov_len))
+			return FALSE;
+		off += iov[i].iov_len;
+	}
+
+	return off == len;
+}
+
+/* Find a pending request with the same destination and payload */
+static GIsiRequest *g_isi_flight_find(GIsiClient *client, uint8_t resource,
+					const struct iovec *__restrict iov,
+					size_t iovlen)
+{
+	GSList *l;
+
+	for (l = client->reqs.flights; l; l = l->next) {
+		GIsiRequest *req = l->data;
+
+		if (req->resource != resource)
+			continue;
+
+		if (g_isi_iov_equal(req->payload, req->payload_len, iov, iovlen))
+			return req;
+	}
+
+	return NULL;
+}
+
+/* Wait for the response to @flight instead of sending a new request */
+static GIsiRequest *g_isi_flight_join(GIsiRequest *flight,
+					GIsiResponseFunc cb, void *opaque,
+					GDestroyNotify notify)
+{
+	GIsiRequest *req = g_isi_request_alloc(flight->client);
+
+	if (!req) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	req->client = flight->client;
+	req->id = flight->id;
+	req->resource = flight->resource;
+	req->func = cb;
+	req->data = opaque;
+	req->notify = notify;
+	req->primary = flight;
+
+	flight->joined = g_slist_append(flight->joined, req);
+	return req;
+}
+
+/* Finish a transaction once neither its sender nor anyone who joined
+ * it is waiting anymore */
+static void g_isi_flight_release(GIsiRequest *flight)
+{
+	if (!flight->busy && !flight->func && !flight->joined)
+		g_isi_request_cancel(flight);
+}
+
+/* Stop offering pending requests of @a msg_id for joining */
+static void g_isi_flight_drop(GIsiClient *client, uint8_t msg_id)
+{
+	GSList *l = client->reqs.flights;
+
+	while (l) {
+		GIsiRequest *req = l->data;
+
+		l = l->next;
+		if (req->payload[0] == msg_id)
+			client->reqs.flights =
+				g_slist_remove(client->reqs.flights, req);
+	}
+}
+
+/**
+ * Enable or disable coalescing of identical requests with message ID
+ * @a msg_id. While enabled, such a request whose destination and
+ * payload match a pending request of @a client is not sent; it joins
+ * the pending transaction instead and its callback receives the same
+ * response(s). Joined requests share the timeout of the transaction
+ * they joined. Only enable it for requests without side effects.
+ * @param client ISI client (from g_isi_client_create())
+ * @param msg_id message ID of the request
+ * @param enabled whether to coalesce requests
+ */
+void g_isi_client_set_coalesce_id(GIsiClient *client, uint8_t msg_id,
+					gboolean enabled)
+{
+	if (!client)
+		return;
+
+	if (enabled) {
+		client->reqs.coalesce[msg_id / 32] |= 1u << (msg_id % 32);
+	} else {
+		client->reqs.coalesce[msg_id / 32] &= ~(1u << (msg_id % 32));
+		g_isi_flight_drop(client, msg_id);
+	}
+}
+
+/**
+ * Enable or disable coalescing for all requests of @a client, see
+ * g_isi_client_set_coalesce_id().
+ * @param client ISI client (from g_isi_client_create())
+ * @param enabled whether to coalesce requests
+ */
+void g_isi_client_set_coalesce(GIsiClient *client, gboolean enabled)
+{
+	if (!client)
+		return;
+
+	memset(client->reqs.coalesce, enabled ? 0xff : 0,
+		sizeof(client->reqs.coalesce));
+	if (!enabled) {
+		g_slist_free(client->reqs.flights);
+		client->reqs.flights = NULL;
+	}
+}
+
 /**
  * Create an ISI client.
  * @param resource PhoNet resource ID for the client
  * @return NULL on error (see errno), a GIsiClient pointer on success,
  */
 GIsiClient *g_isi_client_create(GIsiModem *modem, uint8_t resource)
+{
+	return g_isi_client_create_with_context(modem, resource, NULL);
+}
+
+/**
+ * Create an ISI client whose callbacks are dispatched from @a context.
+ * The client must only be used from the thread running @a context.
+ * @param resource PhoNet resource ID for the client
+ * @param context main context, NULL for the default one
+ * @return NULL on error (see errno), a GIsiClient pointer on success,
+ */
+GIsiClient *g_isi_client_create_with_context(GIsiModem *modem,
+						uint8_t resource,
+						GMainContext *context)
+{
+	return g_isi_client_new(modem, resource, context, NULL);
+}
+
+/**
+ * Create an ISI client whose socket reads and request timeouts are
+ * handled by the I/O thread @a io. Callbacks are run from the
+ * application context of @a io, in the order messages arrived and
+ * timeouts expired, so a stalled application does not see responses
+ * time out. The client must only be used from the application context
+ * and destroyed before @a io.
+ * @param resource PhoNet resource ID for the client
+ * @param io I/O thread
+ * @return NULL on error (see errno), a GIsiClient pointer on success,
+ */
+GIsiClient *g_isi_client_create_threaded(GIsiModem *modem, uint8_t resource,
+						GIsiIOThread *io)
+{
+	if (!io) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return g_isi_client_new(modem, resource,
+				g_isi_io_thread_get_context(io), io);
+}
+
+static GIsiClient *g_isi_client_new(GIsiModem *modem, uint8_t resource,
+					GMainContext *context,
+					GIsiIOThread *io)
 {
 	GIsiClient *client;
 	GIOChannel *channel;
@@ -137,12 +883,27 @@ GIsiClient *g_isi_client_create(GIsiModem *modem, uint8_t resource)
 		return NULL;
 	}
 
+	/* before the first watch, the I/O thread reads these */
+	if (io) {
+		client->token = g_try_new0(GIsiClientToken, 1);
+		if (!client->token) {
+			g_free(client);
+			errno = ENOMEM;
+			return NULL;
+		}
+
+		client->token->refs = 1;
+		client->token->client = client;
+		client->io = io;
+	}
+
 	client->resource = resource;
 	client->version.major = -1;
 	client->version.minor = -1;
 	client->modem = modem;
 	client->error = 0;
 	client->debug_func = NULL;
+	client->context = context ? g_main_context_ref(context) : NULL;
 
 	client->reqs.last = 0;
 	client->reqs.pending = NULL;
@@ -152,18 +913,32 @@ GIsiClient *g_isi_client_create(GIsiModem *modem, uint8_t resource)
 
 	channel = phonet_new(modem, resource);
 	if (!channel) {
+		if (client->context)
+			g_main_context_unref(client->context);
+		g_free(client->token);
 		g_free(client);
 		return NULL;
 	}
 	client->reqs.fd = g_io_channel_unix_get_fd(channel);
-	client->reqs.source = g_io_add_watch(channel,
+	client->reqs.source = g_isi_watch_add(context, channel,
 					G_IO_IN|G_IO_ERR|G_IO_HUP|G_IO_NVAL,
 					g_isi_callback, client);
 	g_io_channel_unref(channel);
+	g_isi_socket_account(modem, 1);
 
 	return client;
 }
 
+/**
+ * Returns the main context @a client dispatches from.
+ * @param client client
+ * @return main context, NULL for the default one
+ */
+GMainContext *g_isi_client_get_context(GIsiClient *client)
+{
+	return client ? client->context : NULL;
+}
+
 /**
  * Set the ISI resource version of @a client.
  * @param client client for the resource
@@ -256,6 +1031,7 @@ void g_isi_client_set_debug(GIsiClient *client, GIsiDebugFunc func,
 static void g_isi_cleanup_req(void *data)
 {
 	GIsiRequest *req = data;
+	GSList *l;
 
 	if (!req)
 		return;
@@ -266,13 +1042,36 @@ static void g_isi_cleanup_req(void *data)
 		req->func(req->client, NULL, 0, 0, req->data);
 	req->client->error = 0;
 
+	for (l = req->joined; l; l = l->next) {
+		GIsiRequest *w = l->data;
+
+		req->client->error = ESHUTDOWN;
+		w->func(w->client, NULL, 0, 0, w->data);
+		req->client->error = 0;
+
+		if (w->notify)
+			w->notify(w->data);
+		g_isi_request_release(w);
+	}
+	g_slist_free(req->joined);
+
 	if (req->notify)
 		req->notify(req->data);
 
-	if (req->timeout > 0)
-		g_source_remove(req->timeout);
+	g_isi_request_untime(req);
+
+	g_free(req->payload);
+	g_isi_request_release(req);
+}
 
-	g_free(req);
+static void g_isi_cleanup_hit(gpointer data, gpointer user_data)
+{
+	g_isi_cleanup_req(data);
+}
+
+static void g_isi_free_invalidator(gpointer data, gpointer user_data)
+{
+	g_free(data);
 }
 
 static void g_isi_cleanup_ind(void *data)
@@ -294,17 +1093,41 @@ void g_isi_client_destroy(GIsiClient *client)
 	if (!client)
 		return;
 
+	g_isi_client_set_coalesce(client, FALSE);
 	tdestroy(client->reqs.pending, g_isi_cleanup_req);
 	if (client->reqs.source > 0)
-		g_source_remove(client->reqs.source);
+		g_isi_source_remove(client->context, client->reqs.source);
+
+	if (client->cache) {
+		g_slist_foreach(client->cache->hits, g_isi_cleanup_hit, NULL);
+		g_slist_free(client->cache->hits);
+		g_slist_foreach(client->cache->invalidators,
+				g_isi_free_invalidator, NULL);
+		g_slist_free(client->cache->invalidators);
+		g_hash_table_destroy(client->cache->entries);
+		g_free(client->cache);
+	}
 
 	tdestroy(client->inds.subs, g_isi_cleanup_ind);
 	client->inds.subs = NULL;
 	client->inds.count = 0;
 	g_isi_commit_subscriptions(client);
-	if (client->inds.source > 0)
-		g_source_remove(client->inds.source);
+	if (client->inds.source > 0) {
+		g_isi_source_remove(client->context, client->inds.source);
+		g_isi_socket_account(client->modem, -1);
+	}
+
+	g_isi_socket_account(client->modem, -1);
+
+	if (client->io) {
+		/* the I/O thread may be reading from the client right now */
+		g_isi_io_thread_sync(client->io);
+		client->token->client = NULL;
+		g_isi_token_unref(client->token);
+	}
 
+	if (client->context)
+		g_main_context_unref(client->context);
 	g_free(client);
 }
 
@@ -462,10 +1285,25 @@ GIsiRequest *g_isi_vsendto(GIsiClient *client,
 		return NULL;
 	}
 
+	if (cb && client->cache) {
+		req = g_isi_cache_lookup(client, dst->spn_resource, iov,
+						iovlen, cb, opaque, notify);
+		if (req)
+			return req;
+	}
+
+	if (cb && iovlen > 0 && iov[0].iov_len > 0 &&
+			g_isi_coalesces(client, *(uint8_t *)iov[0].iov_base)) {
+		req = g_isi_flight_find(client, dst->spn_resource, iov,
+						iovlen);
+		if (req)
+			return g_isi_flight_join(req, cb, opaque, notify);
+	}
+
 	key = 1 + ((client->reqs.last + 1) % 255);
 
 	if (cb) {
-		req = g_try_new0(GIsiRequest, 1);
+		req = g_isi_request_alloc(client);
 		if (!req) {
 			errno = ENOMEM;
 			return NULL;
@@ -476,6 +1314,13 @@ GIsiRequest *g_isi_vsendto(GIsiClient *client,
 		req->func = cb;
 		req->data = opaque;
 		req->notify = notify;
+		req->resource = dst->spn_resource;
+
+		if (!g_isi_save_payload(client, req, iov, iovlen)) {
+			g_isi_request_release(req);
+			errno = ENOMEM;
+			return NULL;
+		}
 
 		old = tsearch(req, &client->reqs.pending, g_isi_cmp);
 		if (!old) {
@@ -520,15 +1365,23 @@ GIsiRequest *g_isi_vsendto(GIsiClient *client,
 		goto error;
 	}
 
-	if (req && timeout)
-		req->timeout = g_timeout_add_seconds(timeout, g_isi_timeout,
+	if (req && timeout && client->io)
+		req->io_timeout = g_isi_io_timeout_add(client, timeout,
+							req->id);
+	else if (req && timeout)
+		req->timeout = g_isi_timeout_add_seconds(client->context,
+						timeout, g_isi_timeout, req);
+	if (req && req->payload && g_isi_coalesces(client, req->payload[0]))
+		client->reqs.flights = g_slist_prepend(client->reqs.flights,
 							req);
 	client->reqs.last = key;
 	return req;
 
 error:
 	tdelete(req, &client->reqs.pending, g_isi_cmp);
-	g_free(req);
+	if (req)
+		g_free(req->payload);
+	g_isi_request_release(req);
 
 	return NULL;
 }
@@ -580,20 +1433,56 @@ GIsiRequest *g_isi_vsend(GIsiClient *client,
  */
 void g_isi_request_cancel(GIsiRequest *req)
 {
+	GIsiClient *client;
+	GIsiRequest *flight;
+
 	if (!req)
 		return;
 
-	if (req->timeout > 0)
-		g_source_remove(req->timeout);
+	client = req->client;
 
-	tdelete(req, &req->client->reqs.pending, g_isi_cmp);
+	if (req->primary) {
+		flight = req->primary;
+		flight->joined = g_slist_remove(flight->joined, req);
+
+		if (req->notify)
+			req->notify(req->data);
+		g_isi_request_release(req);
+
+		g_isi_flight_release(flight);
+		return;
+	}
+
+	if (req->joined || req->busy) {
+		/* Others still wait for this transaction */
+		if (req->notify)
+			req->notify(req->data);
+
+		req->func = NULL;
+		req->data = NULL;
+		req->notify = NULL;
+		return;
+	}
+
+	g_isi_request_untime(req);
+
+	if (req->id == 0) {
+		client->cache->hits = g_slist_remove(client->cache->hits, req);
+	} else {
+		tdelete(req, &client->reqs.pending, g_isi_cmp);
+		client->reqs.flights = g_slist_remove(client->reqs.flights,
+							req);
+	}
 
 	if (req->notify)
 		req->notify(req->data);
 
-	g_free(req);
+	g_free(req->payload);
+	g_isi_request_release(req);
 }
 
+/* twalk() takes no user data, the message being built is passed here */
+G_LOCK_DEFINE_STATIC(subscribe_msg);
 static uint8_t *__msg;
 static void build_subscribe_msg(const void *nodep,
 				const VISIT which,
@@ -615,6 +1504,250 @@ static void build_subscribe_msg(const void *nodep,
 	}
 }
 
+/* Append the subscribed resources of @client to @msg */
+static void g_isi_collect_resources(GIsiClient *client, uint8_t *msg)
+{
+	G_LOCK(subscribe_msg);
+	__msg = msg;
+	twalk(client->inds.subs, build_subscribe_msg);
+	__msg = NULL;
+	G_UNLOCK(subscribe_msg);
+}
+
+static void g_isi_hub_free(GIsiIndHub *hub)
+{
+	g_isi_socket_account(hub->modem, -1);
+	if (hub->context)
+		g_main_context_unref(hub->context);
+	g_free(hub);
+}
+
+/* Subscribe the hub socket to the resources of all attached clients */
+static int g_isi_hub_commit(GIsiIndHub *hub)
+{
+	uint8_t msg[3+256] = {
+		0, PNS_SUBSCRIBED_RESOURCES_IND,
+		0,
+	};
+	uint8_t part[3+256];
+	uint8_t seen[256 / 8] = { 0 };
+	GSList *l;
+	int i;
+
+	for (l = hub->clients; l; l = l->next) {
+		GIsiClient *client = l->data;
+
+		part[2] = 0;
+		g_isi_collect_resources(client, part);
+
+		for (i = 0; i < part[2]; i++) {
+			uint8_t res = part[3 + i];
+
+			if (seen[res / 8] & (1 << res % 8))
+				continue;
+
+			seen[res / 8] |= 1 << res % 8;
+			msg[3 + msg[2]++] = res;
+		}
+	}
+
+	if (sendto(hub->fd, msg, 3+msg[2], MSG_NOSIGNAL, (void *)&commgr,
+			sizeof(commgr)) == -1)
+		return -errno;
+
+	return 0;
+}
+
+static gboolean g_isi_hub_callback(GIOChannel *channel, GIOCondition cond,
+					gpointer data)
+{
+	GIsiIndHub *hub = data;
+	GSList *clients, *l;
+	int len;
+
+	if (cond & (G_IO_NVAL|G_IO_HUP)) {
+		g_warning("Unexpected event on Phonet channel %p", channel);
+		hub->source = 0;
+		return FALSE;
+	}
+
+	len = phonet_peek_length(channel);
+	if (len <= 0)
+		return TRUE;
+
+	{
+		uint32_t buf[(len + 3) / 4];
+		uint8_t *msg = (uint8_t *)buf;
+		uint16_t obj;
+		uint8_t res;
+
+		len = phonet_read(channel, buf, len, &obj, &res);
+		if (len < 2)
+			return TRUE;
+
+		/* One read for all clients, they filter by subscription */
+		hub->dispatching = TRUE;
+		clients = g_slist_copy(hub->clients);
+
+		for (l = clients; l; l = l->next) {
+			GIsiClient *client = l->data;
+
+			/* destroyed by an earlier callback */
+			if (!g_slist_find(hub->clients, client))
+				continue;
+
+			if (client->debug_func)
+				client->debug_func(msg + 1, len - 1,
+							client->debug_data);
+
+			g_isi_dispatch_indication(client, res, obj, msg + 1,
+							len - 1);
+		}
+
+		g_slist_free(clients);
+		hub->dispatching = FALSE;
+	}
+
+	/* released from a callback */
+	if (hub->refs == 0) {
+		g_isi_hub_free(hub);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static int g_isi_hub_attach(GIsiIndHub *hub, GIsiClient *client)
+{
+	/* the hub is gone, fall back to a socket of its own */
+	if (!hub) {
+		client->inds.hub = NULL;
+		return g_isi_commit_subscriptions(client);
+	}
+
+	if (!client->inds.hub) {
+		if (client->inds.source) {
+			g_isi_source_remove(client->context, client->inds.source);
+			client->inds.source = 0;
+			g_isi_socket_account(client->modem, -1);
+		}
+
+		client->inds.hub = hub;
+		hub->clients = g_slist_prepend(hub->clients, client);
+	}
+
+	if (client->inds.count == 0) {
+		hub->clients = g_slist_remove(hub->clients, client);
+		client->inds.hub = NULL;
+	}
+
+	return g_isi_hub_commit(hub);
+}
+
+/**
+ * Share one indication socket among all clients of @a modem. Clients
+ * move to the shared socket on their next subscription change. Calls
+ * nest, the socket is closed by the last g_isi_ind_hub_unref().
+ * @param modem modem
+ * @return 0 on success, a system error code otherwise.
+ */
+int g_isi_ind_hub_ref(GIsiModem *modem)
+{
+	return g_isi_ind_hub_ref_with_context(modem, NULL);
+}
+
+/**
+ * Like g_isi_ind_hub_ref(), for a hub dispatching from @a context. Only
+ * clients created with the same context share it, so all clients of
+ * @a modem should use the same one. Nested references keep the context
+ * of the first.
+ * @param modem modem
+ * @param context main context, NULL for the default one
+ * @return 0 on success, a system error code otherwise.
+ */
+int g_isi_ind_hub_ref_with_context(GIsiModem *modem, GMainContext *context)
+{
+	GIOChannel *channel;
+	GIsiIndHub *hub;
+	int err = 0;
+
+	G_LOCK(modems);
+
+	if (!ind_hubs)
+		ind_hubs = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	hub = g_hash_table_lookup(ind_hubs, modem);
+	if (hub) {
+		hub->refs++;
+		goto out;
+	}
+
+	hub = g_try_new0(GIsiIndHub, 1);
+	if (!hub) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	channel = phonet_new(modem, PN_COMMGR);
+	if (!channel) {
+		err = -errno;
+		g_free(hub);
+		goto out;
+	}
+
+	hub->modem = modem;
+	hub->refs = 1;
+	hub->context = context ? g_main_context_ref(context) : NULL;
+	hub->fd = g_io_channel_unix_get_fd(channel);
+	hub->source = g_isi_watch_add(context, channel,
+					G_IO_IN|G_IO_ERR|G_IO_HUP|G_IO_NVAL,
+					g_isi_hub_callback, hub);
+	g_io_channel_unref(channel);
+	g_isi_socket_account_locked(modem, 1);
+
+	g_hash_table_insert(ind_hubs, modem, hub);
+out:
+	G_UNLOCK(modems);
+	return err;
+}
+
+/**
+ * Drop a reference taken with g_isi_ind_hub_ref(). When the last one is
+ * gone, the clients of @a modem get indication sockets of their own.
+ * @param modem modem
+ */
+void g_isi_ind_hub_unref(GIsiModem *modem)
+{
+	GIsiIndHub *hub;
+
+	G_LOCK(modems);
+
+	hub = ind_hubs ? g_hash_table_lookup(ind_hubs, modem) : NULL;
+	if (!hub || --hub->refs > 0) {
+		G_UNLOCK(modems);
+		return;
+	}
+
+	g_hash_table_remove(ind_hubs, modem);
+	G_UNLOCK(modems);
+
+	while (hub->clients) {
+		GIsiClient *client = hub->clients->data;
+
+		hub->clients = g_slist_delete_link(hub->clients,
+							hub->clients);
+		g_isi_hub_attach(NULL, client);
+	}
+
+	/* freed once the dispatch loop unwinds */
+	if (hub->dispatching)
+		return;
+
+	if (hub->source)
+		g_isi_source_remove(hub->context, hub->source);
+	g_isi_hub_free(hub);
+}
+
 /**
  * Subscribe indications from the modem.
  * @param client ISI client (from g_isi_client_create())
@@ -623,6 +1756,7 @@ static void build_subscribe_msg(const void *nodep,
 int g_isi_commit_subscriptions(GIsiClient *client)
 {
 	GIOChannel *channel;
+	GIsiIndHub *hub;
 	uint8_t msg[3+256] = {
 		0, PNS_SUBSCRIBED_RESOURCES_IND,
 		0,
@@ -631,6 +1765,18 @@ int g_isi_commit_subscriptions(GIsiClient *client)
 	if (!client)
 		return -EINVAL;
 
+	G_LOCK(modems);
+	hub = ind_hubs ? g_hash_table_lookup(ind_hubs, client->modem) : NULL;
+	G_UNLOCK(modems);
+
+	/* hubs only serve clients of their own context, and dispatch
+	 * directly instead of handing over to the application */
+	if (hub && (hub->context != client->context || client->io))
+		hub = NULL;
+
+	if (hub || client->inds.hub)
+		return g_isi_hub_attach(hub, client);
+
 	if (!client->inds.source) {
 		if (client->inds.count == 0)
 			return 0;
@@ -641,16 +1787,16 @@ int g_isi_commit_subscriptions(GIsiClient *client)
 
 		client->inds.fd = g_io_channel_unix_get_fd(channel);
 
-		client->inds.source = g_io_add_watch(channel,
-						G_IO_IN|G_IO_ERR|
+		client->inds.source = g_isi_watch_add(client->context,
+						channel, G_IO_IN|G_IO_ERR|
 						G_IO_HUP|G_IO_NVAL,
 						g_isi_callback, client);
 
 		g_io_channel_unref(channel);
+		g_isi_socket_account(client->modem, 1);
 	}
 
-	__msg = msg;
-	twalk(client->inds.subs, build_subscribe_msg);
+	g_isi_collect_resources(client, msg);
 
 	/* Subscribe by sending an indication */
 	sendto(client->inds.fd, msg, 3+msg[2], MSG_NOSIGNAL, (void *)&commgr,
@@ -746,9 +1892,22 @@ void g_isi_remove_subscription(GIsiClient *client, uint8_t res, uint8_t type)
 	GIsiIndication *ind;
 	unsigned int id = (res << 8) | type;
 
+	void *ret;
+
 	if (!client)
 		return;
 
+	/* Keep listening if the indication invalidates cached responses */
+	if (g_isi_cache_watches(client, id)) {
+		ret = tfind(&id, &client->inds.subs, g_isi_cmp);
+		if (ret) {
+			ind = *(GIsiIndication **)ret;
+			ind->func = NULL;
+			ind->data = NULL;
+		}
+		return;
+	}
+
 	ind = tdelete(&id, &client->inds.subs, g_isi_cmp);
 	if (!ind)
 		return;
@@ -781,6 +1940,9 @@ static void g_isi_dispatch_indication(GIsiClient *client, uint8_t res,
 	GIsiIndication *ind;
 	unsigned type = (res << 8) | msg[0];
 
+	if (client->cache)
+		g_isi_cache_invalidate_by(client, type);
+
 	ret = tfind(&type, &client->inds.subs, g_isi_cmp);
 	if (!ret)
 		return;
@@ -797,6 +1959,9 @@ static void g_isi_dispatch_response(GIsiClient *client, uint8_t res,
 {
 	void *ret;
 	GIsiRequest *req;
+	GSList *waiters, *l;
+	gboolean cacheable;
+	gboolean accepted = FALSE;
 	unsigned id = msg[0];
 
 	ret = tfind(&id, &client->reqs.pending, g_isi_cmp);
@@ -809,9 +1974,46 @@ static void g_isi_dispatch_response(GIsiClient *client, uint8_t res,
 	}
 
 	req = *(GIsiRequest **)ret;
+	cacheable = g_isi_cacheable(client, req);
+
+	/* Requests sent from the callbacks must not join a transaction
+	 * that is about to finish */
+	client->reqs.flights = g_slist_remove(client->reqs.flights, req);
+
+	if (cacheable)
+		client->cache->skip = FALSE;
+
+	req->busy = TRUE;
+
+	if (req->func && req->func(client, msg + 1, len - 1, obj, req->data)) {
+		accepted = TRUE;
+		g_isi_request_cancel(req);
+	}
+
+	waiters = g_slist_copy(req->joined);
+	for (l = waiters; l; l = l->next) {
+		GIsiRequest *w = l->data;
+
+		if (!g_slist_find(req->joined, w))
+			continue;
 
-	if (!req->func || req->func(client, msg + 1, len - 1, obj, req->data))
+		if (w->func(client, msg + 1, len - 1, obj, w->data)) {
+			accepted = TRUE;
+			g_isi_request_cancel(w);
+		}
+	}
+	g_slist_free(waiters);
+
+	req->busy = FALSE;
+
+	if (accepted && cacheable && !client->cache->skip)
+		g_isi_cache_store(client, req, obj, msg + 1, len - 1);
+
+	if (!req->func && !req->joined)
 		g_isi_request_cancel(req);
+	else if (req->payload && g_isi_coalesces(client, req->payload[0]))
+		client->reqs.flights = g_slist_prepend(client->reqs.flights,
+							req);
 }
 
 /* Data callback for both responses and indications */
@@ -841,6 +2043,15 @@ static gboolean g_isi_callback(GIOChannel *channel, GIOCondition cond,
 
 		msg = (uint8_t *)buf;
 
+		if (client->io) {
+			g_isi_handoff(client->token, client->io,
+					fd == client->reqs.fd ?
+					G_ISI_HANDOFF_RESPONSE :
+					G_ISI_HANDOFF_INDICATION,
+					res, obj, msg, len);
+			return TRUE;
+		}
+
 		if (client->debug_func)
 			client->debug_func(msg + 1, len - 1,
 						client->debug_data);
@@ -859,12 +2070,36 @@ static gboolean g_isi_callback(GIOChannel *channel, GIOCondition cond,
 static gboolean g_isi_timeout(gpointer data)
 {
 	GIsiRequest *req = data;
+	GIsiClient *client = req->client;
+	GSList *waiters, *l;
+
+	req->timeout = 0;
+	g_isi_source_drop(&req->io_timeout);
+	client->reqs.flights = g_slist_remove(client->reqs.flights, req);
+	req->busy = TRUE;
 
-	req->client->error = ETIMEDOUT;
+	client->error = ETIMEDOUT;
 	if (req->func)
-		req->func(req->client, NULL, 0, 0, req->data);
-	req->client->error = 0;
+		req->func(client, NULL, 0, 0, req->data);
+	client->error = 0;
+
+	waiters = g_slist_copy(req->joined);
+	for (l = waiters; l; l = l->next) {
+		GIsiRequest *w = l->data;
+
+		if (!g_slist_find(req->joined, w))
+			continue;
+
+		client->error = ETIMEDOUT;
+		w->func(client, NULL, 0, 0, w->data);
+		client->error = 0;
 
+		g_isi_request_cancel(w);
+	}
+	g_slist_free(waiters);
+
+	req->busy = FALSE;
+	req->func = NULL;
 	g_isi_request_cancel(req);
 	return FALSE;
 }
@@ -873,3 +2108,149 @@ int g_isi_client_error(const GIsiClient *client)
 {
 	return -client->error;
 }
+
+static void g_isi_token_unref(GIsiClientToken *token)
+{
+	if (g_atomic_int_dec_and_test(&token->refs))
+		g_free(token);
+}
+
+static GIsiHandoffMsg *g_isi_handoff_new(GIsiClientToken *token, int type,
+						const uint8_t *msg, size_t len)
+{
+	GIsiHandoffMsg *m = g_try_malloc0(sizeof(*m) + len);
+
+	if (!m)
+		return NULL;
+
+	g_atomic_int_inc(&token->refs);
+	m->token = token;
+	m->type = type;
+	m->len = len;
+	if (len)
+		memcpy(m->msg, msg, len);
+
+	return m;
+}
+
+static void g_isi_handoff_free(GIsiHandoffMsg *m)
+{
+	if (m->source)
+		g_source_unref(m->source);
+	g_isi_token_unref(m->token);
+	g_free(m);
+}
+
+/* Run from the application context */
+static void g_isi_handoff_deliver(void *opaque)
+{
+	GIsiHandoffMsg *m = opaque;
+	GIsiClient *client = m->token->client;
+	void *ret;
+
+	if (!client)
+		goto out;
+
+	switch (m->type) {
+	case G_ISI_HANDOFF_RESPONSE:
+		if (client->debug_func)
+			client->debug_func(m->msg + 1, m->len - 1,
+						client->debug_data);
+		g_isi_dispatch_response(client, m->res, m->obj, m->msg,
+					m->len);
+		break;
+
+	case G_ISI_HANDOFF_INDICATION:
+		if (client->debug_func)
+			client->debug_func(m->msg + 1, m->len - 1,
+						client->debug_data);
+		g_isi_dispatch_indication(client, m->res, m->obj, m->msg + 1,
+						m->len - 1);
+		break;
+
+	case G_ISI_HANDOFF_TIMEOUT:
+		/* unless answered or cancelled after the timeout expired */
+		ret = tfind(&m->id, &client->reqs.pending, g_isi_cmp);
+		if (ret && (*(GIsiRequest **)ret)->io_timeout == m->source)
+			g_isi_timeout(*(GIsiRequest **)ret);
+		break;
+	}
+
+out:
+	g_isi_handoff_free(m);
+}
+
+static void g_isi_handoff_post(GIsiIOThread *io, GIsiHandoffMsg *m)
+{
+	if (g_isi_io_thread_post(io, g_isi_handoff_deliver, m) == 0)
+		return;
+
+	g_warning("Dropped ISI message, out of memory");
+	g_isi_handoff_free(m);
+}
+
+/* Run from the I/O thread, queues a received message */
+static void g_isi_handoff(GIsiClientToken *token, GIsiIOThread *io,
+				int type, uint8_t res, uint16_t obj,
+				const uint8_t *msg, size_t len)
+{
+	GIsiHandoffMsg *m = g_isi_handoff_new(token, type, msg, len);
+
+	if (!m) {
+		g_warning("Dropped ISI message, out of memory");
+		return;
+	}
+
+	m->res = res;
+	m->obj = obj;
+	g_isi_handoff_post(io, m);
+}
+
+/* Run from the I/O thread. The expiry is queued behind the responses
+ * received before it, so the application handles them first. */
+static gboolean g_isi_io_timeout(gpointer data)
+{
+	GIsiIOTimeout *t = data;
+	GIsiHandoffMsg *m;
+
+	m = g_isi_handoff_new(t->token, G_ISI_HANDOFF_TIMEOUT, NULL, 0);
+	if (!m)
+		return TRUE; /* try again one period later */
+
+	m->id = t->id;
+	m->source = g_source_ref(g_main_current_source());
+	g_isi_handoff_post(t->io, m);
+
+	return FALSE;
+}
+
+static void g_isi_io_timeout_free(gpointer data)
+{
+	GIsiIOTimeout *t = data;
+
+	g_isi_token_unref(t->token);
+	g_free(t);
+}
+
+/* Returns the timeout held, for g_isi_source_drop() */
+static GSource *g_isi_io_timeout_add(GIsiClient *client, unsigned seconds,
+					unsigned int id)
+{
+	GIsiIOTimeout *t = g_try_new0(GIsiIOTimeout, 1);
+	GSource *source;
+
+	if (!t)
+		return NULL;
+
+	g_atomic_int_inc(&client->token->refs);
+	t->token = client->token;
+	t->io = client->io;
+	t->id = id;
+
+	source = g_timeout_source_new_seconds(seconds);
+	g_source_set_callback(source, g_isi_io_timeout, t,
+				g_isi_io_timeout_free);
+	g_source_attach(source, client->context);
+
+	return source;
+}
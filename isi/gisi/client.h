@@ -28,7 +28,10 @@ extern "C" {
 
 #include <stdint.h>
 #include <glib/gtypes.h>
+#include <glib/gmain.h>
 #include <isi/gisi/modem.h>
+#include <isi/gisi/slab.h>
+#include <isi/gisi/iothread.h>
 #include "phonet.h"
 
 struct _GIsiClient;
@@ -49,6 +52,12 @@ typedef void (*GIsiIndicationFunc) (GIsiClient *client,
 					uint16_t object, void *opaque);
 
 GIsiClient *g_isi_client_create(GIsiModem *modem, uint8_t resource);
+GIsiClient *g_isi_client_create_with_context(GIsiModem *modem,
+						uint8_t resource,
+						GMainContext *context);
+GIsiClient *g_isi_client_create_threaded(GIsiModem *modem, uint8_t resource,
+						GIsiIOThread *io);
+GMainContext *g_isi_client_get_context(GIsiClient *client);
 
 GIsiRequest *g_isi_verify(GIsiClient *client, GIsiVerifyFunc func,
 				void *opaque);
@@ -67,6 +76,9 @@ uint8_t g_isi_server_object(GIsiClient *client);
 
 void g_isi_client_set_debug(GIsiClient *client, GIsiDebugFunc func,
 				void *opaque);
+void g_isi_client_set_coalesce(GIsiClient *client, gboolean enabled);
+void g_isi_client_set_coalesce_id(GIsiClient *client, uint8_t msg_id,
+					gboolean enabled);
 
 void g_isi_client_destroy(GIsiClient *client);
 
@@ -107,6 +119,12 @@ GIsiRequest *g_isi_vsend(GIsiClient *client,
 
 void g_isi_request_cancel(GIsiRequest *req);
 
+int g_isi_cache_set_ttl(GIsiClient *client, uint8_t type, unsigned ttl);
+int g_isi_cache_invalidate_on(GIsiClient *client, uint8_t ind_type,
+				uint8_t type);
+void g_isi_cache_flush(GIsiClient *client);
+void g_isi_response_uncacheable(GIsiClient *client);
+
 int g_isi_commit_subscriptions(GIsiClient *client);
 int g_isi_add_subscription(GIsiClient *client, uint8_t res, uint8_t type,
 				GIsiIndicationFunc cb, void *data);
@@ -116,6 +134,14 @@ int g_isi_subscribe(GIsiClient *client, uint8_t type,
 			GIsiIndicationFunc func, void *opaque);
 void g_isi_unsubscribe(GIsiClient *client, uint8_t type);
 
+size_t g_isi_request_size(void);
+void g_isi_client_set_slab(GIsiClient *client, GIsiSlab *slab);
+
+int g_isi_ind_hub_ref(GIsiModem *modem);
+int g_isi_ind_hub_ref_with_context(GIsiModem *modem, GMainContext *context);
+void g_isi_ind_hub_unref(GIsiModem *modem);
+unsigned g_isi_modem_sockets(GIsiModem *modem);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,278 @@
+/*
+ * This file is GPLv2
+ * Copyright (C) 2010 Sebastian Reichel
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <glib.h>
+
+#include "socket.h"
+#include "iothread.h"
+
+struct _GIsiHandoff {
+	struct _GIsiHandoff *next;
+	GIsiHandoffFunc func;
+	void *opaque;
+};
+typedef struct _GIsiHandoff GIsiHandoff;
+
+struct _GIsiIOThread {
+	GMainContext *context;
+	GMainLoop *loop;
+	GThread *thread;
+
+	/* Handoff to the application context */
+	GMainContext *app;
+	int wake_fd;
+	guint wake_source;
+	volatile gpointer head; /* GIsiHandoff stack, newest first */
+};
+
+struct _GIsiIOSync {
+	GMutex *lock;
+	GCond *cond;
+	gboolean done;
+};
+typedef struct _GIsiIOSync GIsiIOSync;
+
+static gpointer g_isi_io_thread_run(gpointer data)
+{
+	GIsiIOThread *io = data;
+
+	g_main_loop_run(io->loop);
+	return NULL;
+}
+
+/* Run all handoffs posted so far, oldest first */
+static void g_isi_io_thread_drain(GIsiIOThread *io)
+{
+	GIsiHandoff *list, *next, *fifo = NULL;
+
+	/* the only consumer, so taking the whole stack is ABA safe */
+	do
+		list = g_atomic_pointer_get(&io->head);
+	while (list && !g_atomic_pointer_compare_and_exchange(&io->head,
+								list, NULL));
+
+	for (; list; list = next) {
+		next = list->next;
+		list->next = fifo;
+		fifo = list;
+	}
+
+	for (; fifo; fifo = next) {
+		next = fifo->next;
+		fifo->func(fifo->opaque);
+		g_free(fifo);
+	}
+}
+
+static gboolean g_isi_io_thread_wakeup(GIOChannel *channel,
+					GIOCondition cond, gpointer data)
+{
+	GIsiIOThread *io = data;
+	uint64_t count;
+
+	if (cond & (G_IO_NVAL|G_IO_HUP|G_IO_ERR)) {
+		g_warning("Unexpected event on handoff channel %p", channel);
+		io->wake_source = 0;
+		return FALSE;
+	}
+
+	/* Clear the counter before draining, a post racing with the
+	 * drain then wakes us once more instead of getting lost */
+	if (read(io->wake_fd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+		return TRUE;
+
+	g_isi_io_thread_drain(io);
+	return TRUE;
+}
+
+/**
+ * Start an I/O thread with a main context of its own. Objects created
+ * on g_isi_io_thread_get_context() are served by it.
+ * @param app context handoffs are run from, NULL for the default one
+ * @return NULL on error (see errno), a GIsiIOThread pointer on success.
+ */
+GIsiIOThread *g_isi_io_thread_new(GMainContext *app)
+{
+	GIsiIOThread *io;
+	GIOChannel *channel;
+
+	io = g_try_new0(GIsiIOThread, 1);
+	if (!io) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	io->wake_fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+	if (io->wake_fd == -1) {
+		g_free(io);
+		return NULL;
+	}
+
+	io->app = app ? g_main_context_ref(app) : NULL;
+	io->context = g_main_context_new();
+	io->loop = g_main_loop_new(io->context, FALSE);
+
+	channel = g_io_channel_unix_new(io->wake_fd);
+	g_io_channel_set_encoding(channel, NULL, NULL);
+	g_io_channel_set_buffered(channel, FALSE);
+	io->wake_source = g_isi_watch_add(app, channel,
+					G_IO_IN|G_IO_ERR|G_IO_HUP|G_IO_NVAL,
+					g_isi_io_thread_wakeup, io);
+	g_io_channel_unref(channel);
+
+	io->thread = g_thread_create(g_isi_io_thread_run, io, TRUE, NULL);
+	if (!io->thread) {
+		g_isi_source_remove(app, io->wake_source);
+		g_main_loop_unref(io->loop);
+		g_main_context_unref(io->context);
+		if (io->app)
+			g_main_context_unref(io->app);
+		close(io->wake_fd);
+		g_free(io);
+		errno = EAGAIN;
+		return NULL;
+	}
+
+	return io;
+}
+
+static gboolean g_isi_io_thread_quit(gpointer data)
+{
+	g_main_loop_quit(data);
+	return FALSE;
+}
+
+/**
+ * Stop the I/O thread. Handoffs posted before it stopped are run before
+ * this returns. Objects created on its context must be destroyed first.
+ * @param io I/O thread (may be NULL)
+ */
+void g_isi_io_thread_destroy(GIsiIOThread *io)
+{
+	if (!io)
+		return;
+
+	/* from within the loop, a quit before it runs would be lost */
+	g_isi_timeout_add(io->context, 0, g_isi_io_thread_quit, io->loop);
+	g_thread_join(io->thread);
+
+	if (io->wake_source)
+		g_isi_source_remove(io->app, io->wake_source);
+	g_isi_io_thread_drain(io);
+	close(io->wake_fd);
+
+	g_main_loop_unref(io->loop);
+	g_main_context_unref(io->context);
+	if (io->app)
+		g_main_context_unref(io->app);
+	g_free(io);
+}
+
+/**
+ * Returns the context run by the I/O thread.
+ * @param io I/O thread
+ * @return main context of the I/O thread
+ */
+GMainContext *g_isi_io_thread_get_context(GIsiIOThread *io)
+{
+	return io->context;
+}
+
+/**
+ * Returns the context handoffs are run from.
+ * @param io I/O thread
+ * @return application context, NULL for the default one
+ */
+GMainContext *g_isi_io_thread_get_app_context(GIsiIOThread *io)
+{
+	return io->app;
+}
+
+/**
+ * Run @a func from the application context. Callable from any thread
+ * without locking. Handoffs run in the order they were posted, and all
+ * posted until the application gets to them run from one wakeup.
+ * @param io I/O thread
+ * @param func function to run
+ * @param opaque data for @a func
+ * @return 0 on success, a negative error code otherwise.
+ */
+int g_isi_io_thread_post(GIsiIOThread *io, GIsiHandoffFunc func,
+				void *opaque)
+{
+	GIsiHandoff *node;
+	gpointer head;
+	uint64_t one = 1;
+
+	node = g_try_new(GIsiHandoff, 1);
+	if (!node)
+		return -ENOMEM;
+
+	node->func = func;
+	node->opaque = opaque;
+
+	do {
+		head = g_atomic_pointer_get(&io->head);
+		node->next = head;
+	} while (!g_atomic_pointer_compare_and_exchange(&io->head, head,
+								node));
+
+	/* Only the first handoff of a batch wakes the application. The
+	 * write only fails with the counter saturated, i.e. a wakeup is
+	 * pending anyway. */
+	if (head == NULL)
+		while (write(io->wake_fd, &one, sizeof(one)) == -1 &&
+				errno == EINTR)
+			;
+
+	return 0;
+}
+
+static gboolean g_isi_io_thread_synced(gpointer data)
+{
+	GIsiIOSync *sync = data;
+
+	g_mutex_lock(sync->lock);
+	sync->done = TRUE;
+	g_cond_signal(sync->cond);
+	g_mutex_unlock(sync->lock);
+
+	return FALSE;
+}
+
+/**
+ * Wait until callbacks the I/O thread is running have returned, e.g.
+ * before freeing data its sources refer to. Returns at once when
+ * called from the I/O thread itself.
+ * @param io I/O thread
+ */
+void g_isi_io_thread_sync(GIsiIOThread *io)
+{
+	GIsiIOSync sync = { .done = FALSE };
+
+	if (g_thread_self() == io->thread)
+		return;
+
+	sync.lock = g_mutex_new();
+	sync.cond = g_cond_new();
+
+	g_isi_timeout_add(io->context, 0, g_isi_io_thread_synced, &sync);
+
+	g_mutex_lock(sync.lock);
+	while (!sync.done)
+		g_cond_wait(sync.cond, sync.lock);
+	g_mutex_unlock(sync.lock);
+
+	g_cond_free(sync.cond);
+	g_mutex_free(sync.lock);
+}
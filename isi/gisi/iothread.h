@@ -0,0 +1,31 @@
+/*
+ * This file is GPLv2
+ * Copyright (C) 2010 Sebastian Reichel
+ */
+
+#ifndef __GISI_IOTHREAD_H
+#define __GISI_IOTHREAD_H
+
+#include <glib/gmain.h>
+
+/*
+ * Private thread running a main loop for socket reads and request
+ * timeouts. Work done there is handed to the application's context
+ * with g_isi_io_thread_post(), so a busy application loop delays
+ * callbacks but not the protocol.
+ */
+typedef struct _GIsiIOThread GIsiIOThread;
+
+typedef void (*GIsiHandoffFunc)(void *opaque);
+
+GIsiIOThread *g_isi_io_thread_new(GMainContext *app);
+void g_isi_io_thread_destroy(GIsiIOThread *io);
+
+GMainContext *g_isi_io_thread_get_context(GIsiIOThread *io);
+GMainContext *g_isi_io_thread_get_app_context(GIsiIOThread *io);
+
+int g_isi_io_thread_post(GIsiIOThread *io, GIsiHandoffFunc func,
+				void *opaque);
+void g_isi_io_thread_sync(GIsiIOThread *io);
+
+#endif /* __GISI_IOTHREAD_H */
@@ -30,6 +30,12 @@
 
 #include "iter.h"
 
+/* High byte set or low byte >= 0x80 in any of two UCS-2BE characters */
+static const union {
+	uint8_t b[4];
+	uint32_t w;
+} ascii_mask = { { 0xFF, 0x80, 0xFF, 0x80 } };
+
 static inline void bcd_to_mccmnc(const uint8_t *restrict bcd,
 					char *mcc, char *mnc)
 {
@@ -41,7 +47,7 @@ static inline void bcd_to_mccmnc(const uint8_t *restrict bcd,
 	mnc[0] = '0' + (bcd[2] & 0x0F);
 	mnc[1] = '0' + ((bcd[2] & 0xF0) >> 4);
 	mnc[2] = (bcd[1] & 0xF0) == 0xF0 ? '\0' : '0' +
-			(bcd[1] & 0xF0);
+			((bcd[1] & 0xF0) >> 4);
 	mnc[3] = '\0';
 }
 
@@ -53,7 +59,7 @@ void g_isi_sb_iter_init_full(GIsiSubBlockIter *iter, const void *restrict data,
 		len = used = 0;
 
 	iter->start = (uint8_t *)data + used;
-	iter->end = iter->start + len;
+	iter->end = (uint8_t *)data + len;
 	iter->longhdr = longhdr;
 	iter->sub_blocks = len > used ? sub_blocks : 0;
 }
@@ -65,7 +71,7 @@ void g_isi_sb_iter_init(GIsiSubBlockIter *iter, const void *restrict data,
 		len = used = 0;
 
 	iter->start = (uint8_t *)data + used;
-	iter->end = iter->start + len;
+	iter->end = (uint8_t *)data + len;
 	iter->longhdr = FALSE;
 	iter->sub_blocks = len > used ? iter->start[-1] : 0;
 }
@@ -111,6 +117,17 @@ gboolean g_isi_sb_iter_get_data(const GIsiSubBlockIter *restrict iter,
 	return TRUE;
 }
 
+gboolean g_isi_sb_iter_get_struct(const GIsiSubBlockIter *restrict iter,
+					const void **ptr, size_t len,
+					unsigned pos)
+{
+	if (pos + len > g_isi_sb_iter_get_len(iter)
+		|| iter->start + pos + len > iter->end)
+		return FALSE;
+	*ptr = iter->start + pos;
+	return TRUE;
+}
+
 gboolean g_isi_sb_iter_get_byte(const GIsiSubBlockIter *restrict iter,
 				uint8_t *byte, unsigned pos)
 {
@@ -157,24 +174,129 @@ gboolean g_isi_sb_iter_get_oper_code(const GIsiSubBlockIter *restrict iter,
 	return TRUE;
 }
 
+/*
+ * Convert UCS-2BE (surrogate pairs are accepted) to UTF-8 without iconv.
+ * Stops at the first NUL character or when the next character would not
+ * fit into @size bytes; the output is always NUL terminated.
+ * Returns the number of bytes written, not counting the terminator.
+ */
+static size_t ucs2be_to_utf8(const uint8_t *restrict in, size_t len,
+				char *restrict out, size_t size)
+{
+	size_t i = 0, o = 0;
+
+	if (size == 0)
+		return 0;
+
+	len &= ~(size_t)1;
+
+	while (i < len) {
+		uint32_t c;
+		size_t n;
+
+		/* Fast path: four plain ASCII characters at once */
+		while (i + 8 <= len && o + 4 < size) {
+			uint32_t hi, lo;
+
+			memcpy(&hi, in + i, 4);
+			memcpy(&lo, in + i + 4, 4);
+
+			if ((hi | lo) & ascii_mask.w)
+				break;
+
+			if (!in[i + 1] || !in[i + 3] || !in[i + 5] || !in[i + 7])
+				break;
+
+			out[o++] = in[i + 1];
+			out[o++] = in[i + 3];
+			out[o++] = in[i + 5];
+			out[o++] = in[i + 7];
+			i += 8;
+		}
+
+		if (i >= len)
+			break;
+
+		c = (in[i] << 8) | in[i + 1];
+		i += 2;
+
+		if (c == 0)
+			break;
+
+		if (c >= 0xD800 && c <= 0xDFFF) {
+			uint32_t low = i + 1 < len ? (in[i] << 8) | in[i + 1] : 0;
+
+			if (c <= 0xDBFF && low >= 0xDC00 && low <= 0xDFFF) {
+				c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+				i += 2;
+			} else
+				c = '?';
+		}
+
+		n = c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4;
+		if (o + n >= size)
+			break;
+
+		switch (n) {
+		case 1:
+			out[o++] = c;
+			break;
+		case 2:
+			out[o++] = 0xC0 | (c >> 6);
+			out[o++] = 0x80 | (c & 0x3F);
+			break;
+		case 3:
+			out[o++] = 0xE0 | (c >> 12);
+			out[o++] = 0x80 | ((c >> 6) & 0x3F);
+			out[o++] = 0x80 | (c & 0x3F);
+			break;
+		default:
+			out[o++] = 0xF0 | (c >> 18);
+			out[o++] = 0x80 | ((c >> 12) & 0x3F);
+			out[o++] = 0x80 | ((c >> 6) & 0x3F);
+			out[o++] = 0x80 | (c & 0x3F);
+			break;
+		}
+	}
+
+	out[o] = '\0';
+	return o;
+}
+
+gboolean g_isi_sb_iter_get_alpha_tag_buf(const GIsiSubBlockIter *restrict iter,
+					char *utf8, size_t size, size_t len,
+					unsigned pos)
+{
+	if (!utf8 || size == 0)
+		return FALSE;
+
+	if (pos + len > g_isi_sb_iter_get_len(iter)
+		|| iter->start + pos + len > iter->end)
+		return FALSE;
+
+	ucs2be_to_utf8(iter->start + pos, len, utf8, size);
+	return TRUE;
+}
+
 gboolean g_isi_sb_iter_get_alpha_tag(const GIsiSubBlockIter *restrict iter,
 					char **utf8, size_t len, unsigned pos)
 {
-	uint8_t *ucs2 = NULL;
+	/* A UCS-2 character never takes more than 3 bytes in UTF-8 */
+	size_t size = len / 2 * 3 + 1;
 
-	if (pos > g_isi_sb_iter_get_len(iter))
+	if (!utf8 || len == 0)
 		return FALSE;
 
-	if (!utf8 || len == 0 || pos + len > g_isi_sb_iter_get_len(iter))
+	*utf8 = g_try_malloc(size);
+	if (*utf8 == NULL)
 		return FALSE;
 
-	ucs2 = iter->start + pos;
-	if (ucs2 + len > iter->end)
-		return FALSE;
+	if (g_isi_sb_iter_get_alpha_tag_buf(iter, *utf8, size, len, pos))
+		return TRUE;
 
-	*utf8 = g_convert((const char *)ucs2, len, "UTF-8//TRANSLIT", "UCS-2BE",
-				NULL, NULL, NULL);
-	return *utf8 != NULL;
+	g_free(*utf8);
+	*utf8 = NULL;
+	return FALSE;
 }
 
 gboolean g_isi_sb_iter_get_latin_tag(const GIsiSubBlockIter *restrict iter,
@@ -199,7 +321,7 @@ gboolean g_isi_sb_iter_get_latin_tag(const GIsiSubBlockIter *restrict iter,
 
 gboolean g_isi_sb_iter_next(GIsiSubBlockIter *iter)
 {
-	uint8_t len = g_isi_sb_iter_get_len(iter);
+	size_t len = g_isi_sb_iter_get_len(iter);
 
 	if (len == 0)
 		len = iter->longhdr ? 4 : 2;
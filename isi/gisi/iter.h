@@ -54,6 +54,9 @@ size_t g_isi_sb_iter_get_len(const GIsiSubBlockIter *iter);
 
 gboolean g_isi_sb_iter_get_data(const GIsiSubBlockIter *restrict iter,
 				void **data, unsigned pos);
+gboolean g_isi_sb_iter_get_struct(const GIsiSubBlockIter *restrict iter,
+					const void **ptr, size_t len,
+					unsigned pos);
 gboolean g_isi_sb_iter_get_byte(const GIsiSubBlockIter *restrict iter,
 				uint8_t *byte, unsigned pos);
 gboolean g_isi_sb_iter_get_word(const GIsiSubBlockIter *restrict iter,
@@ -64,6 +67,9 @@ gboolean g_isi_sb_iter_get_oper_code(const GIsiSubBlockIter *restrict iter,
 					char *mcc, char *mnc, unsigned pos);
 gboolean g_isi_sb_iter_get_alpha_tag(const GIsiSubBlockIter *restrict iter,
 					char **utf8, size_t len, unsigned pos);
+gboolean g_isi_sb_iter_get_alpha_tag_buf(const GIsiSubBlockIter *restrict iter,
+					char *utf8, size_t size, size_t len,
+					unsigned pos);
 gboolean g_isi_sb_iter_get_latin_tag(const GIsiSubBlockIter *restrict iter,
 					char **ascii, size_t len, unsigned pos);
 
@@ -41,6 +41,8 @@
 
 #include "netlink.h"
 #include "modem.h"
+#include "socket.h"
+#include "iothread.h"
 
 #ifndef ARPHRD_PHONET
 #define ARPHRD_PHONET (820)
@@ -74,33 +76,224 @@
 
 #define SIZE_NLMSG (16384)
 
+/* Datagrams read per wakeup before yielding to the main loop */
+#define NL_DRAIN_MAX (64)
+
+/* Seconds to wait for the kernel to acknowledge a request */
+#define NL_ACK_TIMEOUT (5)
+
+/* Last link state seen for an interface during one wakeup */
+struct _GPhonetLinkEvent {
+	unsigned ifindex;
+	GPhonetLinkState st;
+	char ifname[IF_NAMESIZE];
+};
+typedef struct _GPhonetLinkEvent GPhonetLinkEvent;
+
+/* Watchers of one interface and its last delivered state */
+struct _GPhonetLinkEntry {
+	GSList *watchers;
+	GPhonetLinkState st;
+	gboolean known;
+};
+typedef struct _GPhonetLinkEntry GPhonetLinkEntry;
+
 struct _GPhonetNetlink {
 	GPhonetNetlinkFunc callback;
 	void *opaque;
-	guint watch;
 	unsigned interface;
+	uint32_t dump_seq;	/* link dump still to be delivered, 0 if none */
+	GMainContext *context;	/* callbacks are run from here */
+	GQueue events;		/* GPhonetLinkEvent copies to deliver */
+	guint idle;		/* delivers the events */
+	gboolean delivering;	/* inside the callback */
+	gboolean stopped;	/* stopped from the callback */
+};
+
+/* Request sent on the shared socket, waiting for its ack */
+struct _GPhonetNetlinkAck {
+	uint32_t seq;
+	unsigned ifindex;
+	GSource *timeout;	/* on the context of the requester */
+	int error;
+	GPhonetNetlinkAckFunc callback;
+	void *opaque;
+	GMainContext *context;	/* the callback is run from here */
 };
+typedef struct _GPhonetNetlinkAck GPhonetNetlinkAck;
+
+struct netlink_req {
+	struct nlmsghdr nlh;
+	char buf[512];
+};
+
+/* All watchers share one socket and one receive path */
+static struct {
+	int fd;
+	GSource *watch;
+	uint32_t seq;
+	uint32_t dump_seq;	/* link dump in flight, 0 if none */
+	uint32_t next_dump_seq;	/* dump to run after it, 0 if none */
+	uint32_t done_seq;
+	gboolean dump_done;
+
+	void *buf;		/* receive buffer, grown on demand */
+	size_t buflen;
+	GArray *events;		/* coalesced link events, reused */
+
+	GHashTable *links;	/* ifindex -> GPhonetLinkEntry */
+	GSList *any;		/* watchers of every Phonet interface */
+	GSList *acks;		/* requests in flight */
+	unsigned users;
+	GIsiIOThread *io;	/* reads the socket, kept once started */
+} nl;
+
+/* The socket is read by a thread of its own, so it does not depend on
+ * any watcher's loop. Watchers may live in different threads. Events
+ * and acks are handed to the context of their watcher or requester,
+ * and callbacks run from there without the lock. */
+static GStaticRecMutex nl_lock = G_STATIC_REC_MUTEX_INIT;
 
 static inline GIsiModem *make_modem(unsigned idx)
 {
 	return (void *)(uintptr_t)idx;
 }
 
-static GSList *netlink_list;
+static uint32_t g_pn_nl_next_seq(void)
+{
+	if (++nl.seq == 0)
+		nl.seq = 1;
+	return nl.seq;
+}
+
+static void g_pn_nl_close(void);
+
+/* The socket stays open while there are watchers or requests in flight */
+static void g_pn_nl_maybe_close(void)
+{
+	if (nl.watch && nl.users == 0 && nl.acks == NULL)
+		g_pn_nl_close();
+}
+
+static void g_pn_nl_ack_free(GPhonetNetlinkAck *ack)
+{
+	if (ack->context)
+		g_main_context_unref(ack->context);
+	g_free(ack);
+}
+
+static gboolean g_pn_nl_ack_deliver(gpointer data)
+{
+	GPhonetNetlinkAck *ack = data;
+
+	if (ack->callback)
+		ack->callback(make_modem(ack->ifindex), ack->error,
+				ack->opaque);
+	g_pn_nl_ack_free(ack);
+
+	/* the I/O thread cannot close the socket it is reading */
+	g_static_rec_mutex_lock(&nl_lock);
+	g_pn_nl_maybe_close();
+	g_static_rec_mutex_unlock(&nl_lock);
+	return FALSE;
+}
+
+/* Hand the result to the context of the requester */
+static void g_pn_nl_ack_finish(GPhonetNetlinkAck *ack, int error)
+{
+	nl.acks = g_slist_remove(nl.acks, ack);
+	g_isi_source_drop(&ack->timeout);
+
+	ack->error = error;
+	if (!g_isi_idle_add(ack->context, g_pn_nl_ack_deliver, ack))
+		g_pn_nl_ack_free(ack);
+}
+
+/* Complete the request with sequence number @seq, FALSE if unknown */
+static gboolean g_pn_nl_ack(uint32_t seq, int error)
+{
+	GSList *l;
+
+	for (l = nl.acks; l; l = l->next) {
+		GPhonetNetlinkAck *ack = l->data;
+
+		if (ack->seq == seq) {
+			g_pn_nl_ack_finish(ack, error);
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static gboolean g_pn_nl_ack_timeout(gpointer data)
+{
+	GPhonetNetlinkAck *ack = data;
+
+	g_static_rec_mutex_lock(&nl_lock);
+
+	/* acked meanwhile, and maybe freed */
+	if (g_source_is_destroyed(g_main_current_source())) {
+		g_static_rec_mutex_unlock(&nl_lock);
+		return FALSE;
+	}
+
+	g_isi_source_drop(&ack->timeout);
+	g_pn_nl_ack_finish(ack, -ETIMEDOUT);
+	g_pn_nl_maybe_close();
+	g_static_rec_mutex_unlock(&nl_lock);
+	return FALSE;
+}
+
+static GPhonetLinkEntry *g_pn_nl_entry(unsigned ifindex, gboolean create)
+{
+	GPhonetLinkEntry *entry;
+
+	entry = g_hash_table_lookup(nl.links, GUINT_TO_POINTER(ifindex));
+	if (entry || !create)
+		return entry;
+
+	entry = g_try_new0(GPhonetLinkEntry, 1);
+	if (entry)
+		g_hash_table_insert(nl.links, GUINT_TO_POINTER(ifindex), entry);
+
+	return entry;
+}
+
+/* TRUE if anybody listens to @ifindex */
+static gboolean g_pn_nl_watched(unsigned ifindex)
+{
+	GPhonetLinkEntry *entry;
+
+	if (nl.any)
+		return TRUE;
+
+	entry = g_pn_nl_entry(ifindex, FALSE);
+	return entry && entry->watchers;
+}
 
 GPhonetNetlink *g_pn_netlink_by_modem(GIsiModem *idx)
 {
-	GSList *m;
 	unsigned index = g_isi_modem_index(idx);
+	GPhonetLinkEntry *entry;
+	GPhonetNetlink *self = NULL;
+
+	g_static_rec_mutex_lock(&nl_lock);
 
-	for (m = netlink_list; m; m = m->next) {
-		GPhonetNetlink *self = m->data;
+	if (nl.links == NULL)
+		goto out;
 
-		if (index == self->interface)
-			return self;
+	if (index == 0) {
+		self = nl.any ? nl.any->data : NULL;
+		goto out;
 	}
 
-	return NULL;
+	entry = g_pn_nl_entry(index, FALSE);
+	if (entry && entry->watchers)
+		self = entry->watchers->data;
+out:
+	g_static_rec_mutex_unlock(&nl_lock);
+	return self;
 }
 
 static void bring_up(unsigned ifindex)
@@ -136,7 +329,7 @@ static int netlink_socket(void)
 	return fd;
 }
 
-static void g_pn_nl_addr(GPhonetNetlink *self, struct nlmsghdr *nlh)
+static void g_pn_nl_addr(struct nlmsghdr *nlh)
 {
 	int len;
 	uint8_t local = 0xff;
@@ -152,7 +345,7 @@ static void g_pn_nl_addr(GPhonetNetlink *self, struct nlmsghdr *nlh)
 	if (ifa->ifa_family != AF_PHONET)
 		return;
 
-	if (ifa->ifa_index != self->interface)
+	if (!g_pn_nl_watched(ifa->ifa_index))
 		return;
 
 	for (rta = IFA_RTA(ifa); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
@@ -164,26 +357,46 @@ static void g_pn_nl_addr(GPhonetNetlink *self, struct nlmsghdr *nlh)
 	}
 }
 
-static void g_pn_nl_link(GPhonetNetlink *self, struct nlmsghdr *nlh)
+/* Keep only the latest state of each interface, in order of first change */
+static void g_pn_nl_queue_link(unsigned ifindex, GPhonetLinkState st,
+				const char *ifname)
+{
+	GPhonetLinkEvent *ev;
+	guint i;
+
+	for (i = 0; i < nl.events->len; i++) {
+		ev = &g_array_index(nl.events, GPhonetLinkEvent, i);
+		if (ev->ifindex == ifindex)
+			goto update;
+	}
+
+	g_array_set_size(nl.events, nl.events->len + 1);
+	ev = &g_array_index(nl.events, GPhonetLinkEvent, i);
+	ev->ifindex = ifindex;
+
+update:
+	ev->st = st;
+	strncpy(ev->ifname, ifname, IF_NAMESIZE - 1);
+	ev->ifname[IF_NAMESIZE - 1] = '\0';
+}
+
+static void g_pn_nl_link(struct nlmsghdr *nlh)
 {
 	const struct ifinfomsg *ifi;
 	const struct rtattr *rta;
 	int len;
 	const char *ifname = NULL;
-	GIsiModem *idx = NULL;
 	GPhonetLinkState st;
 
 	ifi = NLMSG_DATA(nlh);
 	len = IFA_PAYLOAD(nlh);
 
-	if (ifi->ifi_type != ARPHRD_PHONET)
+	if (ifi->ifi_type != ARPHRD_PHONET || ifi->ifi_index <= 0)
 		return;
 
-	if (self->interface != 0 && self->interface != (unsigned)ifi->ifi_index)
+	if (!g_pn_nl_watched(ifi->ifi_index))
 		return;
 
-	idx = make_modem(ifi->ifi_index);
-
 #define UP (IFF_UP | IFF_LOWER_UP | IFF_RUNNING)
 
 	if (nlh->nlmsg_type == RTM_DELLINK)
@@ -200,70 +413,315 @@ static void g_pn_nl_link(GPhonetNetlink *self, struct nlmsghdr *nlh)
 			ifname = RTA_DATA(rta);
 	}
 
-	if (ifname && idx)
-		self->callback(idx, st, ifname, self->opaque);
+	if (ifname)
+		g_pn_nl_queue_link(ifi->ifi_index, st, ifname);
 
 #undef UP
 }
 
-/* Parser Netlink messages */
-static gboolean g_pn_nl_process(GIOChannel *channel, GIOCondition cond,
-				gpointer data)
+static void g_pn_nl_parse(struct nlmsghdr *nlh, ssize_t len)
 {
-	struct {
-		struct nlmsghdr nlh;
-		char buf[SIZE_NLMSG];
-	} resp;
-	struct iovec iov = { &resp, sizeof(resp), };
-	struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, };
-	ssize_t ret;
-	struct nlmsghdr *nlh;
-	int fd = g_io_channel_unix_get_fd(channel);
-	GPhonetNetlink *self = data;
-
-	if (cond & (G_IO_NVAL|G_IO_HUP))
-		return FALSE;
-
-	ret = recvmsg(fd, &msg, 0);
-	if (ret == -1)
-		return TRUE;
-
-	if (msg.msg_flags & MSG_TRUNC) {
-		g_printerr("Netlink message of %zu bytes truncated at %zu\n",
-				ret, sizeof(resp));
-		return TRUE;
-	}
-
-	for (nlh = &resp.nlh; NLMSG_OK(nlh, (size_t)ret);
-						nlh = NLMSG_NEXT(nlh, ret)) {
-		if (nlh->nlmsg_type == NLMSG_DONE)
+	for (; NLMSG_OK(nlh, (size_t)len); nlh = NLMSG_NEXT(nlh, len)) {
+		if (nlh->nlmsg_type == NLMSG_DONE) {
+			/* end of a link dump requested on start */
+			nl.done_seq = nlh->nlmsg_seq;
+			nl.dump_done = TRUE;
+			if (nlh->nlmsg_seq == nl.dump_seq)
+				nl.dump_seq = 0;
 			break;
+		}
 
 		switch (nlh->nlmsg_type) {
 		case NLMSG_ERROR: {
 			struct nlmsgerr *err = NLMSG_DATA(nlh);
+			if (g_pn_nl_ack(nlh->nlmsg_seq, err->error))
+				break;
+			if (nlh->nlmsg_seq && nlh->nlmsg_seq == nl.dump_seq) {
+				nl.dump_seq = 0;
+				/* its watchers are synced by the next one */
+				if (err->error == -EBUSY && !nl.next_dump_seq)
+					nl.next_dump_seq = g_pn_nl_next_seq();
+			}
 			if (err->error)
-				g_printerr("Netlink error: %s",
+				g_printerr("Netlink error: %s\n",
 						strerror(-err->error));
-			return TRUE;
+			break;
 		}
 		case RTM_NEWADDR:
 		case RTM_DELADDR:
-			g_pn_nl_addr(self, nlh);
+			g_pn_nl_addr(nlh);
 			break;
 		case RTM_NEWLINK:
 		case RTM_DELLINK:
-			g_pn_nl_link(self, nlh);
+			g_pn_nl_link(nlh);
 			break;
 		default:
 			continue;
 		}
 	}
+}
+
+/* Make room for a datagram of @len bytes, the buffer is never shrunk */
+static gboolean g_pn_nl_reserve(size_t len)
+{
+	size_t size = nl.buflen ? nl.buflen : SIZE_NLMSG;
+	void *buf;
+
+	if (len <= nl.buflen)
+		return TRUE;
+
+	while (size < len)
+		size *= 2;
+
+	buf = realloc(nl.buf, size);
+	if (buf == NULL)
+		return FALSE;
+
+	nl.buf = buf;
+	nl.buflen = size;
 	return TRUE;
 }
 
+/* Read one pending datagram in full, 0 if there is none */
+static ssize_t g_pn_nl_recv(int fd)
+{
+	ssize_t ret;
+
+	/* MSG_TRUNC makes the peek return the real datagram size */
+	ret = recv(fd, nl.buf, nl.buflen, MSG_PEEK | MSG_TRUNC
+			| MSG_DONTWAIT);
+	if (ret < 0)
+		return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -errno;
+
+	if (!g_pn_nl_reserve(ret)) {
+		/* drop it rather than spin on it */
+		recv(fd, nl.buf, nl.buflen, MSG_DONTWAIT);
+		return -ENOMEM;
+	}
+
+	ret = recv(fd, nl.buf, nl.buflen, MSG_DONTWAIT);
+	if (ret < 0)
+		return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -errno;
+
+	return ret;
+}
+
+static void g_pn_nl_free(GPhonetNetlink *self)
+{
+	GPhonetLinkEvent *ev;
+
+	while ((ev = g_queue_pop_head(&self->events)))
+		g_free(ev);
+	if (self->context)
+		g_main_context_unref(self->context);
+	free(self);
+}
+
+/* Run the callback of @self for its queued events, from its context */
+static gboolean g_pn_nl_deliver(gpointer data)
+{
+	GPhonetNetlink *self = data;
+	GPhonetLinkEvent *ev;
+
+	g_static_rec_mutex_lock(&nl_lock);
+	self->delivering = TRUE;
+
+	while (!self->stopped && (ev = g_queue_pop_head(&self->events))) {
+		g_static_rec_mutex_unlock(&nl_lock);
+		self->callback(make_modem(ev->ifindex), ev->st, ev->ifname,
+				self->opaque);
+		g_free(ev);
+		g_static_rec_mutex_lock(&nl_lock);
+	}
+
+	self->delivering = FALSE;
+	self->idle = 0;
+
+	/* stopped from the callback */
+	if (self->stopped)
+		g_pn_nl_free(self);
+
+	g_static_rec_mutex_unlock(&nl_lock);
+	return FALSE;
+}
+
+static void g_pn_nl_notify(GSList *watchers, const GPhonetLinkEvent *ev,
+				gboolean changed)
+{
+	GSList *l;
+
+	for (l = watchers; l; l = l->next) {
+		GPhonetNetlink *self = l->data;
+		GPhonetLinkEvent *copy;
+
+		/* watchers in sync only hear about changes */
+		if (!changed && !self->dump_seq)
+			continue;
+
+		copy = g_try_new(GPhonetLinkEvent, 1);
+		if (copy == NULL)
+			continue;
+
+		*copy = *ev;
+		g_queue_push_tail(&self->events, copy);
+
+		if (!self->idle)
+			self->idle = g_isi_idle_add(self->context,
+							g_pn_nl_deliver, self);
+	}
+}
+
+static void g_pn_nl_mark_synced(GSList *watchers)
+{
+	for (; watchers; watchers = watchers->next) {
+		GPhonetNetlink *self = watchers->data;
+
+		if (self->dump_seq
+			&& (int32_t)(nl.done_seq - self->dump_seq) >= 0)
+			self->dump_seq = 0;
+	}
+}
+
+static void g_pn_nl_mark_entry_synced(gpointer key, gpointer value,
+					gpointer data)
+{
+	GPhonetLinkEntry *entry = value;
+
+	g_pn_nl_mark_synced(entry->watchers);
+}
+
+static int g_pn_netlink_getlink(int fd, uint32_t seq);
+
+static void g_pn_nl_dump(uint32_t seq)
+{
+	nl.dump_seq = seq;
+	if (g_pn_netlink_getlink(nl.fd, seq) == -1) {
+		g_printerr("Netlink link dump: %s\n", strerror(errno));
+		nl.dump_seq = 0;
+	}
+}
+
+/* The kernel runs one dump per socket at a time and refuses others with
+ * EBUSY, so a watcher started during a dump waits for the next one */
+static void g_pn_nl_request_dump(GPhonetNetlink *self)
+{
+	if (nl.dump_seq == 0) {
+		self->dump_seq = g_pn_nl_next_seq();
+		g_pn_nl_dump(self->dump_seq);
+		return;
+	}
+
+	if (!nl.next_dump_seq)
+		nl.next_dump_seq = g_pn_nl_next_seq();
+	self->dump_seq = nl.next_dump_seq;
+}
+
+static void g_pn_nl_dispatch(void)
+{
+	guint i;
+
+	for (i = 0; i < nl.events->len; i++) {
+		GPhonetLinkEvent *ev;
+		GPhonetLinkEntry *entry;
+		gboolean changed;
+
+		ev = &g_array_index(nl.events, GPhonetLinkEvent, i);
+		entry = g_pn_nl_entry(ev->ifindex, TRUE);
+		if (entry == NULL)
+			continue;
+
+		changed = !entry->known || entry->st != ev->st;
+		entry->st = ev->st;
+		entry->known = TRUE;
+
+		g_pn_nl_notify(entry->watchers, ev, changed);
+		g_pn_nl_notify(nl.any, ev, changed);
+	}
+
+	if (nl.dump_done) {
+		g_hash_table_foreach(nl.links, g_pn_nl_mark_entry_synced, NULL);
+		g_pn_nl_mark_synced(nl.any);
+		nl.dump_done = FALSE;
+	}
+
+	if (!nl.dump_seq && nl.next_dump_seq) {
+		uint32_t seq = nl.next_dump_seq;
+
+		nl.next_dump_seq = 0;
+		g_pn_nl_dump(seq);
+	}
+
+	g_array_set_size(nl.events, 0);
+}
+
+/* The I/O thread stays, joining it here could wait for ourselves */
+static void g_pn_nl_close(void)
+{
+	GIsiIOThread *io = nl.io;
+
+	g_isi_source_drop(&nl.watch);
+	if (nl.events)
+		g_array_free(nl.events, TRUE);
+	if (nl.links)
+		g_hash_table_destroy(nl.links);
+	free(nl.buf);
+
+	memset(&nl, 0, sizeof(nl));
+	nl.io = io;
+}
+
+/* Parser Netlink messages, drains the socket before calling back */
+static gboolean g_pn_nl_drain(GIOChannel *channel, GIOCondition cond)
+{
+	ssize_t ret;
+	unsigned count;
+	int fd = g_io_channel_unix_get_fd(channel);
+
+	if (cond & (G_IO_NVAL|G_IO_HUP))
+		return FALSE;
+
+	/* acks complete while parsing, link events after the drain */
+	for (count = 0; count < NL_DRAIN_MAX; count++) {
+		ret = g_pn_nl_recv(fd);
+		if (ret == 0)
+			break;
+
+		if (ret < 0) {
+			if (ret == -ENOBUFS)
+				g_printerr("Netlink events lost, "
+						"receive queue overrun\n");
+			else if (ret != -ENOMEM)
+				break;
+			continue;
+		}
+
+		g_pn_nl_parse(nl.buf, ret);
+	}
+
+	g_pn_nl_dispatch();
+	return TRUE;
+}
+
+static gboolean g_pn_nl_process(GIOChannel *channel, GIOCondition cond,
+				gpointer data)
+{
+	gboolean ret;
+
+	g_static_rec_mutex_lock(&nl_lock);
+
+	/* closed while waiting for the lock */
+	if (g_source_is_destroyed(g_main_current_source()))
+		ret = FALSE;
+	else
+		ret = g_pn_nl_drain(channel, cond);
+
+	g_static_rec_mutex_unlock(&nl_lock);
+
+	return ret;
+}
+
 /* Dump current links */
-static int g_pn_netlink_getlink(int fd)
+static int g_pn_netlink_getlink(int fd, uint32_t seq)
 {
 	struct {
 		struct nlmsghdr nlh;
@@ -274,6 +732,7 @@ static int g_pn_netlink_getlink(int fd)
 			.nlmsg_len = sizeof(req),
 			.nlmsg_flags = NLM_F_REQUEST | NLM_F_ROOT | NLM_F_MATCH,
 			.nlmsg_pid = getpid(),
+			.nlmsg_seq = seq,
 		},
 		.ifi = {
 			.ifi_family = AF_UNSPEC,
@@ -288,23 +747,16 @@ static int g_pn_netlink_getlink(int fd)
 		      (struct sockaddr *)&addr, sizeof(addr));
 }
 
-GPhonetNetlink *g_pn_netlink_start(GIsiModem *idx,
-				   GPhonetNetlinkFunc callback,
-				   void *data)
+/* Open the shared socket and read it from the I/O thread, returns its fd */
+static int g_pn_nl_open(void)
 {
 	GIOChannel *chan;
-	GPhonetNetlink *self;
 	int fd;
 	unsigned group = RTNLGRP_LINK;
-	unsigned interface = g_isi_modem_index(idx);
 
 	fd = netlink_socket();
 	if (fd == -1)
-		return NULL;
-
-	self = calloc(1, sizeof(*self));
-	if (self == NULL)
-		goto error;
+		return -1;
 
 	fcntl(fd, F_SETFL, O_NONBLOCK | fcntl(fd, F_GETFL));
 
@@ -312,10 +764,14 @@ GPhonetNetlink *g_pn_netlink_start(GIsiModem *idx,
 		       &group, sizeof(group)))
 		goto error;
 
-	if (interface)
-		bring_up(interface);
+	nl.events = g_array_new(FALSE, FALSE, sizeof(GPhonetLinkEvent));
+	nl.links = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+						NULL, g_free);
+	if (!g_pn_nl_reserve(SIZE_NLMSG))
+		goto error;
 
-	g_pn_netlink_getlink(fd);
+	if (!nl.io && !(nl.io = g_isi_io_thread_new(NULL)))
+		goto error;
 
 	chan = g_io_channel_unix_new(fd);
 	if (chan == NULL)
@@ -324,30 +780,127 @@ GPhonetNetlink *g_pn_netlink_start(GIsiModem *idx,
 	g_io_channel_set_encoding(chan, NULL, NULL);
 	g_io_channel_set_buffered(chan, FALSE);
 
+	nl.watch = g_isi_watch_source_add(g_isi_io_thread_get_context(nl.io),
+						chan, G_IO_IN|G_IO_ERR|G_IO_HUP,
+						g_pn_nl_process, NULL);
+	g_io_channel_unref(chan);
+
+	return fd;
+
+error:
+	close(fd);
+	g_pn_nl_close();
+	return -1;
+}
+
+GPhonetNetlink *g_pn_netlink_start(GIsiModem *idx,
+				   GPhonetNetlinkFunc callback,
+				   void *data)
+{
+	return g_pn_netlink_start_with_context(idx, callback, data, NULL);
+}
+
+/**
+ * Watch the link state of a modem interface, or of all Phonet
+ * interfaces if @idx is NULL. All watchers share one socket, which is
+ * read by a private I/O thread, so g_thread_init() must have been
+ * called. Each watcher gets its events from an idle source on its own
+ * context.
+ * @param idx modem interface or NULL
+ * @param callback called on link state changes, from @context
+ * @param data passed to @callback
+ * @param context main context, NULL for the default one
+ * @return a watcher on success, NULL on error.
+ */
+GPhonetNetlink *g_pn_netlink_start_with_context(GIsiModem *idx,
+						GPhonetNetlinkFunc callback,
+						void *data,
+						GMainContext *context)
+{
+	GPhonetNetlink *self;
+	GPhonetLinkEntry *entry = NULL;
+	unsigned interface = g_isi_modem_index(idx);
+
+	self = calloc(1, sizeof(*self));
+	if (self == NULL)
+		return NULL;
+
+	g_static_rec_mutex_lock(&nl_lock);
+
+	if (!nl.watch && (nl.fd = g_pn_nl_open()) == -1)
+		goto error;
+
+	if (interface) {
+		entry = g_pn_nl_entry(interface, TRUE);
+		if (entry == NULL)
+			goto error;
+	}
+
 	self->callback = callback;
 	self->opaque = data;
 	self->interface = interface;
-	self->watch = g_io_add_watch(chan, G_IO_IN|G_IO_ERR|G_IO_HUP,
-					g_pn_nl_process, self);
-	g_io_channel_unref(chan);
+	self->context = context ? g_main_context_ref(context) : NULL;
+
+	if (entry)
+		entry->watchers = g_slist_prepend(entry->watchers, self);
+	else
+		nl.any = g_slist_prepend(nl.any, self);
+	nl.users++;
+
+	if (interface)
+		bring_up(interface);
 
-	netlink_list = g_slist_prepend(netlink_list, self);
+	/* the new watcher gets the current state from the dump */
+	g_pn_nl_request_dump(self);
 
+	g_static_rec_mutex_unlock(&nl_lock);
 	return self;
 
 error:
-	close(fd);
+	g_pn_nl_maybe_close();
+	g_static_rec_mutex_unlock(&nl_lock);
 	free(self);
 	return NULL;
 }
 
 void g_pn_netlink_stop(GPhonetNetlink *self)
 {
-	if (self) {
-		netlink_list = g_slist_remove(netlink_list, self);
-		g_source_remove(self->watch);
-		free(self);
+	GPhonetLinkEntry *entry;
+
+	if (self == NULL)
+		return;
+
+	g_static_rec_mutex_lock(&nl_lock);
+
+	entry = g_pn_nl_entry(self->interface, FALSE);
+	if (entry)
+		entry->watchers = g_slist_remove(entry->watchers, self);
+	else
+		nl.any = g_slist_remove(nl.any, self);
+	nl.users--;
+
+	/* freed by g_pn_nl_deliver() once the callback returns */
+	if (self->delivering)
+		self->stopped = TRUE;
+	else {
+		if (self->idle)
+			g_isi_source_remove(self->context, self->idle);
+		g_pn_nl_free(self);
 	}
+
+	g_pn_nl_maybe_close();
+	g_static_rec_mutex_unlock(&nl_lock);
+}
+
+unsigned g_pn_netlink_watchers(void)
+{
+	unsigned users;
+
+	g_static_rec_mutex_lock(&nl_lock);
+	users = nl.users;
+	g_static_rec_mutex_unlock(&nl_lock);
+
+	return users;
 }
 
 static int netlink_getack(int fd)
@@ -382,29 +935,94 @@ static int netlink_getack(int fd)
 	return -EIO;
 }
 
+/* Send @req on a throwaway socket and wait for the ack */
+static int netlink_request_sync(struct netlink_req *req, uint32_t reqlen)
+{
+	int fd;
+	int error;
+	struct sockaddr_nl addr = { .nl_family = AF_NETLINK, };
+
+	fd = netlink_socket();
+	if (fd == -1)
+		return -errno;
+
+	if (sendto(fd, req, reqlen, 0, (void *)&addr, sizeof(addr)) == -1)
+		error = -errno;
+	else
+		error = netlink_getack(fd);
+
+	close(fd);
+
+	return error;
+}
+
+/* Send @req on the shared socket, @callback gets the ack from @context */
+static int netlink_request_async(struct netlink_req *req, uint32_t reqlen,
+					unsigned ifindex,
+					GPhonetNetlinkAckFunc callback,
+					void *data, GMainContext *context)
+{
+	GPhonetNetlinkAck *ack;
+	struct sockaddr_nl addr = { .nl_family = AF_NETLINK, };
+	int error;
+
+	g_static_rec_mutex_lock(&nl_lock);
+
+	if (!nl.watch && (nl.fd = g_pn_nl_open()) == -1) {
+		g_static_rec_mutex_unlock(&nl_lock);
+		return -EIO;
+	}
+
+	ack = g_try_new0(GPhonetNetlinkAck, 1);
+	if (ack == NULL) {
+		error = -ENOMEM;
+		goto error;
+	}
+
+	req->nlh.nlmsg_seq = g_pn_nl_next_seq();
+
+	if (sendto(nl.fd, req, reqlen, 0, (void *)&addr, sizeof(addr)) == -1) {
+		error = -errno;
+		goto error;
+	}
+
+	ack->seq = req->nlh.nlmsg_seq;
+	ack->ifindex = ifindex;
+	ack->callback = callback;
+	ack->opaque = data;
+	ack->context = context ? g_main_context_ref(context) : NULL;
+	ack->timeout = g_isi_timeout_source_add_seconds(ack->context,
+							NL_ACK_TIMEOUT,
+							g_pn_nl_ack_timeout,
+							ack);
+	nl.acks = g_slist_append(nl.acks, ack);
+
+	g_static_rec_mutex_unlock(&nl_lock);
+	return 0;
+
+error:
+	g_free(ack);
+	g_pn_nl_maybe_close();
+	g_static_rec_mutex_unlock(&nl_lock);
+	return error;
+}
+
 /* Set local address */
-static int netlink_setaddr(uint32_t ifa_index, uint8_t ifa_local)
+static uint32_t netlink_setaddr_req(struct netlink_req *req,
+					uint32_t ifa_index, uint8_t ifa_local)
 {
 	struct ifaddrmsg *ifa;
 	struct rtattr *rta;
 	uint32_t reqlen = NLMSG_LENGTH(NLMSG_ALIGN(sizeof(*ifa))
 				+ RTA_SPACE(1));
-	struct req {
-		struct nlmsghdr nlh;
-		char buf[512];
-	} req = {
-		.nlh = {
-			.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK,
-			.nlmsg_type = RTM_NEWADDR,
-			.nlmsg_pid = getpid(),
-			.nlmsg_len = reqlen,
-		},
-	};
-	int fd;
-	int error;
-	struct sockaddr_nl addr = { .nl_family = AF_NETLINK, };
 
-	ifa = NLMSG_DATA(&req.nlh);
+	memset(req, 0, sizeof(*req));
+	req->nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	req->nlh.nlmsg_type = RTM_NEWADDR;
+	req->nlh.nlmsg_pid = getpid();
+	req->nlh.nlmsg_len = reqlen;
+
+	ifa = NLMSG_DATA(&req->nlh);
 	ifa->ifa_family = AF_PHONET;
 	ifa->ifa_prefixlen = 0;
 	ifa->ifa_index = ifa_index;
@@ -414,59 +1032,89 @@ static int netlink_setaddr(uint32_t ifa_index, uint8_t ifa_local)
 	rta->rta_len = RTA_LENGTH(1);
 	*(uint8_t *)RTA_DATA(rta) = ifa_local;
 
-	fd = netlink_socket();
-	if (fd == -1)
-		return -errno;
+	return reqlen;
+}
 
-	if (sendto(fd, &req, reqlen, 0, (void *)&addr, sizeof(addr)) == -1)
-		error = -errno;
-	else
-		error = netlink_getack(fd);
+static int netlink_check_setaddr(GIsiModem *idx, uint8_t local)
+{
+	if (g_isi_modem_index(idx) == 0)
+		return -ENODEV;
 
-	close(fd);
+	if (local != PN_DEV_PC && local != PN_DEV_SOS)
+		return -EINVAL;
 
-	return error;
+	return 0;
 }
 
 int g_pn_netlink_set_address(GIsiModem *idx, uint8_t local)
 {
+	struct netlink_req req;
 	uint32_t ifindex = g_isi_modem_index(idx);
+	int error = netlink_check_setaddr(idx, local);
 
-	if (ifindex == 0)
-		return -ENODEV;
+	if (error)
+		return error;
 
-	if (local != PN_DEV_PC && local != PN_DEV_SOS)
-		return -EINVAL;
+	return netlink_request_sync(&req,
+			netlink_setaddr_req(&req, ifindex, local));
+}
+
+int g_pn_netlink_set_address_async(GIsiModem *idx, uint8_t local,
+					GPhonetNetlinkAckFunc callback,
+					void *data)
+{
+	return g_pn_netlink_set_address_async_with_context(idx, local,
+							callback, data, NULL);
+}
+
+/**
+ * Set the local Phonet address of a modem interface without waiting
+ * for the kernel. Requests are pipelined on the shared netlink socket.
+ * @param idx modem interface
+ * @param local PN_DEV_PC or PN_DEV_SOS
+ * @param callback called with 0 or a negative error code once acked
+ * @param data passed to @callback
+ * @param context main context running @callback, NULL for the default
+ * @return 0 if the request was sent, a negative error code otherwise
+ * (@callback is not called then).
+ */
+int g_pn_netlink_set_address_async_with_context(GIsiModem *idx,
+						uint8_t local,
+						GPhonetNetlinkAckFunc callback,
+						void *data,
+						GMainContext *context)
+{
+	struct netlink_req req;
+	uint32_t ifindex = g_isi_modem_index(idx);
+	int error = netlink_check_setaddr(idx, local);
+
+	if (error)
+		return error;
 
-	return netlink_setaddr(ifindex, local);
+	return netlink_request_async(&req,
+			netlink_setaddr_req(&req, ifindex, local),
+			ifindex, callback, data, context);
 }
 
 /* Add remote address */
-static int netlink_addroute(uint32_t ifa_index, uint8_t remote)
+static uint32_t netlink_addroute_req(struct netlink_req *req,
+					uint32_t ifa_index, uint8_t remote)
 {
 	struct rtmsg *rtm;
 	struct rtattr *rta;
 	uint32_t reqlen = NLMSG_LENGTH(NLMSG_ALIGN(sizeof(*rtm)) +
 				RTA_SPACE(1) +
 				RTA_SPACE(sizeof(ifa_index)));
-	struct req {
-		struct nlmsghdr nlh;
-		char buf[512];
-	} req = {
-		.nlh = {
-			.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK
-					| NLM_F_CREATE | NLM_F_APPEND,
-			.nlmsg_type = RTM_NEWROUTE,
-			.nlmsg_pid = getpid(),
-			.nlmsg_len = reqlen,
-		},
-	};
-	size_t buflen = sizeof(req.buf) - sizeof(*rtm);
-	int fd;
-	int error;
-	struct sockaddr_nl addr = { .nl_family = AF_NETLINK, };
+	size_t buflen = sizeof(req->buf) - sizeof(*rtm);
 
-	rtm = NLMSG_DATA(&req.nlh);
+	memset(req, 0, sizeof(*req));
+	req->nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK
+				| NLM_F_CREATE | NLM_F_APPEND;
+	req->nlh.nlmsg_type = RTM_NEWROUTE;
+	req->nlh.nlmsg_pid = getpid();
+	req->nlh.nlmsg_len = reqlen;
+
+	rtm = NLMSG_DATA(&req->nlh);
 	rtm->rtm_family = AF_PHONET;
 	rtm->rtm_dst_len = 6;
 	rtm->rtm_src_len = 0;
@@ -488,29 +1136,65 @@ static int netlink_addroute(uint32_t ifa_index, uint8_t remote)
 	rta->rta_len = RTA_LENGTH(sizeof(ifa_index));
 	*(uint32_t *)RTA_DATA(rta) = ifa_index;
 
-	fd = netlink_socket();
-	if (fd == -1)
-		return -errno;
+	return reqlen;
+}
 
-	if (sendto(fd, &req, reqlen, 0, (void *)&addr, sizeof(addr)) == -1)
-		error = -errno;
-	else
-		error = netlink_getack(fd);
+static int netlink_check_addroute(GIsiModem *idx, uint8_t remote)
+{
+	if (g_isi_modem_index(idx) == 0)
+		return -ENODEV;
 
-	close(fd);
+	if (remote != PN_DEV_SOS && remote != PN_DEV_HOST)
+		return -EINVAL;
 
-	return error;
+	return 0;
 }
 
 int g_pn_netlink_add_route(GIsiModem *idx, uint8_t remote)
 {
+	struct netlink_req req;
 	uint32_t ifindex = g_isi_modem_index(idx);
+	int error = netlink_check_addroute(idx, remote);
 
-	if (ifindex == 0)
-		return -ENODEV;
+	if (error)
+		return error;
 
-	if (remote != PN_DEV_SOS && remote != PN_DEV_HOST)
-		return -EINVAL;
+	return netlink_request_sync(&req,
+			netlink_addroute_req(&req, ifindex, remote));
+}
+
+int g_pn_netlink_add_route_async(GIsiModem *idx, uint8_t remote,
+					GPhonetNetlinkAckFunc callback,
+					void *data)
+{
+	return g_pn_netlink_add_route_async_with_context(idx, remote,
+							callback, data, NULL);
+}
+
+/**
+ * Add a route to a remote Phonet device without waiting for the
+ * kernel, see g_pn_netlink_set_address_async_with_context().
+ * @param idx modem interface
+ * @param remote PN_DEV_SOS or PN_DEV_HOST
+ * @param callback called with 0 or a negative error code once acked
+ * @param data passed to @callback
+ * @param context main context running @callback, NULL for the default
+ * @return 0 if the request was sent, a negative error code otherwise.
+ */
+int g_pn_netlink_add_route_async_with_context(GIsiModem *idx,
+						uint8_t remote,
+						GPhonetNetlinkAckFunc callback,
+						void *data,
+						GMainContext *context)
+{
+	struct netlink_req req;
+	uint32_t ifindex = g_isi_modem_index(idx);
+	int error = netlink_check_addroute(idx, remote);
+
+	if (error)
+		return error;
 
-	return netlink_addroute(ifindex, remote);
+	return netlink_request_async(&req,
+			netlink_addroute_req(&req, ifindex, remote),
+			ifindex, callback, data, context);
 }
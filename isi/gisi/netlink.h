@@ -20,6 +20,7 @@
  */
 
 #include <stdint.h>
+#include <glib/gmain.h>
 #include <isi/gisi/modem.h>
 
 #ifndef __GPHONET_NETLINK_H
@@ -54,12 +55,35 @@ GPhonetNetlink *g_pn_netlink_by_modem(GIsiModem *idx);
 GPhonetNetlink *g_pn_netlink_start(GIsiModem *idx,
 			GPhonetNetlinkFunc callback,
 			void *data);
+GPhonetNetlink *g_pn_netlink_start_with_context(GIsiModem *idx,
+			GPhonetNetlinkFunc callback,
+			void *data,
+			GMainContext *context);
 
 void g_pn_netlink_stop(GPhonetNetlink *self);
 
+/* watchers of the process, they all share one socket */
+unsigned g_pn_netlink_watchers(void);
+
+/* ack of an asynchronous request, error is 0 or a negative errno */
+typedef void (*GPhonetNetlinkAckFunc)(GIsiModem *idx, int error,
+			void *data);
+
+/* these block until the kernel has answered */
 int g_pn_netlink_set_address(GIsiModem *, uint8_t local);
 int g_pn_netlink_add_route(GIsiModem *, uint8_t remote);
 
+int g_pn_netlink_set_address_async(GIsiModem *, uint8_t local,
+			GPhonetNetlinkAckFunc callback, void *data);
+int g_pn_netlink_add_route_async(GIsiModem *, uint8_t remote,
+			GPhonetNetlinkAckFunc callback, void *data);
+int g_pn_netlink_set_address_async_with_context(GIsiModem *, uint8_t local,
+			GPhonetNetlinkAckFunc callback, void *data,
+			GMainContext *context);
+int g_pn_netlink_add_route_async_with_context(GIsiModem *, uint8_t remote,
+			GPhonetNetlinkAckFunc callback, void *data,
+			GMainContext *context);
+
 #ifdef __cplusplus
 }
 #endif
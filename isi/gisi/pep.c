@@ -24,7 +24,11 @@
 #endif
 
 #include <stdint.h>
+#include <string.h>
+#include <errno.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <net/if.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -34,12 +38,51 @@
 #include "socket.h"
 #include "pep.h"
 
+#ifndef HAVE_STRUCT_MMSGHDR
+struct mmsghdr {
+	struct msghdr msg_hdr;
+	unsigned int msg_len;
+};
+#endif
+
+/* Batches read from the pipe socket per wakeup, to keep the main loop
+ * responsive under sustained downlink traffic */
+#define PEP_RX_BUDGET	4
+
+/* Fixed set of packet buffers reused for every batch */
+struct _GIsiPEPRing {
+	unsigned depth;
+	uint8_t *bufs;
+	struct iovec *iov;
+	struct mmsghdr *msgs;
+};
+typedef struct _GIsiPEPRing GIsiPEPRing;
+
 struct _GIsiPEP {
 	GIsiPEPCallback ready;
 	void *opaque;
 	int gprs_fd;
 	guint source;
 	uint16_t handle;
+	GMainContext *context;
+
+	/* Data path */
+	unsigned depth;
+	GIsiPEPRing rx;
+	GIsiPEPRing tx;
+	guint rx_source;
+	guint tun_source;
+	int tun_fd;
+	GIsiPEPDataFunc data_func;
+	void *data_opaque;
+	GIsiPEPStats stats;
+	gboolean delivering; /* inside the data callback */
+	gboolean destroyed; /* destroyed from it, freed once it returns */
+
+	/* TUN forwarding */
+	GIsiPEPForwardMode mode;
+	int splice_rx[2]; /* pipe -> TUN */
+	int splice_tx[2]; /* TUN -> pipe */
 };
 
 
@@ -72,6 +115,14 @@ static gboolean g_isi_pep_callback(GIOChannel *channel, GIOCondition cond,
 }
 
 GIsiPEP *g_isi_pep_create(GIsiModem *modem, GIsiPEPCallback cb, void *opaque)
+{
+	return g_isi_pep_create_with_context(modem, cb, opaque, NULL);
+}
+
+/* The PEP and its data path are dispatched from @context, NULL for the
+ * default one, and must only be used from the thread running it */
+GIsiPEP *g_isi_pep_create_with_context(GIsiModem *modem, GIsiPEPCallback cb,
+					void *opaque, GMainContext *context)
 {
 	unsigned ifi = g_isi_modem_index(modem);
 	GIsiPEP *pep = NULL;
@@ -92,7 +143,7 @@ GIsiPEP *g_isi_pep_create(GIsiModem *modem, GIsiPEPCallback cb, void *opaque)
 	if (setsockopt(fd, SOL_SOCKET, SO_BINDTODEVICE, buf, IF_NAMESIZE) != 0)
 		goto error;
 
-	pep = g_try_malloc(sizeof(GIsiPEP));
+	pep = g_try_new0(GIsiPEP, 1);
 	if (pep == NULL)
 		goto error;
 
@@ -100,15 +151,22 @@ GIsiPEP *g_isi_pep_create(GIsiModem *modem, GIsiPEPCallback cb, void *opaque)
 	pep->opaque = opaque;
 	pep->gprs_fd = -1;
 	pep->handle = 0;
+	pep->depth = G_ISI_PEP_RING_DEPTH;
+	pep->tun_fd = -1;
+	pep->mode = G_ISI_PEP_FORWARD_BATCH;
+	pep->splice_rx[0] = pep->splice_rx[1] = -1;
+	pep->splice_tx[0] = pep->splice_tx[1] = -1;
 
 	if (listen(fd, 1) || ioctl(fd, SIOCPNGETOBJECT, &pep->handle))
 		goto error;
 
+	pep->context = context ? g_main_context_ref(context) : NULL;
+
 	channel = g_io_channel_unix_new(fd);
 	g_io_channel_set_close_on_unref(channel, TRUE);
 	g_io_channel_set_encoding(channel, NULL, NULL);
 	g_io_channel_set_buffered(channel, FALSE);
-	pep->source = g_io_add_watch(channel,
+	pep->source = g_isi_watch_add(context, channel,
 					G_IO_IN|G_IO_ERR|G_IO_HUP|G_IO_NVAL,
 					g_isi_pep_callback, pep);
 	g_io_channel_unref(channel);
@@ -128,11 +186,19 @@ uint16_t g_isi_pep_get_object(const GIsiPEP *pep)
 
 void g_isi_pep_destroy(GIsiPEP *pep)
 {
+	g_isi_pep_stop_data(pep);
+
 	if (pep->gprs_fd != -1)
 		close(pep->gprs_fd);
 	else
-		g_source_remove(pep->source);
-	g_free(pep);
+		g_isi_source_remove(pep->context, pep->source);
+	if (pep->context)
+		g_main_context_unref(pep->context);
+
+	if (pep->delivering)
+		pep->destroyed = TRUE;
+	else
+		g_free(pep);
 }
 
 unsigned g_isi_pep_get_ifindex(const GIsiPEP *pep)
@@ -151,3 +217,685 @@ char *g_isi_pep_get_ifname(const GIsiPEP *pep, char *ifname)
 	unsigned ifi = g_isi_pep_get_ifindex(pep);
 	return if_indextoname(ifi, ifname);
 }
+
+static void g_isi_pep_ring_free(GIsiPEPRing *ring)
+{
+	g_free(ring->bufs);
+	g_free(ring->iov);
+	g_free(ring->msgs);
+	memset(ring, 0, sizeof(*ring));
+}
+
+static gboolean g_isi_pep_ring_init(GIsiPEPRing *ring, unsigned depth)
+{
+	unsigned i;
+
+	if (ring->depth == depth)
+		return TRUE;
+
+	g_isi_pep_ring_free(ring);
+
+	ring->bufs = g_try_malloc(depth * G_ISI_PEP_MTU);
+	ring->iov = g_try_new0(struct iovec, depth);
+	ring->msgs = g_try_new0(struct mmsghdr, depth);
+	if (!ring->bufs || !ring->iov || !ring->msgs) {
+		g_isi_pep_ring_free(ring);
+		return FALSE;
+	}
+
+	for (i = 0; i < depth; i++) {
+		ring->iov[i].iov_base = ring->bufs + i * G_ISI_PEP_MTU;
+		ring->msgs[i].msg_hdr.msg_iov = &ring->iov[i];
+		ring->msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	ring->depth = depth;
+	return TRUE;
+}
+
+/* Make every buffer of the ring available for receiving again */
+static void g_isi_pep_ring_reset(GIsiPEPRing *ring)
+{
+	unsigned i;
+
+	for (i = 0; i < ring->depth; i++) {
+		ring->iov[i].iov_len = G_ISI_PEP_MTU;
+		ring->msgs[i].msg_hdr.msg_flags = 0;
+		ring->msgs[i].msg_len = 0;
+	}
+}
+
+static int g_isi_pep_recv_batch(GIsiPEP *pep, struct mmsghdr *msgs,
+				unsigned n)
+{
+	int fd = pep->gprs_fd;
+	unsigned i;
+	ssize_t ret;
+
+#ifdef HAVE_RECVMMSG
+	pep->stats.syscalls++;
+	ret = recvmmsg(fd, msgs, n, MSG_DONTWAIT, NULL);
+	if (ret >= 0 || errno != ENOSYS)
+		return ret;
+#endif
+	for (i = 0; i < n; i++) {
+		pep->stats.syscalls++;
+		ret = recvmsg(fd, &msgs[i].msg_hdr, MSG_DONTWAIT);
+		if (ret < 0)
+			break;
+		msgs[i].msg_len = ret;
+	}
+
+	return i > 0 ? (int)i : (int)ret;
+}
+
+static int g_isi_pep_send_batch(GIsiPEP *pep, struct mmsghdr *msgs,
+				unsigned n)
+{
+	int fd = pep->gprs_fd;
+	unsigned i;
+	ssize_t ret;
+
+#ifdef HAVE_SENDMMSG
+	pep->stats.syscalls++;
+	ret = sendmmsg(fd, msgs, n, MSG_DONTWAIT|MSG_NOSIGNAL);
+	if (ret >= 0 || errno != ENOSYS)
+		return ret;
+#endif
+	for (i = 0; i < n; i++) {
+		pep->stats.syscalls++;
+		ret = sendmsg(fd, &msgs[i].msg_hdr, MSG_DONTWAIT|MSG_NOSIGNAL);
+		if (ret < 0)
+			break;
+		msgs[i].msg_len = ret;
+	}
+
+	return i > 0 ? (int)i : (int)ret;
+}
+
+/* Send @n prepared packets until the pipe does not take more */
+static unsigned g_isi_pep_flush(GIsiPEP *pep, struct mmsghdr *msgs,
+				unsigned n)
+{
+	unsigned i, done = 0;
+	int ret;
+
+	while (done < n) {
+		ret = g_isi_pep_send_batch(pep, msgs + done, n - done);
+		if (ret <= 0)
+			break;
+
+		for (i = done; i < done + ret; i++)
+			pep->stats.tx_bytes += msgs[i].msg_len;
+		pep->stats.tx_packets += ret;
+		done += ret;
+	}
+
+	return done;
+}
+
+static void g_isi_pep_close_pipe(int fds[2])
+{
+	if (fds[0] != -1)
+		close(fds[0]);
+	if (fds[1] != -1)
+		close(fds[1]);
+	fds[0] = fds[1] = -1;
+}
+
+static void g_isi_pep_close_splice(GIsiPEP *pep)
+{
+	g_isi_pep_close_pipe(pep->splice_rx);
+	g_isi_pep_close_pipe(pep->splice_tx);
+}
+
+static gboolean g_isi_pep_open_pipe(int fds[2])
+{
+	if (fds[0] != -1)
+		return TRUE;
+
+	if (pipe(fds))
+		return FALSE;
+
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[0], F_SETFL, O_NONBLOCK|fcntl(fds[0], F_GETFL));
+	fcntl(fds[1], F_SETFL, O_NONBLOCK|fcntl(fds[1], F_GETFL));
+	return TRUE;
+}
+
+static void g_isi_pep_count(GIsiPEP *pep, gboolean uplink, ssize_t len,
+				ssize_t sent)
+{
+	if (sent != len) {
+		if (uplink)
+			pep->stats.tx_dropped++;
+		else
+			pep->stats.rx_dropped++;
+	} else if (uplink) {
+		pep->stats.tx_packets++;
+		pep->stats.tx_bytes += len;
+	} else {
+		pep->stats.rx_packets++;
+		pep->stats.rx_bytes += len;
+	}
+}
+
+/* Plain read/write loop, one packet per system call pair */
+static int g_isi_pep_forward_copy(GIsiPEP *pep, gboolean uplink)
+{
+	uint8_t *buf = uplink ? pep->tx.bufs : pep->rx.bufs;
+	ssize_t len, sent;
+	unsigned i;
+
+	for (i = 0; i < pep->depth; i++) {
+		pep->stats.syscalls += 2;
+
+		if (uplink)
+			len = read(pep->tun_fd, buf, G_ISI_PEP_MTU);
+		else
+			len = recv(pep->gprs_fd, buf, G_ISI_PEP_MTU,
+					MSG_DONTWAIT);
+		if (len <= 0)
+			break;
+
+		if (uplink)
+			sent = send(pep->gprs_fd, buf, len,
+					MSG_DONTWAIT|MSG_NOSIGNAL);
+		else
+			sent = write(pep->tun_fd, buf, len);
+
+		g_isi_pep_count(pep, uplink, len, sent);
+	}
+
+	if (i == pep->depth)
+		return 0;
+
+	/* The final read found nothing, so no write followed it */
+	pep->stats.syscalls--;
+
+	if (len < 0 && errno != EAGAIN && errno != EINTR)
+		return -errno;
+	return 0;
+}
+
+/* Discard a partially forwarded packet left in the splice pipe */
+static void g_isi_pep_drain(GIsiPEP *pep, int fd)
+{
+	uint8_t buf[G_ISI_PEP_MTU];
+
+	while (read(fd, buf, sizeof(buf)) > 0)
+		pep->stats.syscalls++;
+	pep->stats.syscalls++;
+}
+
+/* Move packets through a kernel pipe with splice(), one packet at a time
+ * so that the packet boundaries survive on both sides */
+static int g_isi_pep_forward_splice(GIsiPEP *pep, gboolean uplink)
+{
+	int *fds = uplink ? pep->splice_tx : pep->splice_rx;
+	int in = uplink ? pep->tun_fd : pep->gprs_fd;
+	int out = uplink ? pep->gprs_fd : pep->tun_fd;
+	unsigned flags = SPLICE_F_MOVE|SPLICE_F_NONBLOCK;
+	ssize_t len, sent;
+	unsigned i;
+
+	for (i = 0; i < pep->depth; i++) {
+		pep->stats.syscalls++;
+		len = splice(in, NULL, fds[1], NULL, G_ISI_PEP_MTU, flags);
+		if (len < 0 && errno != EAGAIN && errno != EINTR)
+			return -errno;
+		if (len <= 0)
+			break;
+
+		pep->stats.syscalls++;
+		sent = splice(fds[0], NULL, out, NULL, len, flags);
+		if (sent < 0 && (errno == EINVAL || errno == ENOSYS) && i == 0) {
+			int err = errno;
+
+			/* the packet is already in the pipe, drop it */
+			g_isi_pep_drain(pep, fds[0]);
+			g_isi_pep_count(pep, uplink, len, 0);
+			return -err;
+		}
+
+		if (sent != len)
+			g_isi_pep_drain(pep, fds[0]);
+
+		g_isi_pep_count(pep, uplink, len, sent);
+	}
+
+	return 0;
+}
+
+/* Forward between the pipe and the TUN device in the current mode. If
+ * splice() is unsupported, this switches to batches and fails; the caller
+ * then continues with a batch. Any other failure leaves the mode as it
+ * is, and the caller has to stop watching. */
+static int g_isi_pep_forward(GIsiPEP *pep, gboolean uplink)
+{
+	int ret;
+
+	if (pep->mode == G_ISI_PEP_FORWARD_COPY)
+		return g_isi_pep_forward_copy(pep, uplink);
+
+	ret = g_isi_pep_forward_splice(pep, uplink);
+	if (ret == -EINVAL || ret == -ENOSYS) {
+		g_warning("splice() not supported (%s), using batches",
+				strerror(-ret));
+		g_isi_pep_close_splice(pep);
+		pep->mode = G_ISI_PEP_FORWARD_BATCH;
+	}
+
+	return ret;
+}
+
+/* Forward in a mode other than batches, FALSE if the caller should use
+ * a batch instead. On errors the watch is given up with *keep = FALSE. */
+static gboolean g_isi_pep_forwarded(GIsiPEP *pep, gboolean uplink,
+					gboolean *keep)
+{
+	int ret;
+
+	*keep = TRUE;
+
+	if (pep->mode == G_ISI_PEP_FORWARD_BATCH)
+		return FALSE;
+
+	ret = g_isi_pep_forward(pep, uplink);
+	if (ret == 0)
+		return TRUE;
+
+	if (pep->mode == G_ISI_PEP_FORWARD_BATCH)
+		return FALSE;
+
+	g_warning("Forwarding %s failed: %s", uplink ? "uplink" : "downlink",
+			strerror(-ret));
+	*keep = FALSE;
+	return TRUE;
+}
+
+static void g_isi_pep_deliver(GIsiPEP *pep, const uint8_t *buf, size_t len)
+{
+	if (pep->tun_fd != -1) {
+		pep->stats.syscalls++;
+		if (write(pep->tun_fd, buf, len) != (ssize_t)len) {
+			pep->stats.rx_dropped++;
+			return;
+		}
+	}
+
+	pep->stats.rx_packets++;
+	pep->stats.rx_bytes += len;
+
+	if (pep->tun_fd != -1 || !pep->data_func)
+		return;
+
+	/* The callback may destroy the PEP */
+	pep->delivering = TRUE;
+	pep->data_func(pep, buf, len, pep->data_opaque);
+	pep->delivering = FALSE;
+}
+
+static gboolean g_isi_pep_rx_callback(GIOChannel *channel, GIOCondition cond,
+					gpointer data)
+{
+	GIsiPEP *pep = data;
+	GIsiPEPRing *ring = &pep->rx;
+	struct mmsghdr *msgs = ring->msgs;
+	unsigned budget = PEP_RX_BUDGET;
+	gboolean keep;
+	int i, n;
+
+	if (cond & (G_IO_HUP|G_IO_ERR|G_IO_NVAL)) {
+		pep->rx_source = 0;
+		return FALSE;
+	}
+
+	if (pep->tun_fd != -1 && g_isi_pep_forwarded(pep, FALSE, &keep)) {
+		if (!keep)
+			pep->rx_source = 0;
+		return keep;
+	}
+
+	do {
+		g_isi_pep_ring_reset(ring);
+
+		n = g_isi_pep_recv_batch(pep, ring->msgs, ring->depth);
+		if (n <= 0)
+			break;
+
+		for (i = 0; i < n; i++) {
+			struct mmsghdr *m = &ring->msgs[i];
+
+			if (m->msg_hdr.msg_flags & MSG_TRUNC) {
+				pep->stats.rx_dropped++;
+				continue;
+			}
+
+			g_isi_pep_deliver(pep, ring->iov[i].iov_base,
+						m->msg_len);
+
+			if (pep->destroyed) {
+				g_free(pep);
+				return FALSE;
+			}
+
+			/* The callback may have stopped the data path or
+			 * resized the ring */
+			if (ring->msgs != msgs)
+				return TRUE;
+		}
+	} while (n == (int)ring->depth && --budget > 0);
+
+	return TRUE;
+}
+
+static gboolean g_isi_pep_tun_callback(GIOChannel *channel,
+					GIOCondition cond, gpointer data)
+{
+	GIsiPEP *pep = data;
+	GIsiPEPRing *ring = &pep->tx;
+	gboolean keep;
+	unsigned n;
+	ssize_t len;
+
+	if (cond & (G_IO_HUP|G_IO_ERR|G_IO_NVAL)) {
+		pep->tun_source = 0;
+		return FALSE;
+	}
+
+	if (g_isi_pep_forwarded(pep, TRUE, &keep)) {
+		if (!keep)
+			pep->tun_source = 0;
+		return keep;
+	}
+
+	/* A TUN device hands out one packet per read */
+	for (n = 0; n < ring->depth; n++) {
+		pep->stats.syscalls++;
+		len = read(pep->tun_fd, ring->iov[n].iov_base, G_ISI_PEP_MTU);
+		if (len <= 0)
+			break;
+		ring->iov[n].iov_len = len;
+	}
+
+	if (n > 0)
+		pep->stats.tx_dropped += n - g_isi_pep_flush(pep, ring->msgs, n);
+
+	return TRUE;
+}
+
+static guint g_isi_pep_watch(int fd, GIOFunc func, GIsiPEP *pep)
+{
+	GIOChannel *channel = g_io_channel_unix_new(fd);
+	guint source;
+
+	g_io_channel_set_encoding(channel, NULL, NULL);
+	g_io_channel_set_buffered(channel, FALSE);
+	source = g_isi_watch_add(pep->context, channel,
+				G_IO_IN|G_IO_ERR|G_IO_HUP|G_IO_NVAL, func, pep);
+	g_io_channel_unref(channel);
+
+	return source;
+}
+
+static int g_isi_pep_start_rx(GIsiPEP *pep)
+{
+	if (pep->gprs_fd == -1)
+		return -ENOTCONN;
+
+	if (!g_isi_pep_ring_init(&pep->rx, pep->depth))
+		return -ENOMEM;
+
+	fcntl(pep->gprs_fd, F_SETFL, O_NONBLOCK|fcntl(pep->gprs_fd, F_GETFL));
+
+	if (!pep->rx_source)
+		pep->rx_source = g_isi_pep_watch(pep->gprs_fd,
+						g_isi_pep_rx_callback, pep);
+	return 0;
+}
+
+/**
+ * Set the number of packets moved per batch, and the number of pooled
+ * buffers in each direction. Takes effect immediately.
+ * @param pep PEP (from g_isi_pep_create())
+ * @param depth number of buffers, 1 to G_ISI_PEP_RING_MAX
+ * @return 0 on success, a negative error code otherwise.
+ */
+int g_isi_pep_set_ring_depth(GIsiPEP *pep, unsigned depth)
+{
+	if (depth == 0 || depth > G_ISI_PEP_RING_MAX)
+		return -EINVAL;
+
+	pep->depth = depth;
+
+	if (pep->rx.depth && !g_isi_pep_ring_init(&pep->rx, depth))
+		goto error;
+
+	if (pep->tx.depth && !g_isi_pep_ring_init(&pep->tx, depth))
+		goto error;
+
+	return 0;
+
+error:
+	g_isi_pep_stop_data(pep);
+	return -ENOMEM;
+}
+
+/**
+ * Deliver every IP packet received on the pipe to @a func. The data
+ * passed to the callback is only valid until it returns.
+ * @param pep PEP whose pipe is connected
+ * @param func packet callback
+ * @param opaque data for the callback
+ * @return 0 on success, a negative error code otherwise.
+ */
+int g_isi_pep_start_data(GIsiPEP *pep, GIsiPEPDataFunc func, void *opaque)
+{
+	pep->data_func = func;
+	pep->data_opaque = opaque;
+
+	return g_isi_pep_start_rx(pep);
+}
+
+/**
+ * Forward IP packets between the pipe and a TUN device, in both
+ * directions. The TUN file descriptor is switched to non-blocking mode
+ * and remains owned by the caller.
+ * @param pep PEP whose pipe is connected
+ * @param tun_fd TUN device opened with IFF_TUN|IFF_NO_PI
+ * @return 0 on success, a negative error code otherwise.
+ */
+int g_isi_pep_attach_tun(GIsiPEP *pep, int tun_fd)
+{
+	int ret;
+
+	if (tun_fd < 0)
+		return -EINVAL;
+
+	if (!g_isi_pep_ring_init(&pep->tx, pep->depth))
+		return -ENOMEM;
+
+	/* stopping the data path closed the splice pipes */
+	if (pep->mode == G_ISI_PEP_FORWARD_SPLICE) {
+		ret = g_isi_pep_set_forward_mode(pep, pep->mode);
+		if (ret) {
+			g_warning("No splice pipes (%s), using batches",
+					strerror(-ret));
+			pep->mode = G_ISI_PEP_FORWARD_BATCH;
+		}
+	}
+
+	fcntl(tun_fd, F_SETFL, O_NONBLOCK|fcntl(tun_fd, F_GETFL));
+	pep->tun_fd = tun_fd;
+
+	ret = g_isi_pep_start_rx(pep);
+	if (ret) {
+		g_isi_pep_stop_data(pep);
+		return ret;
+	}
+
+	if (!pep->tun_source)
+		pep->tun_source = g_isi_pep_watch(tun_fd,
+						g_isi_pep_tun_callback, pep);
+	return 0;
+}
+
+/**
+ * Stop moving packets and release the packet buffers. The forwarding
+ * mode is kept, g_isi_pep_attach_tun() opens new splice pipes for it.
+ * @param pep PEP (from g_isi_pep_create())
+ */
+void g_isi_pep_stop_data(GIsiPEP *pep)
+{
+	if (pep->rx_source)
+		g_isi_source_remove(pep->context, pep->rx_source);
+	if (pep->tun_source)
+		g_isi_source_remove(pep->context, pep->tun_source);
+
+	pep->rx_source = 0;
+	pep->tun_source = 0;
+	pep->tun_fd = -1;
+	pep->data_func = NULL;
+	pep->data_opaque = NULL;
+
+	g_isi_pep_ring_free(&pep->rx);
+	g_isi_pep_ring_free(&pep->tx);
+	g_isi_pep_close_splice(pep);
+}
+
+/**
+ * Send a batch of IP packets on the pipe, one packet per vector.
+ * Packets the pipe does not take are counted as dropped.
+ * @param pep PEP whose pipe is connected
+ * @param pkts packets to send
+ * @param count number of packets
+ * @return number of packets sent, a negative error code otherwise.
+ */
+int g_isi_pep_sendv(GIsiPEP *pep, const struct iovec *pkts, unsigned count)
+{
+	return g_isi_pep_sendv_full(pep, pkts, count, FALSE);
+}
+
+/**
+ * Send a batch of IP packets on the pipe, like g_isi_pep_sendv().
+ * @param pep PEP whose pipe is connected
+ * @param pkts packets to send
+ * @param count number of packets
+ * @param retry whether the caller keeps packets that were not sent for
+ * another attempt; if so, they are not counted as dropped, see
+ * g_isi_pep_add_dropped()
+ * @return number of packets sent, a negative error code otherwise.
+ */
+int g_isi_pep_sendv_full(GIsiPEP *pep, const struct iovec *pkts,
+				unsigned count, gboolean retry)
+{
+	struct mmsghdr msgs[G_ISI_PEP_RING_MAX];
+	unsigned i, n, sent = 0;
+
+	if (pep->gprs_fd == -1)
+		return -ENOTCONN;
+
+	while (sent < count) {
+		n = MIN(count - sent, G_ISI_PEP_RING_MAX);
+
+		memset(msgs, 0, n * sizeof(*msgs));
+		for (i = 0; i < n; i++) {
+			msgs[i].msg_hdr.msg_iov = (struct iovec *)&pkts[sent + i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		i = g_isi_pep_flush(pep, msgs, n);
+		sent += i;
+		if (i < n)
+			break;
+	}
+
+	if (!retry)
+		pep->stats.tx_dropped += count - sent;
+
+	return sent;
+}
+
+/**
+ * Count packets given up by a caller of g_isi_pep_sendv_full() as
+ * dropped.
+ * @param pep PEP (from g_isi_pep_create())
+ * @param count number of packets
+ */
+void g_isi_pep_add_dropped(GIsiPEP *pep, unsigned count)
+{
+	pep->stats.tx_dropped += count;
+}
+
+/**
+ * Send a single IP packet on the pipe.
+ * @param pep PEP whose pipe is connected
+ * @param data packet
+ * @param len packet length
+ * @return 0 on success, a negative error code otherwise.
+ */
+int g_isi_pep_send(GIsiPEP *pep, const void *data, size_t len)
+{
+	const struct iovec iov = {
+		.iov_base = (void *)data,
+		.iov_len = len,
+	};
+	int ret = g_isi_pep_sendv(pep, &iov, 1);
+
+	if (ret < 0)
+		return ret;
+
+	return ret == 1 ? 0 : -EAGAIN;
+}
+
+/**
+ * Read the packet and byte counters of the data path.
+ * @param pep PEP (from g_isi_pep_create())
+ * @param stats filled with the counters
+ */
+void g_isi_pep_get_stats(const GIsiPEP *pep, GIsiPEPStats *stats)
+{
+	*stats = pep->stats;
+}
+
+/**
+ * Select how g_isi_pep_attach_tun() moves packets. Batches of
+ * recvmmsg()/sendmmsg() are the default, as they took the fewest system
+ * calls and the least CPU time per packet when measured against the plain
+ * copy loop. Splice keeps the packet data in the kernel and falls back to
+ * batches if either file descriptor does not support it; TUN devices do
+ * not, at least up to Linux 6.18. The syscalls counter of
+ * g_isi_pep_get_stats() compares the modes on a given system.
+ * @param pep PEP (from g_isi_pep_create())
+ * @param mode forwarding mode
+ * @return 0 on success, a negative error code otherwise.
+ */
+int g_isi_pep_set_forward_mode(GIsiPEP *pep, GIsiPEPForwardMode mode)
+{
+	switch (mode) {
+	case G_ISI_PEP_FORWARD_BATCH:
+	case G_ISI_PEP_FORWARD_COPY:
+		g_isi_pep_close_splice(pep);
+		break;
+
+	case G_ISI_PEP_FORWARD_SPLICE:
+		if (!g_isi_pep_open_pipe(pep->splice_rx) ||
+				!g_isi_pep_open_pipe(pep->splice_tx)) {
+			g_isi_pep_close_splice(pep);
+			return -errno;
+		}
+		break;
+
+	default:
+		return -EINVAL;
+	}
+
+	pep->mode = mode;
+	return 0;
+}
+
+GIsiPEPForwardMode g_isi_pep_get_forward_mode(const GIsiPEP *pep)
+{
+	return pep->mode;
+}
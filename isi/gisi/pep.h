@@ -19,11 +19,60 @@
  *
  */
 
+#ifndef __GISI_PEP_H
+#define __GISI_PEP_H
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <glib/gmain.h>
+#include <isi/gisi/modem.h>
+
 typedef struct _GIsiPEP GIsiPEP;
 typedef void (*GIsiPEPCallback)(GIsiPEP *pep, void *opaque);
+typedef void (*GIsiPEPDataFunc)(GIsiPEP *pep, const void *data, size_t len,
+				void *opaque);
+
+struct _GIsiPEPStats {
+	uint64_t rx_packets;
+	uint64_t rx_bytes;
+	uint64_t rx_dropped;
+	uint64_t tx_packets;
+	uint64_t tx_bytes;
+	uint64_t tx_dropped;
+	uint64_t syscalls; /* I/O system calls made by the data path */
+};
+typedef struct _GIsiPEPStats GIsiPEPStats;
+
+typedef enum {
+	G_ISI_PEP_FORWARD_BATCH,	/* recvmmsg()/sendmmsg() batches */
+	G_ISI_PEP_FORWARD_SPLICE,	/* splice() through a kernel pipe */
+	G_ISI_PEP_FORWARD_COPY,		/* one read()/write() per packet */
+} GIsiPEPForwardMode;
+
+/* Largest IP packet carried by the data path */
+#define G_ISI_PEP_MTU		2048
+#define G_ISI_PEP_RING_DEPTH	16
+#define G_ISI_PEP_RING_MAX	256
 
 GIsiPEP *g_isi_pep_create(GIsiModem *modem, GIsiPEPCallback, void *);
+GIsiPEP *g_isi_pep_create_with_context(GIsiModem *modem, GIsiPEPCallback,
+					void *, GMainContext *context);
 void g_isi_pep_destroy(GIsiPEP *pep);
 uint16_t g_isi_pep_get_object(const GIsiPEP *pep);
 unsigned g_isi_pep_get_ifindex(const GIsiPEP *pep);
 char *g_isi_pep_get_ifname(const GIsiPEP *pep, char *ifname);
+
+int g_isi_pep_set_ring_depth(GIsiPEP *pep, unsigned depth);
+int g_isi_pep_start_data(GIsiPEP *pep, GIsiPEPDataFunc func, void *opaque);
+int g_isi_pep_attach_tun(GIsiPEP *pep, int tun_fd);
+void g_isi_pep_stop_data(GIsiPEP *pep);
+int g_isi_pep_send(GIsiPEP *pep, const void *data, size_t len);
+int g_isi_pep_sendv(GIsiPEP *pep, const struct iovec *pkts, unsigned count);
+int g_isi_pep_sendv_full(GIsiPEP *pep, const struct iovec *pkts,
+				unsigned count, gboolean retry);
+void g_isi_pep_add_dropped(GIsiPEP *pep, unsigned count);
+void g_isi_pep_get_stats(const GIsiPEP *pep, GIsiPEPStats *stats);
+int g_isi_pep_set_forward_mode(GIsiPEP *pep, GIsiPEPForwardMode mode);
+GIsiPEPForwardMode g_isi_pep_get_forward_mode(const GIsiPEP *pep);
+
+#endif /* __GISI_PEP_H */
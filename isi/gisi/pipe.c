@@ -62,6 +62,7 @@ typedef struct {
 typedef struct {
 	uint8_t cmd;
 	uint8_t pipe_handle;
+	uint8_t pad;
 } isi_pipe_remove_req_t;
 
 typedef struct {
@@ -115,15 +116,26 @@ enum {
 	PN_MSG_PRIORITY_HIGH,
 };
 
+#define PIPE_CREATE_TIMEOUT	3
+#define PIPE_TIMEOUT		5
+
 struct _GIsiPipe {
 	GIsiClient *client;
 	void (*handler)(GIsiPipe *);
 	void (*error_handler)(GIsiPipe *);
+	void (*state_handler)(GIsiPipe *);
 	void *opaque;
 	int error;
 	uint8_t handle;
-	gboolean enabled;
-	gboolean enabling;
+	GIsiPipeState state;
+	gboolean enable_on_create;
+	gboolean start_pending;
+	gboolean own_client;
+
+	/* Outstanding requests, cancelled on destruction */
+	GIsiRequest *create_req;
+	GIsiRequest *enable_req;
+	GIsiRequest *reset_req;
 };
 
 static int g_isi_pipe_error(uint8_t code)
@@ -149,15 +161,32 @@ static int g_isi_pipe_error(uint8_t code)
 	return -EBADMSG;
 }
 
+static void g_isi_pipe_set_state(GIsiPipe *pipe, GIsiPipeState state)
+{
+	if (pipe->state == state)
+		return;
+
+	pipe->state = state;
+	if (pipe->state_handler)
+		pipe->state_handler(pipe);
+}
+
+static void g_isi_pipe_fail(GIsiPipe *pipe, int err)
+{
+	pipe->error = err;
+	pipe->start_pending = FALSE;
+	g_isi_pipe_set_state(pipe, G_ISI_PIPE_FAILED);
+	if (pipe->error_handler)
+		pipe->error_handler(pipe);
+}
+
 static void g_isi_pipe_handle_error(GIsiPipe *pipe, uint8_t code)
 {
 	int err = g_isi_pipe_error(code);
 
 	if (err == 0)
 		return;
-	pipe->error = err;
-	if (pipe->error_handler)
-		pipe->error_handler(pipe);
+	g_isi_pipe_fail(pipe, err);
 }
 
 static gboolean g_isi_pipe_created(GIsiClient *client,
@@ -167,18 +196,38 @@ static gboolean g_isi_pipe_created(GIsiClient *client,
 	GIsiPipe *pipe = opaque;
 	const isi_pipe_resp_t *resp = data;
 
+	if (!resp) {
+		pipe->create_req = NULL;
+		g_isi_pipe_fail(pipe, g_isi_client_error(client));
+		return TRUE;
+	}
+
 	if (len < 5 ||
 	    resp->cmd != PNS_PIPE_CREATE_RESP)
 		return FALSE;
 
-	if (resp->pipe_handle != PN_PIPE_INVALID_HANDLE) {
-		pipe->handle = resp->pipe_handle;
-		if (pipe->enabling)
+	pipe->create_req = NULL;
+
+	if (resp->pipe_handle == PN_PIPE_INVALID_HANDLE) {
+		if (resp->error_code == PN_PIPE_NO_ERROR)
+			g_isi_pipe_fail(pipe, -EBADMSG);
+		else
+			g_isi_pipe_handle_error(pipe, resp->error_code);
+		return TRUE;
+	}
+
+	pipe->handle = resp->pipe_handle;
+
+	if (pipe->enable_on_create) {
+		g_isi_pipe_set_state(pipe, G_ISI_PIPE_ENABLED);
+	} else {
+		g_isi_pipe_set_state(pipe, G_ISI_PIPE_CREATED);
+		if (pipe->start_pending)
 			g_isi_pipe_start(pipe);
-		if (pipe->handler)
-			pipe->handler(pipe);
-	} else
-		g_isi_pipe_handle_error(pipe, resp->error_code);
+	}
+
+	if (pipe->handler)
+		pipe->handler(pipe);
 	return TRUE;
 }
 
@@ -195,10 +244,20 @@ static gboolean g_isi_pipe_created(GIsiClient *client,
 GIsiPipe *g_isi_pipe_create(GIsiModem *modem, void (*created)(GIsiPipe *),
 				uint16_t obj1, uint16_t obj2,
 				uint8_t type1, uint8_t type2)
+{
+	return g_isi_pipe_create_full(modem, created, obj1, obj2,
+					type1, type2, FALSE);
+}
+
+static GIsiPipe *g_isi_pipe_new(GIsiClient *client, gboolean own_client,
+					void (*created)(GIsiPipe *),
+					uint16_t obj1, uint16_t obj2,
+					uint8_t type1, uint8_t type2,
+					gboolean enable)
 {
 	isi_pipe_create_req_t msg = {
 		.cmd = PNS_PIPE_CREATE_REQ,
-		.state_after = PN_PIPE_DISABLE,
+		.state_after = enable ? PN_PIPE_ENABLE : PN_PIPE_DISABLE,
 		.priority = PN_MSG_PRIORITY_LOW,
 		.device1 = obj1 >> 8,
 		.object1 = obj1 & 0xff,
@@ -208,33 +267,110 @@ GIsiPipe *g_isi_pipe_create(GIsiModem *modem, void (*created)(GIsiPipe *),
 		.type2 = type2,
 		.n_sb = 0,
 	};
-	GIsiPipe *pipe = g_try_malloc(sizeof(GIsiPipe));
+	GIsiPipe *pipe = g_try_new0(GIsiPipe, 1);
 
 	if (pipe == NULL)
 		return NULL;
 
-	pipe->client = g_isi_client_create(modem, PN_PIPE);
+	pipe->client = client;
+	pipe->own_client = own_client;
 	pipe->handler = created;
 	pipe->error_handler = NULL;
+	pipe->state_handler = NULL;
 	pipe->error = 0;
-	pipe->enabling = FALSE;
-	pipe->enabled = FALSE;
 	pipe->handle = PN_PIPE_INVALID_HANDLE;
+	pipe->state = G_ISI_PIPE_CREATING;
+	pipe->enable_on_create = enable;
+	pipe->start_pending = FALSE;
+
+	if (pipe->client == NULL)
+		goto error;
 
-	if (pipe->client == NULL ||
-	    g_isi_request_make(pipe->client, &msg, sizeof(msg), 3,
-				g_isi_pipe_created, pipe) == NULL)
+	pipe->create_req = g_isi_request_make(pipe->client, &msg, sizeof(msg),
+						PIPE_CREATE_TIMEOUT,
+						g_isi_pipe_created, pipe);
+	if (pipe->create_req == NULL)
 		goto error;
 
 	return pipe;
 
 error:
-	if (pipe->client)
+	if (pipe->client && own_client)
 		g_isi_client_destroy(pipe->client);
 	g_free(pipe);
 	return NULL;
 }
 
+/**
+ * Create a Phonet pipe with low priority. A pipe created enabled carries
+ * data as soon as the creation callback is called, saving the round
+ * trip of g_isi_pipe_start().
+ * @param modem ISI modem to create a pipe with
+ * @param created optional callback for created event
+ * @param obj1 Object handle of the first end point
+ * @param obj2 Object handle of the second end point
+ * @param type1 Type of the first end point
+ * @param type2 Type of the second end point
+ * @param enable whether to create the pipe in enabled state
+ * @return a pipe object on success, NULL on error.
+ */
+GIsiPipe *g_isi_pipe_create_full(GIsiModem *modem,
+					void (*created)(GIsiPipe *),
+					uint16_t obj1, uint16_t obj2,
+					uint8_t type1, uint8_t type2,
+					gboolean enable)
+{
+	return g_isi_pipe_new(g_isi_client_create(modem, PN_PIPE), TRUE,
+				created, obj1, obj2, type1, type2, enable);
+}
+
+/**
+ * Like g_isi_pipe_create_full(), for a pipe dispatched from @a context.
+ * The pipe must only be used from the thread running @a context.
+ * @param context main context, NULL for the default one
+ * @return a pipe object on success, NULL on error.
+ */
+GIsiPipe *g_isi_pipe_create_with_context(GIsiModem *modem,
+						void (*created)(GIsiPipe *),
+						uint16_t obj1, uint16_t obj2,
+						uint8_t type1, uint8_t type2,
+						gboolean enable,
+						GMainContext *context)
+{
+	GIsiClient *client;
+
+	client = g_isi_client_create_with_context(modem, PN_PIPE, context);
+	return g_isi_pipe_new(client, TRUE, created, obj1, obj2,
+				type1, type2, enable);
+}
+
+/**
+ * Create a Phonet pipe on an existing PN_PIPE client, saving a socket
+ * per pipe. The client must outlive the pipe.
+ * @param client ISI client for PN_PIPE
+ * @param created optional callback for created event
+ * @param obj1 Object handle of the first end point
+ * @param obj2 Object handle of the second end point
+ * @param type1 Type of the first end point
+ * @param type2 Type of the second end point
+ * @param enable whether to create the pipe in enabled state
+ * @return a pipe object on success, NULL on error.
+ */
+GIsiPipe *g_isi_pipe_create_shared(GIsiClient *client,
+					void (*created)(GIsiPipe *),
+					uint16_t obj1, uint16_t obj2,
+					uint8_t type1, uint8_t type2,
+					gboolean enable)
+{
+	if (client == NULL || g_isi_client_resource(client) != PN_PIPE) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return g_isi_pipe_new(client, FALSE, created, obj1, obj2,
+				type1, type2, enable);
+}
+
 static const isi_pipe_resp_t *
 g_isi_pipe_check_resp(const GIsiPipe *pipe, uint8_t cmd,
 			const void *restrict data, size_t len)
@@ -254,14 +390,26 @@ static gboolean g_isi_pipe_enabled(GIsiClient *client,
 	GIsiPipe *pipe = opaque;
 	const isi_pipe_resp_t *resp;
 
+	if (!data) {
+		pipe->enable_req = NULL;
+		if (pipe->state == G_ISI_PIPE_ENABLING)
+			g_isi_pipe_fail(pipe, g_isi_client_error(client));
+		return TRUE;
+	}
+
 	resp = g_isi_pipe_check_resp(pipe, PNS_PIPE_ENABLE_RESP, data, len);
 	if (!resp)
 		return FALSE;
 
+	pipe->enable_req = NULL;
+
+	/* Superseded by a reset or removal */
+	if (pipe->state != G_ISI_PIPE_ENABLING)
+		return TRUE;
+
 	g_isi_pipe_handle_error(pipe, resp->error_code);
-	pipe->enabling = FALSE;
 	if (!pipe->error)
-		pipe->enabled = TRUE;
+		g_isi_pipe_set_state(pipe, G_ISI_PIPE_ENABLED);
 	return TRUE;
 }
 
@@ -273,12 +421,13 @@ static GIsiRequest *g_isi_pipe_enable(GIsiPipe *pipe)
 	};
 	const size_t len = 3;
 
-	return g_isi_request_make(pipe->client, &msg, len, 5,
+	return g_isi_request_make(pipe->client, &msg, len, PIPE_TIMEOUT,
 					g_isi_pipe_enabled, pipe);
 }
 
 /**
  * Enable a pipe, i.e. turn on data transfer between the two end points.
+ * A pipe that is still being created is enabled as soon as it exists.
  * @param pipe pipe as returned from g_isi_pipe_create()
  * @return 0 on success or an error code
  */
@@ -286,45 +435,115 @@ int g_isi_pipe_start(GIsiPipe *pipe)
 {
 	if (pipe->error)
 		return pipe->error;
-	if (pipe->enabling || pipe->enabled)
+
+	switch (pipe->state) {
+	case G_ISI_PIPE_CREATING:
+		pipe->start_pending = TRUE;
 		return 0;
 
-	if (pipe->handle != PN_PIPE_INVALID_HANDLE)
-		g_isi_pipe_enable(pipe);
-	else
-		pipe->enabling = TRUE;
+	case G_ISI_PIPE_CREATED:
+		pipe->start_pending = FALSE;
+		g_isi_request_cancel(pipe->enable_req);
+		pipe->enable_req = g_isi_pipe_enable(pipe);
+		if (!pipe->enable_req)
+			return -errno;
+		g_isi_pipe_set_state(pipe, G_ISI_PIPE_ENABLING);
+		return 0;
 
-	return 0;
+	case G_ISI_PIPE_ENABLING:
+	case G_ISI_PIPE_ENABLED:
+		return 0;
+
+	case G_ISI_PIPE_RESETTING:
+		return -EBUSY;
+
+	default:
+		return -EPIPE;
+	}
 }
 
-/* Not very useful, it will never have time to trigger */
-static gboolean g_isi_pipe_removed(GIsiClient *client,
+static gboolean g_isi_pipe_reset_done(GIsiClient *client,
 					const void *restrict data, size_t len,
 					uint16_t object, void *opaque)
 {
 	GIsiPipe *pipe = opaque;
 	const isi_pipe_resp_t *resp;
 
-	resp = g_isi_pipe_check_resp(pipe, PNS_PIPE_REMOVE_RESP, data, len);
+	if (!data) {
+		pipe->reset_req = NULL;
+		if (pipe->state == G_ISI_PIPE_RESETTING)
+			g_isi_pipe_fail(pipe, g_isi_client_error(client));
+		return TRUE;
+	}
+
+	resp = g_isi_pipe_check_resp(pipe, PNS_PIPE_RESET_RESP, data, len);
 	if (!resp)
 		return FALSE;
 
-	pipe->handle = PN_PIPE_INVALID_HANDLE;
-	pipe->error = -EPIPE;
+	pipe->reset_req = NULL;
+
+	if (pipe->state != G_ISI_PIPE_RESETTING)
+		return TRUE;
+
+	g_isi_pipe_handle_error(pipe, resp->error_code);
+	if (!pipe->error)
+		g_isi_pipe_set_state(pipe, G_ISI_PIPE_CREATED);
 	return TRUE;
 }
 
+/**
+ * Reset a pipe to disabled state, discarding data in transit. This also
+ * recovers a pipe that failed after it was created.
+ * @param pipe pipe as returned from g_isi_pipe_create()
+ * @return 0 on success or an error code
+ */
+int g_isi_pipe_reset(GIsiPipe *pipe)
+{
+	isi_pipe_reset_req_t msg = {
+		.cmd = PNS_PIPE_RESET_REQ,
+		.pipe_handle = pipe->handle,
+		.state_after = PN_PIPE_DISABLE,
+	};
+
+	switch (pipe->state) {
+	case G_ISI_PIPE_CREATING:
+		return -EBUSY;
+
+	case G_ISI_PIPE_RESETTING:
+		return 0;
+
+	case G_ISI_PIPE_REMOVING:
+		return -EPIPE;
+
+	default:
+		break;
+	}
 
-static GIsiRequest *g_isi_pipe_remove(GIsiPipe *pipe)
+	if (pipe->handle == PN_PIPE_INVALID_HANDLE)
+		return -EBADF;
+
+	g_isi_request_cancel(pipe->reset_req);
+	pipe->reset_req = g_isi_request_make(pipe->client, &msg, sizeof(msg),
+						PIPE_TIMEOUT,
+						g_isi_pipe_reset_done, pipe);
+	if (!pipe->reset_req)
+		return -errno;
+
+	pipe->error = 0;
+	pipe->start_pending = FALSE;
+	g_isi_pipe_set_state(pipe, G_ISI_PIPE_RESETTING);
+	return 0;
+}
+
+/* Nobody waits for the response, the pipe is gone by then */
+static void g_isi_pipe_remove(GIsiPipe *pipe)
 {
 	isi_pipe_remove_req_t msg = {
 		.cmd = PNS_PIPE_REMOVE_REQ,
 		.pipe_handle = pipe->handle,
 	};
-	const size_t len = 3;
 
-	return g_isi_request_make(pipe->client, &msg, len, 5,
-					g_isi_pipe_removed, pipe);
+	g_isi_request_make(pipe->client, &msg, sizeof(msg), 0, NULL, NULL);
 }
 
 /**
@@ -333,9 +552,17 @@ static GIsiRequest *g_isi_pipe_remove(GIsiPipe *pipe)
  */
 void g_isi_pipe_destroy(GIsiPipe *pipe)
 {
-	if (!pipe->error)
+	g_isi_request_cancel(pipe->create_req);
+	g_isi_request_cancel(pipe->enable_req);
+	g_isi_request_cancel(pipe->reset_req);
+
+	if (pipe->handle != PN_PIPE_INVALID_HANDLE) {
+		pipe->state = G_ISI_PIPE_REMOVING;
 		g_isi_pipe_remove(pipe);
-	g_isi_client_destroy(pipe->client);
+	}
+
+	if (pipe->own_client)
+		g_isi_client_destroy(pipe->client);
 	g_free(pipe);
 }
 
@@ -373,3 +600,18 @@ uint8_t g_isi_pipe_get_handle(GIsiPipe *pipe)
 {
 	return pipe->handle;
 }
+
+GIsiPipeState g_isi_pipe_get_state(const GIsiPipe *pipe)
+{
+	return pipe->state;
+}
+
+/**
+ * Set a callback to be notified of every state change of a pipe.
+ * @param pipe pipe as returned from g_isi_pipe_create()
+ * @param cb callback, reads the new state with g_isi_pipe_get_state()
+ */
+void g_isi_pipe_set_state_handler(GIsiPipe *pipe, void (*cb)(GIsiPipe *))
+{
+	pipe->state_handler = cb;
+}
@@ -19,11 +19,45 @@
  *
  */
 
+#ifndef __GISI_PIPE_H
+#define __GISI_PIPE_H
+
+#include <stdint.h>
+#include <glib/gtypes.h>
+#include <glib/gmain.h>
+#include <isi/gisi/modem.h>
+#include <isi/gisi/client.h>
+
 typedef struct _GIsiPipe GIsiPipe;
 
+typedef enum {
+	G_ISI_PIPE_CREATING,
+	G_ISI_PIPE_CREATED,	/* exists, data transfer disabled */
+	G_ISI_PIPE_ENABLING,
+	G_ISI_PIPE_ENABLED,
+	G_ISI_PIPE_RESETTING,
+	G_ISI_PIPE_REMOVING,
+	G_ISI_PIPE_FAILED,	/* see g_isi_pipe_get_error() */
+} GIsiPipeState;
+
 GIsiPipe *g_isi_pipe_create(GIsiModem *, void (*cb)(GIsiPipe *),
 				uint16_t obj1, uint16_t obj2,
 				uint8_t type1, uint8_t type2);
+GIsiPipe *g_isi_pipe_create_full(GIsiModem *, void (*cb)(GIsiPipe *),
+					uint16_t obj1, uint16_t obj2,
+					uint8_t type1, uint8_t type2,
+					gboolean enable);
+GIsiPipe *g_isi_pipe_create_with_context(GIsiModem *,
+						void (*cb)(GIsiPipe *),
+						uint16_t obj1, uint16_t obj2,
+						uint8_t type1, uint8_t type2,
+						gboolean enable,
+						GMainContext *context);
+GIsiPipe *g_isi_pipe_create_shared(GIsiClient *client,
+					void (*cb)(GIsiPipe *),
+					uint16_t obj1, uint16_t obj2,
+					uint8_t type1, uint8_t type2,
+					gboolean enable);
 void g_isi_pipe_destroy(GIsiPipe *pipe);
 
 void g_isi_pipe_set_error_handler(GIsiPipe *pipe, void (*cb)(GIsiPipe *));
@@ -33,3 +67,8 @@ void *g_isi_pipe_get_userdata(GIsiPipe *pipe);
 uint8_t g_isi_pipe_get_handle(GIsiPipe *pipe);
 
 int g_isi_pipe_start(GIsiPipe *pipe);
+int g_isi_pipe_reset(GIsiPipe *pipe);
+GIsiPipeState g_isi_pipe_get_state(const GIsiPipe *pipe);
+void g_isi_pipe_set_state_handler(GIsiPipe *pipe, void (*cb)(GIsiPipe *));
+
+#endif /* __GISI_PIPE_H */
@@ -0,0 +1,377 @@
+/*
+ * This file is GPLv2
+ * Copyright (C) 2010 Sebastian Reichel
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <errno.h>
+#include <glib.h>
+
+#include "client.h"
+#include "pep.h"
+#include "pipe.h"
+#include "pipepool.h"
+#include "socket.h"
+
+#define PN_PIPE			0xd9
+
+/* Seconds before replacing pipes that failed */
+#define POOL_RETRY_TIMEOUT	5
+
+struct _GIsiPoolEntry {
+	GIsiPipePool *pool;
+	GIsiPEP *pep;
+	GIsiPipe *pipe;
+	gboolean pep_ready;
+	gboolean pipe_ready;
+	gboolean taken;
+	gboolean discard; /* freed on the next refill */
+};
+typedef struct _GIsiPoolEntry GIsiPoolEntry;
+
+struct _GIsiPipePool {
+	GIsiModem *modem;
+	GIsiClient *client; /* shared by all pipes of the pool */
+	unsigned size;
+	uint16_t obj;
+	uint8_t local_type;
+	uint8_t remote_type;
+
+	GSList *entries;
+	GSList *ready;
+	unsigned count; /* entries not taken */
+	guint retry;
+};
+
+static GIsiPoolEntry *g_isi_pool_find(GIsiPipePool *pool, GIsiPipe *pipe)
+{
+	GSList *l;
+
+	for (l = pool->entries; l; l = l->next) {
+		GIsiPoolEntry *entry = l->data;
+
+		if (entry->pipe == pipe)
+			return entry;
+	}
+
+	return NULL;
+}
+
+static void g_isi_pool_entry_free(GIsiPoolEntry *entry)
+{
+	GIsiPipePool *pool = entry->pool;
+
+	pool->entries = g_slist_remove(pool->entries, entry);
+	pool->ready = g_slist_remove(pool->ready, entry);
+	if (!entry->taken)
+		pool->count--;
+
+	if (entry->pipe)
+		g_isi_pipe_destroy(entry->pipe);
+	if (entry->pep)
+		g_isi_pep_destroy(entry->pep);
+	g_free(entry);
+}
+
+static void g_isi_pool_check_ready(GIsiPoolEntry *entry)
+{
+	GIsiPipePool *pool = entry->pool;
+
+	if (entry->taken || entry->discard)
+		return;
+
+	if (!entry->pep_ready || !entry->pipe_ready)
+		return;
+
+	if (!g_slist_find(pool->ready, entry))
+		pool->ready = g_slist_append(pool->ready, entry);
+}
+
+static gboolean g_isi_pool_refill(gpointer data);
+
+/* Pipes are freed from the main loop, not from within their callbacks */
+static void g_isi_pool_schedule(GIsiPipePool *pool, unsigned timeout)
+{
+	GMainContext *context = g_isi_client_get_context(pool->client);
+
+	if (pool->retry)
+		return;
+
+	if (timeout)
+		pool->retry = g_isi_timeout_add_seconds(context, timeout,
+							g_isi_pool_refill,
+							pool);
+	else
+		pool->retry = g_isi_idle_add(context, g_isi_pool_refill, pool);
+}
+
+static void g_isi_pool_pipe_state(GIsiPipe *pipe)
+{
+	GIsiPoolEntry *entry = g_isi_pipe_get_userdata(pipe);
+
+	switch (g_isi_pipe_get_state(pipe)) {
+	case G_ISI_PIPE_CREATED:
+		entry->pipe_ready = TRUE;
+		g_isi_pool_check_ready(entry);
+		break;
+
+	case G_ISI_PIPE_FAILED:
+		entry->discard = TRUE;
+		entry->pool->ready = g_slist_remove(entry->pool->ready, entry);
+		g_isi_pool_schedule(entry->pool, POOL_RETRY_TIMEOUT);
+		break;
+
+	default:
+		entry->pipe_ready = FALSE;
+		entry->pool->ready = g_slist_remove(entry->pool->ready, entry);
+		break;
+	}
+}
+
+static void g_isi_pool_pep_ready(GIsiPEP *pep, void *opaque)
+{
+	GIsiPoolEntry *entry = opaque;
+
+	entry->pep_ready = TRUE;
+	g_isi_pool_check_ready(entry);
+}
+
+static gboolean g_isi_pool_add(GIsiPipePool *pool)
+{
+	GIsiPoolEntry *entry = g_try_new0(GIsiPoolEntry, 1);
+
+	if (!entry)
+		return FALSE;
+
+	entry->pool = pool;
+	entry->pep = g_isi_pep_create_with_context(pool->modem,
+					g_isi_pool_pep_ready, entry,
+					g_isi_client_get_context(pool->client));
+	if (!entry->pep)
+		goto error;
+
+	entry->pipe = g_isi_pipe_create_shared(pool->client, NULL,
+					g_isi_pep_get_object(entry->pep),
+					pool->obj, pool->local_type,
+					pool->remote_type, FALSE);
+	if (!entry->pipe)
+		goto error;
+
+	g_isi_pipe_set_userdata(entry->pipe, entry);
+	g_isi_pipe_set_state_handler(entry->pipe, g_isi_pool_pipe_state);
+
+	pool->entries = g_slist_prepend(pool->entries, entry);
+	pool->count++;
+	return TRUE;
+
+error:
+	if (entry->pep)
+		g_isi_pep_destroy(entry->pep);
+	g_free(entry);
+	return FALSE;
+}
+
+/* Replace failed or surplus pipes and top up the pool */
+static gboolean g_isi_pool_refill(gpointer data)
+{
+	GIsiPipePool *pool = data;
+	GSList *l, *next;
+
+	pool->retry = 0;
+
+	for (l = pool->entries; l; l = next) {
+		GIsiPoolEntry *entry = l->data;
+
+		next = l->next;
+		if (entry->discard && !entry->taken)
+			g_isi_pool_entry_free(entry);
+	}
+
+	while (pool->count < pool->size) {
+		if (!g_isi_pool_add(pool)) {
+			g_isi_pool_schedule(pool, POOL_RETRY_TIMEOUT);
+			break;
+		}
+	}
+
+	return FALSE;
+}
+
+/**
+ * Create a pool of pipes from new host PEPs to a modem end point.
+ * @param modem ISI modem to create the pipes with
+ * @param size number of pipes kept ready
+ * @param obj object handle of the modem end point
+ * @param local_type type of the host end points
+ * @param remote_type type of the modem end point
+ * @return a pipe pool on success, NULL on error.
+ */
+GIsiPipePool *g_isi_pipe_pool_create(GIsiModem *modem, unsigned size,
+					uint16_t obj, uint8_t local_type,
+					uint8_t remote_type)
+{
+	return g_isi_pipe_pool_create_with_context(modem, size, obj,
+							local_type, remote_type,
+							NULL);
+}
+
+/**
+ * Create a pipe pool whose pipes and PEPs are dispatched from @a
+ * context. The pool must only be used from the thread running it.
+ * @param context main context, NULL for the default one
+ * @return a pipe pool on success, NULL on error.
+ */
+GIsiPipePool *g_isi_pipe_pool_create_with_context(GIsiModem *modem,
+							unsigned size,
+							uint16_t obj,
+							uint8_t local_type,
+							uint8_t remote_type,
+							GMainContext *context)
+{
+	GIsiPipePool *pool;
+
+	if (size == 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	pool = g_try_new0(GIsiPipePool, 1);
+	if (!pool)
+		return NULL;
+
+	pool->client = g_isi_client_create_with_context(modem, PN_PIPE,
+								context);
+	if (!pool->client) {
+		g_free(pool);
+		return NULL;
+	}
+
+	pool->modem = modem;
+	pool->size = size;
+	pool->obj = obj;
+	pool->local_type = local_type;
+	pool->remote_type = remote_type;
+
+	g_isi_pool_refill(pool);
+	return pool;
+}
+
+/**
+ * Destroy a pipe pool, including all pipes taken from it.
+ * @param pool pool as returned from g_isi_pipe_pool_create()
+ */
+void g_isi_pipe_pool_destroy(GIsiPipePool *pool)
+{
+	if (!pool)
+		return;
+
+	if (pool->retry)
+		g_isi_source_remove(g_isi_client_get_context(pool->client),
+					pool->retry);
+
+	while (pool->entries)
+		g_isi_pool_entry_free(pool->entries->data);
+
+	g_isi_client_destroy(pool->client);
+	g_free(pool);
+}
+
+/**
+ * Take a created, disabled pipe and its connected host PEP out of the
+ * pool. Both stay owned by the pool; hand them back with
+ * g_isi_pipe_pool_release() instead of destroying them. The pool
+ * creates a replacement in the background.
+ * @param pool pool as returned from g_isi_pipe_pool_create()
+ * @param pipe set to the pipe
+ * @param pep set to the host end point of the pipe
+ * @return 0 on success, -EAGAIN if no pipe is ready.
+ */
+int g_isi_pipe_pool_take(GIsiPipePool *pool, GIsiPipe **pipe, GIsiPEP **pep)
+{
+	GIsiPoolEntry *entry;
+
+	if (!pool->ready)
+		return -EAGAIN;
+
+	entry = pool->ready->data;
+	pool->ready = g_slist_delete_link(pool->ready, pool->ready);
+
+	entry->taken = TRUE;
+	pool->count--;
+	g_isi_pipe_set_state_handler(entry->pipe, NULL);
+
+	*pipe = entry->pipe;
+	*pep = entry->pep;
+
+	g_isi_pool_schedule(pool, 0);
+	return 0;
+}
+
+/**
+ * Return a pipe taken with g_isi_pipe_pool_take(). The pipe is reset
+ * to disabled state and reused, unless the pool is already full.
+ * @param pool pool the pipe was taken from
+ * @param pipe pipe to return
+ */
+void g_isi_pipe_pool_release(GIsiPipePool *pool, GIsiPipe *pipe)
+{
+	GIsiPoolEntry *entry = g_isi_pool_find(pool, pipe);
+
+	if (!entry || !entry->taken)
+		return;
+
+	g_isi_pipe_set_userdata(pipe, entry);
+	g_isi_pipe_set_error_handler(pipe, NULL);
+	g_isi_pipe_set_state_handler(pipe, g_isi_pool_pipe_state);
+	g_isi_pep_stop_data(entry->pep);
+
+	entry->taken = FALSE;
+	entry->pipe_ready = FALSE;
+	pool->count++;
+
+	if (pool->count > pool->size) {
+		entry->discard = TRUE;
+		g_isi_pool_schedule(pool, 0);
+		return;
+	}
+
+	switch (g_isi_pipe_get_state(pipe)) {
+	case G_ISI_PIPE_CREATED:
+		entry->pipe_ready = TRUE;
+		g_isi_pool_check_ready(entry);
+		break;
+
+	case G_ISI_PIPE_RESETTING:
+		break;
+
+	default:
+		if (g_isi_pipe_reset(pipe) == 0)
+			break;
+
+		entry->discard = TRUE;
+		g_isi_pool_schedule(pool, 0);
+		break;
+	}
+}
+
+/**
+ * @param pool pool as returned from g_isi_pipe_pool_create()
+ * @return number of pipes that can be taken right away.
+ */
+unsigned g_isi_pipe_pool_ready(const GIsiPipePool *pool)
+{
+	return g_slist_length(pool->ready);
+}
+
+/**
+ * @param pool pool as returned from g_isi_pipe_pool_create()
+ * @return number of pipes taken and not released yet.
+ */
+unsigned g_isi_pipe_pool_taken(const GIsiPipePool *pool)
+{
+	return g_slist_length(pool->entries) - pool->count;
+}
@@ -0,0 +1,36 @@
+/*
+ * This file is GPLv2
+ * Copyright (C) 2010 Sebastian Reichel
+ */
+
+#ifndef __GISI_PIPEPOOL_H
+#define __GISI_PIPEPOOL_H
+
+#include <isi/gisi/pep.h>
+#include <isi/gisi/pipe.h>
+
+/*
+ * Pool of pipes between host PEPs and a modem end point, created ahead
+ * of time in disabled state. Taking a pipe from the pool leaves only
+ * the enable round trip, see g_isi_pipe_start().
+ */
+
+typedef struct _GIsiPipePool GIsiPipePool;
+
+GIsiPipePool *g_isi_pipe_pool_create(GIsiModem *modem, unsigned size,
+					uint16_t obj, uint8_t local_type,
+					uint8_t remote_type);
+GIsiPipePool *g_isi_pipe_pool_create_with_context(GIsiModem *modem,
+							unsigned size,
+							uint16_t obj,
+							uint8_t local_type,
+							uint8_t remote_type,
+							GMainContext *context);
+void g_isi_pipe_pool_destroy(GIsiPipePool *pool);
+
+int g_isi_pipe_pool_take(GIsiPipePool *pool, GIsiPipe **pipe, GIsiPEP **pep);
+void g_isi_pipe_pool_release(GIsiPipePool *pool, GIsiPipe *pipe);
+unsigned g_isi_pipe_pool_ready(const GIsiPipePool *pool);
+unsigned g_isi_pipe_pool_taken(const GIsiPipePool *pool);
+
+#endif /* __GISI_PIPEPOOL_H */
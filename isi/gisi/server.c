@@ -57,6 +57,7 @@ struct _GIsiServer {
 	/* Callbacks */
 	int fd;
 	guint source;
+	GMainContext *context;
 	GIsiRequestFunc func[256];
 	void *data[256];
 
@@ -75,6 +76,22 @@ static gboolean g_isi_server_callback(GIOChannel *channel, GIOCondition cond,
  */
 GIsiServer *g_isi_server_create(GIsiModem *modem, uint8_t resource,
 				uint8_t major, uint8_t minor)
+{
+	return g_isi_server_create_with_context(modem, resource, major, minor,
+						NULL);
+}
+
+/**
+ * Create an ISI server whose requests are dispatched from @a context.
+ * The server must only be used from the thread running @a context.
+ * @param resource PhoNet resource ID for the server
+ * @param context main context, NULL for the default one
+ * @return NULL on error (see errno), a GIsiServer pointer on success,
+ */
+GIsiServer *g_isi_server_create_with_context(GIsiModem *modem,
+						uint8_t resource,
+						uint8_t major, uint8_t minor,
+						GMainContext *context)
 {
 	void *ptr;
 	GIsiServer *self;
@@ -97,8 +114,9 @@ GIsiServer *g_isi_server_create(GIsiModem *modem, uint8_t resource,
 		return NULL;
 	}
 
+	self->context = context ? g_main_context_ref(context) : NULL;
 	self->fd = g_io_channel_unix_get_fd(channel);
-	self->source = g_io_add_watch(channel,
+	self->source = g_isi_watch_add(context, channel,
 					G_IO_IN|G_IO_ERR|G_IO_HUP|G_IO_NVAL,
 					g_isi_server_callback, self);
 	g_io_channel_unref(channel);
@@ -141,7 +159,9 @@ void g_isi_server_destroy(GIsiServer *server)
 	if (!server)
 		return;
 
-	g_source_remove(server->source);
+	g_isi_source_remove(server->context, server->source);
+	if (server->context)
+		g_main_context_unref(server->context);
 	free(server);
 }
 
@@ -41,6 +41,10 @@ typedef gboolean (*GIsiRequestFunc)(GIsiServer *server,
 
 GIsiServer *g_isi_server_create(GIsiModem *modem, uint8_t resource,
 				uint8_t major, uint8_t minor);
+GIsiServer *g_isi_server_create_with_context(GIsiModem *modem,
+						uint8_t resource,
+						uint8_t major, uint8_t minor,
+						GMainContext *context);
 
 uint8_t g_isi_server_resource(GIsiServer *server);
 
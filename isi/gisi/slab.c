@@ -0,0 +1,156 @@
+/*
+ * This file is GPLv2
+ * Copyright (C) 2010 Sebastian Reichel
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <glib.h>
+
+#include "slab.h"
+
+/* Free objects are linked through their first bytes */
+struct _GIsiSlabObject {
+	struct _GIsiSlabObject *next;
+};
+
+struct _GIsiSlab {
+	size_t size;
+	unsigned per_chunk;
+	GSList *chunks;
+	struct _GIsiSlabObject *free;
+
+	GIsiSlabStats stats;
+	GIsiSlabStatsFunc stats_func;
+	void *stats_data;
+};
+
+/**
+ * Create an allocator for objects of @a size bytes.
+ * @param size object size
+ * @param per_chunk objects allocated from the system at once
+ * @return slab, or NULL on error
+ */
+GIsiSlab *g_isi_slab_new(size_t size, unsigned per_chunk)
+{
+	GIsiSlab *slab = g_try_new0(GIsiSlab, 1);
+
+	if (!slab)
+		return NULL;
+
+	/* keep every object pointer aligned */
+	if (size < sizeof(struct _GIsiSlabObject))
+		size = sizeof(struct _GIsiSlabObject);
+	slab->size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	slab->per_chunk = per_chunk ? per_chunk : 1;
+	slab->stats.size = slab->size;
+	return slab;
+}
+
+/**
+ * Free all memory of @a slab, including objects still in use.
+ * @param slab slab or NULL
+ */
+void g_isi_slab_destroy(GIsiSlab *slab)
+{
+	GSList *l;
+
+	if (!slab)
+		return;
+
+	for (l = slab->chunks; l; l = l->next)
+		g_free(l->data);
+
+	g_slist_free(slab->chunks);
+	g_free(slab);
+}
+
+static gboolean g_isi_slab_grow(GIsiSlab *slab)
+{
+	uint8_t *chunk = g_try_malloc(slab->size * slab->per_chunk);
+	unsigned i;
+
+	if (!chunk)
+		return FALSE;
+
+	slab->chunks = g_slist_prepend(slab->chunks, chunk);
+
+	for (i = 0; i < slab->per_chunk; i++) {
+		struct _GIsiSlabObject *obj = (void *)(chunk + i * slab->size);
+
+		obj->next = slab->free;
+		slab->free = obj;
+	}
+
+	slab->stats.chunks++;
+	if (slab->stats_func)
+		slab->stats_func(slab, &slab->stats, slab->stats_data);
+
+	return TRUE;
+}
+
+/**
+ * Take an object from @a slab, its content is undefined.
+ * @param slab slab
+ * @return object, or NULL on error
+ */
+void *g_isi_slab_alloc(GIsiSlab *slab)
+{
+	struct _GIsiSlabObject *obj;
+
+	if (!slab->free && !g_isi_slab_grow(slab))
+		return NULL;
+
+	obj = slab->free;
+	slab->free = obj->next;
+
+	slab->stats.allocs++;
+	if (++slab->stats.in_use > slab->stats.peak)
+		slab->stats.peak = slab->stats.in_use;
+
+	return obj;
+}
+
+/**
+ * Return an object to @a slab.
+ * @param slab slab the object was taken from
+ * @param obj object or NULL
+ */
+void g_isi_slab_free(GIsiSlab *slab, void *obj)
+{
+	struct _GIsiSlabObject *o = obj;
+
+	if (!o)
+		return;
+
+	o->next = slab->free;
+	slab->free = o;
+	slab->stats.in_use--;
+}
+
+/**
+ * Get the allocation statistics of @a slab.
+ * @param slab slab
+ * @param stats filled in
+ */
+void g_isi_slab_get_stats(GIsiSlab *slab, GIsiSlabStats *stats)
+{
+	*stats = slab->stats;
+}
+
+/**
+ * Watch the growth of @a slab, a slab that keeps growing in a long
+ * running process points to a leak.
+ * @param slab slab
+ * @param func called after a new chunk was added, NULL to disable
+ * @param opaque passed to @a func
+ */
+void g_isi_slab_set_stats_func(GIsiSlab *slab, GIsiSlabStatsFunc func,
+				void *opaque)
+{
+	slab->stats_func = func;
+	slab->stats_data = opaque;
+}
@@ -0,0 +1,43 @@
+/*
+ * This file is GPLv2
+ * Copyright (C) 2010 Sebastian Reichel
+ */
+
+#ifndef __GISI_SLAB_H
+#define __GISI_SLAB_H
+
+#include <stddef.h>
+
+/*
+ * Allocator for many short lived objects of one size, e.g. callback
+ * contexts of requests. Freed objects are kept on a free list and
+ * memory is only returned to the system by g_isi_slab_destroy().
+ * Not thread safe.
+ */
+
+typedef struct _GIsiSlab GIsiSlab;
+
+struct _GIsiSlabStats {
+	size_t size;		/* object size */
+	unsigned chunks;
+	unsigned in_use;
+	unsigned peak;		/* highest in_use so far */
+	unsigned long allocs;	/* objects handed out in total */
+};
+typedef struct _GIsiSlabStats GIsiSlabStats;
+
+/* called whenever the slab grows by a chunk */
+typedef void (*GIsiSlabStatsFunc)(GIsiSlab *slab, const GIsiSlabStats *stats,
+					void *opaque);
+
+GIsiSlab *g_isi_slab_new(size_t size, unsigned per_chunk);
+void g_isi_slab_destroy(GIsiSlab *slab);
+
+void *g_isi_slab_alloc(GIsiSlab *slab);
+void g_isi_slab_free(GIsiSlab *slab, void *obj);
+
+void g_isi_slab_get_stats(GIsiSlab *slab, GIsiSlabStats *stats);
+void g_isi_slab_set_stats_func(GIsiSlab *slab, GIsiSlabStatsFunc func,
+				void *opaque);
+
+#endif /* __GISI_SLAB_H */
@@ -95,3 +95,96 @@ ssize_t phonet_read(GIOChannel *channel, void *restrict buf, size_t len,
 		*res = addr.spn_resource;
 	return ret;
 }
+
+static guint g_isi_source_attach(GMainContext *context, GSource *source,
+					GSourceFunc func, gpointer data)
+{
+	guint id;
+
+	g_source_set_callback(source, func, data, NULL);
+	id = g_source_attach(source, context);
+	g_source_unref(source);
+	return id;
+}
+
+/*
+ * Like g_io_add_watch() and friends, for sources attached to @context
+ * instead of the default main context. NULL is the default context.
+ */
+guint g_isi_watch_add(GMainContext *context, GIOChannel *channel,
+			GIOCondition cond, GIOFunc func, gpointer data)
+{
+	return g_isi_source_attach(context, g_io_create_watch(channel, cond),
+					(GSourceFunc)func, data);
+}
+
+guint g_isi_timeout_add(GMainContext *context, guint ms,
+			GSourceFunc func, gpointer data)
+{
+	return g_isi_source_attach(context, g_timeout_source_new(ms),
+					func, data);
+}
+
+guint g_isi_timeout_add_seconds(GMainContext *context, guint seconds,
+				GSourceFunc func, gpointer data)
+{
+	return g_isi_source_attach(context,
+					g_timeout_source_new_seconds(seconds),
+					func, data);
+}
+
+guint g_isi_idle_add(GMainContext *context, GSourceFunc func, gpointer data)
+{
+	return g_isi_source_attach(context, g_idle_source_new(), func, data);
+}
+
+static GSource *g_isi_source_hold(GMainContext *context, GSource *source,
+					GSourceFunc func, gpointer data)
+{
+	g_source_set_callback(source, func, data, NULL);
+	g_source_attach(source, context);
+	return source;
+}
+
+/*
+ * Like the above, but the source is returned with a reference held. A
+ * source dispatched by another thread must be removed this way: its ID
+ * may be finalized between the lookup and g_source_destroy(). Release
+ * it with g_isi_source_drop().
+ */
+GSource *g_isi_watch_source_add(GMainContext *context, GIOChannel *channel,
+				GIOCondition cond, GIOFunc func, gpointer data)
+{
+	return g_isi_source_hold(context, g_io_create_watch(channel, cond),
+					(GSourceFunc)func, data);
+}
+
+GSource *g_isi_timeout_source_add_seconds(GMainContext *context,
+						guint seconds,
+						GSourceFunc func,
+						gpointer data)
+{
+	return g_isi_source_hold(context,
+					g_timeout_source_new_seconds(seconds),
+					func, data);
+}
+
+/* Destroy and release a held source, from any thread */
+void g_isi_source_drop(GSource **source)
+{
+	if (*source == NULL)
+		return;
+
+	g_source_destroy(*source);
+	g_source_unref(*source);
+	*source = NULL;
+}
+
+/* Source IDs are only unique within their context */
+void g_isi_source_remove(GMainContext *context, guint id)
+{
+	GSource *source = g_main_context_find_source_by_id(context, id);
+
+	if (source)
+		g_source_destroy(source);
+}
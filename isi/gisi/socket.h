@@ -25,3 +25,22 @@ GIOChannel *phonet_new(GIsiModem *, uint8_t resource);
 size_t phonet_peek_length(GIOChannel *io);
 ssize_t phonet_read(GIOChannel *io, void *restrict buf, size_t len,
 			uint16_t *restrict obj, uint8_t *restrict res);
+
+/* event sources on an explicit main context, NULL for the default one */
+guint g_isi_watch_add(GMainContext *context, GIOChannel *channel,
+			GIOCondition cond, GIOFunc func, gpointer data);
+guint g_isi_timeout_add(GMainContext *context, guint ms,
+			GSourceFunc func, gpointer data);
+guint g_isi_timeout_add_seconds(GMainContext *context, guint seconds,
+				GSourceFunc func, gpointer data);
+guint g_isi_idle_add(GMainContext *context, GSourceFunc func, gpointer data);
+void g_isi_source_remove(GMainContext *context, guint id);
+
+/* held sources, for removal from another thread than their context's */
+GSource *g_isi_watch_source_add(GMainContext *context, GIOChannel *channel,
+				GIOCondition cond, GIOFunc func, gpointer data);
+GSource *g_isi_timeout_source_add_seconds(GMainContext *context,
+						guint seconds,
+						GSourceFunc func,
+						gpointer data);
+void g_isi_source_drop(GSource **source);
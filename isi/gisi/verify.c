@@ -103,6 +103,9 @@ static gboolean verify_cb(GIsiClient *client, const void *restrict data,
 		alive = TRUE;
 
 out:
+	if (!alive)
+		g_isi_response_uncacheable(client);
+
 	if (func)
 		func(client, alive, object, vd->data);
 
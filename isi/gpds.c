@@ -5,14 +5,545 @@
  */
 #include <errno.h>
 #include <string.h>
+#include <arpa/inet.h>
 
 #include "opcodes/gpds.h"
 #include "gpds.h"
 #include "modem.h"
 #include "debug.h"
 #include "gisi/iter.h"
+#include "gisi/socket.h"
+#include "descriptor.h"
 #include "helper.h"
 
+ISI_MSG_DEFINE(gpds_context_id_create_req, GPDS_CONTEXT_ID_CREATE_REQ, GPDS_CONTEXT_ID_CREATE_REQ_LAYOUT, GPDS_CONTEXT_ID_CREATE_REQ_LEN)
+ISI_MSG_DEFINE(gpds_ll_configure_req, GPDS_LL_CONFIGURE_REQ, GPDS_LL_CONFIGURE_REQ_LAYOUT, GPDS_LL_CONFIGURE_REQ_LEN)
+ISI_MSG_DEFINE(gpds_context_configure_req, GPDS_CONTEXT_CONFIGURE_REQ, GPDS_CONTEXT_CONFIGURE_REQ_LAYOUT, GPDS_CONTEXT_CONFIGURE_REQ_LEN)
+ISI_MSG_DEFINE(gpds_context_auth_req, GPDS_CONTEXT_AUTH_REQ, GPDS_CONTEXT_AUTH_REQ_LAYOUT, GPDS_CONTEXT_AUTH_REQ_LEN)
+ISI_MSG_DEFINE(gpds_context_activate_req, GPDS_CONTEXT_ACTIVATE_REQ, GPDS_CONTEXT_ACTIVATE_REQ_LAYOUT, GPDS_CONTEXT_ACTIVATE_REQ_LEN)
+ISI_MSG_DEFINE(gpds_context_deactivate_req, GPDS_CONTEXT_DEACTIVATE_REQ, GPDS_CONTEXT_REQ_LAYOUT, GPDS_CONTEXT_REQ_LEN)
+ISI_MSG_DEFINE(gpds_context_status_req, GPDS_CONTEXT_STATUS_REQ, GPDS_CONTEXT_REQ_LAYOUT, GPDS_CONTEXT_REQ_LEN)
+
+ISI_MSG_DEFINE(gpds_context_id_create_resp, GPDS_CONTEXT_ID_CREATE_RESP, GPDS_CONTEXT_RESP_LAYOUT, GPDS_CONTEXT_RESP_LEN)
+ISI_MSG_DEFINE(gpds_ll_configure_resp, GPDS_LL_CONFIGURE_RESP, GPDS_CONTEXT_RESP_LAYOUT, GPDS_CONTEXT_RESP_LEN)
+ISI_MSG_DEFINE(gpds_context_configure_resp, GPDS_CONTEXT_CONFIGURE_RESP, GPDS_CONTEXT_RESP_LAYOUT, GPDS_CONTEXT_RESP_LEN)
+ISI_MSG_DEFINE(gpds_context_auth_resp, GPDS_CONTEXT_AUTH_RESP, GPDS_CONTEXT_RESP_LAYOUT, GPDS_CONTEXT_RESP_LEN)
+ISI_MSG_DEFINE(gpds_context_activate_resp, GPDS_CONTEXT_ACTIVATE_RESP, GPDS_CONTEXT_RESP_LAYOUT, GPDS_CONTEXT_RESP_LEN)
+ISI_MSG_DEFINE(gpds_context_deactivate_resp, GPDS_CONTEXT_DEACTIVATE_RESP, GPDS_CONTEXT_RESP_LAYOUT, GPDS_CONTEXT_RESP_LEN)
+ISI_MSG_DEFINE(gpds_context_status_resp, GPDS_CONTEXT_STATUS_RESP, GPDS_CONTEXT_STATUS_LAYOUT, GPDS_CONTEXT_STATUS_LEN)
+ISI_MSG_DEFINE(gpds_context_status_ind, GPDS_CONTEXT_STATUS_IND, GPDS_CONTEXT_STATUS_LAYOUT, GPDS_CONTEXT_STATUS_LEN)
+
+ISI_SB_DEFINE(gpds_address_info, GPDS_ADDRESS_INFO_LAYOUT, GPDS_ADDRESS_INFO_LEN)
+
+/* string sub-block: id, length, string length, string, zero padded to 4 bytes */
+#define GPDS_STRING_SB_MAX(len) ((3 + (len) + 3) & ~3)
+
+static const uint8_t gpds_context_inds[] = {
+	GPDS_CONTEXT_ACTIVATE_IND,
+	GPDS_CONTEXT_ACTIVATE_FAIL_IND,
+	GPDS_CONTEXT_DEACTIVATE_IND,
+	GPDS_CONTEXT_STATUS_IND,
+};
+
+static size_t gpds_put_string_sb(uint8_t *buf, uint8_t id, const char *str) {
+	size_t len = strlen(str);
+	size_t sb_len = GPDS_STRING_SB_MAX(len);
+
+	memset(buf, 0, sb_len);
+	buf[0] = id;
+	buf[1] = sb_len;
+	buf[2] = len;
+	memcpy(buf + 3, str, len);
+	return sb_len;
+}
+
+static struct isi_gpds_context* gpds_find_context(struct isi_gpds *nd, guint8 cid) {
+	GSList *l;
+
+	for(l = nd->contexts; l; l = l->next) {
+		struct isi_gpds_context *ctx = l->data;
+		if(ctx->has_handle && ctx->handle == cid)
+			return ctx;
+	}
+
+	return NULL;
+}
+
+/* Milliseconds before retrying contexts whose pipe did not take all packets */
+#define GPDS_TX_RETRY		10
+/* Scheduler rounds per main loop iteration */
+#define GPDS_TX_ROUNDS		4
+
+struct gpds_packet {
+	size_t len;
+	uint8_t data[];
+};
+
+static void context_tx_flush(struct isi_gpds_context *ctx) {
+	struct isi_gpds *nd = ctx->gpds;
+	struct gpds_packet *pkt;
+
+	/* the only place queued packets are lost, partial sends are retried */
+	if(ctx->pep)
+		g_isi_pep_add_dropped(ctx->pep, g_queue_get_length(&ctx->txq));
+
+	while((pkt = g_queue_pop_head(&ctx->txq)))
+		g_free(pkt);
+
+	if(ctx->tx_pending)
+		nd->tx_active = g_list_remove(nd->tx_active, ctx);
+	ctx->tx_pending = FALSE;
+	ctx->tx_blocked = FALSE;
+}
+
+/* one batched write of up to weight * quantum packets from the queue head */
+static int context_tx_batch(struct isi_gpds_context *ctx) {
+	struct iovec iov[ISI_GPDS_WEIGHT_MAX * ISI_GPDS_TX_QUANTUM];
+	unsigned n = 0, quantum = ctx->weight * ISI_GPDS_TX_QUANTUM;
+	GList *l;
+	int ret, i;
+
+	for(l = ctx->txq.head; l && n < quantum; l = l->next, n++) {
+		struct gpds_packet *pkt = l->data;
+		iov[n].iov_base = pkt->data;
+		iov[n].iov_len = pkt->len;
+	}
+
+	ret = g_isi_pep_sendv_full(ctx->pep, iov, n, TRUE);
+	for(i = 0; i < ret; i++)
+		g_free(g_queue_pop_head(&ctx->txq));
+
+	ctx->tx_blocked = ret < (int)n;
+	return ret;
+}
+
+static gboolean gpds_tx_run(gpointer data) {
+	struct isi_gpds *nd = data;
+	gboolean ready = TRUE;
+	unsigned round;
+	GList *l, *next;
+
+	nd->tx_source = 0;
+
+	for(l = nd->tx_active; l; l = l->next)
+		((struct isi_gpds_context *)l->data)->tx_blocked = FALSE;
+
+	for(round = 0; round < GPDS_TX_ROUNDS && ready; round++) {
+		ready = FALSE;
+
+		for(l = nd->tx_active; l; l = next) {
+			struct isi_gpds_context *ctx = l->data;
+			next = l->next;
+
+			if(ctx->tx_blocked)
+				continue;
+
+			if(context_tx_batch(ctx) < 0) {
+				g_warning("dropping %u queued packets of context %u", g_queue_get_length(&ctx->txq), ctx->handle);
+				context_tx_flush(ctx);
+				continue;
+			}
+
+			if(g_queue_is_empty(&ctx->txq)) {
+				nd->tx_active = g_list_delete_link(nd->tx_active, l);
+				ctx->tx_pending = FALSE;
+			} else if(!ctx->tx_blocked)
+				ready = TRUE;
+		}
+	}
+
+	/* rotate, so no context always gets the first write of a run */
+	if(nd->tx_active && nd->tx_active->next) {
+		l = nd->tx_active;
+		nd->tx_active = g_list_remove_link(nd->tx_active, l);
+		nd->tx_active = g_list_concat(nd->tx_active, l);
+	}
+
+	if(nd->tx_active) {
+		if(ready)
+			nd->tx_source = g_isi_idle_add(nd->modem->context, gpds_tx_run, nd);
+		else
+			nd->tx_source = g_isi_timeout_add(nd->modem->context, GPDS_TX_RETRY, gpds_tx_run, nd);
+	}
+
+	return FALSE;
+}
+
+/* drop the modem side state and give back the data path */
+static void context_release(struct isi_gpds_context *ctx) {
+	if(ctx->cleanup)
+		g_isi_source_remove(ctx->gpds->modem->context, ctx->cleanup);
+	if(ctx->req)
+		g_isi_request_cancel(ctx->req);
+
+	context_tx_flush(ctx);
+
+	if(ctx->pool)
+		g_isi_pipe_pool_release(ctx->pool, ctx->pipe);
+	else {
+		if(ctx->pipe)
+			g_isi_pipe_destroy(ctx->pipe);
+		if(ctx->pep)
+			g_isi_pep_destroy(ctx->pep);
+	}
+
+	ctx->cleanup = 0;
+	ctx->req = NULL;
+	ctx->pipe = NULL;
+	ctx->pep = NULL;
+	ctx->pool = NULL;
+	ctx->pep_ready = FALSE;
+	ctx->pipe_ready = FALSE;
+	ctx->has_handle = FALSE;
+	ctx->state = ISI_GPDS_CONTEXT_INACTIVE;
+	memset(&ctx->settings, 0, sizeof(ctx->settings));
+}
+
+static void context_notify_activate(struct isi_gpds_context *ctx, gboolean error) {
+	struct isi_cb_data *cbd = ctx->activate;
+	isi_gpds_activate_cb cb;
+
+	if(!cbd)
+		return;
+
+	ctx->activate = NULL;
+	cb = cbd->callback;
+	cb(error, error ? NULL : &ctx->settings, cbd->data);
+	isi_cb_data_free(cbd);
+}
+
+static void context_notify_deactivate(struct isi_gpds_context *ctx, gboolean error) {
+	struct isi_cb_data *cbd = ctx->deactivate;
+	isi_gpds_deactivate_cb cb;
+
+	if(!cbd)
+		return;
+
+	ctx->deactivate = NULL;
+	cb = cbd->callback;
+	cb(error, cbd->data);
+	isi_cb_data_free(cbd);
+}
+
+static void context_notify_deactivated(struct isi_gpds_context *ctx) {
+	isi_gpds_deactivate_cb cb;
+
+	if(!ctx->deactivated_sub)
+		return;
+
+	cb = ctx->deactivated_sub->callback;
+	cb(FALSE, ctx->deactivated_sub->data);
+}
+
+/* the modem keeps a context id until it is deactivated, nobody waits for the answer */
+static void context_drop_handle(struct isi_gpds_context *ctx) {
+	uint8_t msg[gpds_context_deactivate_req_len];
+	struct gpds_context_deactivate_req req = { .cid = ctx->handle };
+
+	if(!ctx->has_handle)
+		return;
+
+	gpds_context_deactivate_req_pack(msg, &req);
+	g_isi_request_make(ctx->gpds->client, msg, sizeof(msg), 0, NULL, NULL);
+}
+
+/* failures may be detected inside pipe callbacks, so tear down from idle */
+static gboolean context_failed_cb(gpointer data) {
+	struct isi_gpds_context *ctx = data;
+	gboolean active = ctx->state == ISI_GPDS_CONTEXT_ACTIVE;
+
+	ctx->cleanup = 0;
+	context_drop_handle(ctx);
+	context_release(ctx);
+
+	if(ctx->activate)
+		context_notify_activate(ctx, TRUE);
+	else if(ctx->deactivate)
+		context_notify_deactivate(ctx, TRUE);
+	else if(active)
+		context_notify_deactivated(ctx);
+
+	return FALSE;
+}
+
+static void context_fail(struct isi_gpds_context *ctx) {
+	if(!ctx->cleanup)
+		ctx->cleanup = g_isi_idle_add(ctx->gpds->modem->context, context_failed_cb, ctx);
+}
+
+static gboolean context_send(struct isi_gpds_context *ctx, const void *msg, size_t len, GIsiResponseFunc func) {
+	ctx->req = g_isi_request_make(ctx->gpds->client, msg, len, GPDS_TIMEOUT, func, ctx);
+	if(!ctx->req) {
+		context_fail(ctx);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static gboolean context_activate_resp_cb(GIsiClient *client, const void *restrict data, size_t len, uint16_t object, void *opaque) {
+	struct isi_gpds_context *ctx = opaque;
+	struct gpds_context_activate_resp resp;
+
+	ctx->req = NULL;
+
+	/* addresses follow with GPDS_CONTEXT_ACTIVATE_IND */
+	if(!gpds_context_activate_resp_decode(data, len, &resp) || resp.status != GPDS_OK)
+		context_fail(ctx);
+
+	return TRUE;
+}
+
+static void context_send_activate(struct isi_gpds_context *ctx) {
+	uint8_t msg[gpds_context_activate_req_len];
+	struct gpds_context_activate_req req = { .cid = ctx->handle };
+
+	gpds_context_activate_req_pack(msg, &req);
+	context_send(ctx, msg, sizeof(msg), context_activate_resp_cb);
+}
+
+static gboolean context_auth_resp_cb(GIsiClient *client, const void *restrict data, size_t len, uint16_t object, void *opaque) {
+	struct isi_gpds_context *ctx = opaque;
+	struct gpds_context_auth_resp resp;
+
+	ctx->req = NULL;
+
+	if(!gpds_context_auth_resp_decode(data, len, &resp) || resp.status != GPDS_OK)
+		context_fail(ctx);
+	else
+		context_send_activate(ctx);
+
+	return TRUE;
+}
+
+static void context_send_auth(struct isi_gpds_context *ctx) {
+	uint8_t msg[gpds_context_auth_req_len + GPDS_STRING_SB_MAX(GPDS_MAX_USERNAME_LENGTH) + GPDS_STRING_SB_MAX(GPDS_MAX_PASSWORD_LENGTH)];
+	struct gpds_context_auth_req req = { .cid = ctx->handle };
+	size_t len;
+
+	len = gpds_context_auth_req_pack(msg, &req);
+	len += gpds_put_string_sb(msg + len, GPDS_USER_NAME_INFO, ctx->username);
+	len += gpds_put_string_sb(msg + len, GPDS_PASSWORD_INFO, ctx->password);
+
+	context_send(ctx, msg, len, context_auth_resp_cb);
+}
+
+static gboolean context_configure_resp_cb(GIsiClient *client, const void *restrict data, size_t len, uint16_t object, void *opaque) {
+	struct isi_gpds_context *ctx = opaque;
+	struct gpds_context_configure_resp resp;
+
+	ctx->req = NULL;
+
+	if(!gpds_context_configure_resp_decode(data, len, &resp) || resp.status != GPDS_OK)
+		context_fail(ctx);
+	else if(ctx->username[0] || ctx->password[0])
+		context_send_auth(ctx);
+	else
+		context_send_activate(ctx);
+
+	return TRUE;
+}
+
+static gboolean context_ll_configure_resp_cb(GIsiClient *client, const void *restrict data, size_t len, uint16_t object, void *opaque) {
+	struct isi_gpds_context *ctx = opaque;
+	struct gpds_ll_configure_resp resp;
+	uint8_t msg[gpds_context_configure_req_len + GPDS_STRING_SB_MAX(GPDS_MAX_APN_STRING_LENGTH)];
+	struct gpds_context_configure_req req;
+	size_t msg_len;
+
+	ctx->req = NULL;
+
+	if(!gpds_ll_configure_resp_decode(data, len, &resp) || resp.status != GPDS_OK) {
+		context_fail(ctx);
+		return TRUE;
+	}
+
+	req.cid = ctx->handle;
+	req.pdp_type = ctx->type;
+	req.primary = ctx->handle;
+
+	msg_len = gpds_context_configure_req_pack(msg, &req);
+	msg_len += gpds_put_string_sb(msg + msg_len, GPDS_APN_INFO, ctx->apn);
+
+	context_send(ctx, msg, msg_len, context_configure_resp_cb);
+	return TRUE;
+}
+
+/* runs once the context id, the pipe and the PEP are all there */
+static void context_configure_link(struct isi_gpds_context *ctx) {
+	uint8_t msg[gpds_ll_configure_req_len];
+	struct gpds_ll_configure_req req;
+
+	if(ctx->state != ISI_GPDS_CONTEXT_ACTIVATING || !ctx->has_handle || !ctx->pipe_ready || !ctx->pep_ready)
+		return;
+
+	req.cid = ctx->handle;
+	req.pipe = g_isi_pipe_get_handle(ctx->pipe);
+	gpds_ll_configure_req_pack(msg, &req);
+
+	context_send(ctx, msg, sizeof(msg), context_ll_configure_resp_cb);
+}
+
+static gboolean context_id_create_resp_cb(GIsiClient *client, const void *restrict data, size_t len, uint16_t object, void *opaque) {
+	struct isi_gpds_context *ctx = opaque;
+	struct gpds_context_id_create_resp resp;
+
+	ctx->req = NULL;
+
+	if(!gpds_context_id_create_resp_decode(data, len, &resp) || resp.status != GPDS_OK) {
+		context_fail(ctx);
+		return TRUE;
+	}
+
+	ctx->handle = resp.cid;
+	ctx->has_handle = TRUE;
+	context_configure_link(ctx);
+	return TRUE;
+}
+
+static void context_pep_ready_cb(GIsiPEP *pep, void *opaque) {
+	struct isi_gpds_context *ctx = opaque;
+
+	ctx->pep_ready = TRUE;
+	context_configure_link(ctx);
+}
+
+static void context_pipe_created_cb(GIsiPipe *pipe) {
+	struct isi_gpds_context *ctx = g_isi_pipe_get_userdata(pipe);
+
+	ctx->pipe_ready = TRUE;
+	context_configure_link(ctx);
+}
+
+static void context_pipe_error_cb(GIsiPipe *pipe) {
+	struct isi_gpds_context *ctx = g_isi_pipe_get_userdata(pipe);
+
+	g_warning("GPRS pipe failed: %s", strerror(-g_isi_pipe_get_error(pipe)));
+	context_fail(ctx);
+}
+
+static int context_open_pipe(struct isi_gpds_context *ctx) {
+	struct isi_modem *modem = ctx->gpds->modem;
+
+	if(modem->pipe_pool && !g_isi_pipe_pool_take(modem->pipe_pool, &ctx->pipe, &ctx->pep)) {
+		ctx->pool = modem->pipe_pool;
+		ctx->pep_ready = TRUE;
+		ctx->pipe_ready = TRUE;
+	} else {
+		ctx->pep = g_isi_pep_create_with_context(modem->idx, context_pep_ready_cb, ctx, modem->context);
+		if(!ctx->pep)
+			return -ENOMEM;
+
+		ctx->pipe = g_isi_pipe_create_with_context(modem->idx, context_pipe_created_cb, g_isi_pep_get_object(ctx->pep), PN_OBJ_PEP_GPRS, PN_PEP_TYPE_COMMON, PN_PEP_TYPE_GPRS, FALSE, modem->context);
+		if(!ctx->pipe)
+			return -ENOMEM;
+	}
+
+	g_isi_pipe_set_userdata(ctx->pipe, ctx);
+	g_isi_pipe_set_error_handler(ctx->pipe, context_pipe_error_cb);
+	return 0;
+}
+
+static void context_activate_ind(struct isi_gpds_context *ctx, const uint8_t *msg, size_t len) {
+	GIsiSubBlockIter iter;
+
+	if(ctx->state != ISI_GPDS_CONTEXT_ACTIVATING)
+		return;
+
+	for(g_isi_sb_iter_init(&iter, msg, len, 3); g_isi_sb_iter_is_valid(&iter); g_isi_sb_iter_next(&iter)) {
+		struct gpds_address_info info;
+		void *addr;
+		char *dst;
+
+		switch(g_isi_sb_iter_get_id(&iter)) {
+			case GPDS_PDP_ADDRESS_INFO:
+				dst = ctx->settings.ip;
+				break;
+			case GPDS_PDNS_ADDRESS_INFO:
+				dst = ctx->settings.primary_dns;
+				break;
+			case GPDS_SDNS_ADDRESS_INFO:
+				dst = ctx->settings.secondary_dns;
+				break;
+			default:
+				continue;
+		}
+
+		if(!gpds_address_info_decode(&iter, &info) || info.addr_len != 4 || !g_isi_sb_iter_get_data(&iter, &addr, 4))
+			continue;
+
+		inet_ntop(AF_INET, addr, dst, INET_ADDRSTRLEN);
+	}
+
+	if(!g_isi_pep_get_ifname(ctx->pep, ctx->settings.ifname) || g_isi_pipe_start(ctx->pipe) < 0) {
+		context_fail(ctx);
+		return;
+	}
+
+	ctx->state = ISI_GPDS_CONTEXT_ACTIVE;
+	context_notify_activate(ctx, FALSE);
+}
+
+static void context_deactivate_ind(struct isi_gpds_context *ctx) {
+	switch(ctx->state) {
+		case ISI_GPDS_CONTEXT_ACTIVATING:
+			context_fail(ctx);
+			break;
+		case ISI_GPDS_CONTEXT_ACTIVE:
+			context_release(ctx);
+			context_notify_deactivated(ctx);
+			break;
+		default:
+			/* our own deactivation, finished by the response */
+			break;
+	}
+}
+
+static void context_update_counters(struct isi_gpds_context *ctx, guint32 tx_bytes, guint32 rx_bytes) {
+	struct isi_gpds_counters counters;
+	isi_gpds_counters_cb cb;
+
+	ctx->counters.tx_bytes = tx_bytes;
+	ctx->counters.rx_bytes = rx_bytes;
+
+	if(!ctx->counters_sub)
+		return;
+
+	counters = ctx->counters;
+	cb = ctx->counters_sub->callback;
+	cb(FALSE, &counters, ctx->counters_sub->data);
+}
+
+static void gpds_context_ind_cb(GIsiClient *client, const void *restrict data, size_t len, uint16_t object, void *opaque) {
+	struct isi_gpds *nd = opaque;
+	struct isi_gpds_context *ctx;
+	struct gpds_context_status_ind ind;
+	const uint8_t *msg = data;
+
+	if(!msg || len < 2)
+		return;
+
+	ctx = gpds_find_context(nd, msg[1]);
+	if(!ctx)
+		return;
+
+	switch(msg[0]) {
+		case GPDS_CONTEXT_ACTIVATE_IND:
+			context_activate_ind(ctx, msg, len);
+			break;
+		case GPDS_CONTEXT_ACTIVATE_FAIL_IND:
+			if(ctx->state == ISI_GPDS_CONTEXT_ACTIVATING)
+				context_fail(ctx);
+			break;
+		case GPDS_CONTEXT_DEACTIVATE_IND:
+			context_deactivate_ind(ctx);
+			break;
+		case GPDS_CONTEXT_STATUS_IND:
+			if(gpds_context_status_ind_decode(msg, len, &ind))
+				context_update_counters(ctx, ind.tx_bytes, ind.rx_bytes);
+			break;
+	}
+}
+
 static void gpds_reachable_cb(GIsiClient *client, gboolean alive, uint16_t object, void *opaque) {
 	struct isi_cb_data *cbd = opaque;
 	isi_subsystem_reachable_cb cb = cbd->callback;
@@ -37,20 +568,28 @@ static void gpds_reachable_cb(GIsiClient *client, gboolean alive, uint16_t objec
 struct isi_gpds* isi_gpds_create(struct isi_modem *modem, isi_subsystem_reachable_cb cb, void *data) {
 	struct isi_gpds *nd = calloc(sizeof(struct isi_gpds), 1);
 	struct isi_cb_data *cbd = isi_cb_data_new(nd, cb, data);
+	unsigned i;
 
 	if(!nd || !cbd || !modem->idx)
 		goto error;
 
-	nd->client = g_isi_client_create(modem->idx, PN_GPDS);
+	nd->modem = modem;
+	nd->client = isi_modem_client_create(modem, PN_GPDS);
 	if(!nd->client)
 		goto error;
 
+	for(i = 0; i < G_N_ELEMENTS(gpds_context_inds); i++)
+		if(g_isi_subscribe(nd->client, gpds_context_inds[i], gpds_context_ind_cb, nd))
+			goto error;
+
 	g_isi_verify(nd->client, gpds_reachable_cb, cbd);
 
 	return nd;
 
 	error:
 		cb(TRUE, data);
+		if(nd && nd->client)
+			g_isi_client_destroy(nd->client);
 		if(nd)
 			free(nd);
 		isi_cb_data_free(cbd);
@@ -61,6 +600,263 @@ struct isi_gpds* isi_gpds_create(struct isi_modem *modem, isi_subsystem_reachabl
 void isi_gpds_destroy(struct isi_gpds *nd) {
 	if(!nd)
 		return;
+	while(nd->contexts)
+		isi_gpds_context_destroy(nd->contexts->data);
+	if(nd->tx_source)
+		g_isi_source_remove(nd->modem->context, nd->tx_source);
 	g_isi_client_destroy(nd->client);
 	free(nd);
 }
+
+struct isi_gpds_context* isi_gpds_context_create(struct isi_gpds *nd, const char *apn, const char *username, const char *password) {
+	struct isi_gpds_context *ctx;
+
+	if(!apn || strlen(apn) > GPDS_MAX_APN_STRING_LENGTH)
+		return NULL;
+	if(username && strlen(username) > GPDS_MAX_USERNAME_LENGTH)
+		return NULL;
+	if(password && strlen(password) > GPDS_MAX_PASSWORD_LENGTH)
+		return NULL;
+
+	if(g_slist_length(nd->contexts) >= GPDS_MAX_CONTEXT_COUNT)
+		return NULL;
+
+	ctx = calloc(sizeof(struct isi_gpds_context), 1);
+	if(!ctx)
+		return NULL;
+
+	ctx->gpds = nd;
+	ctx->type = GPDS_PDP_TYPE_IPV4;
+	ctx->weight = 1;
+	g_queue_init(&ctx->txq);
+	strcpy(ctx->apn, apn);
+	if(username)
+		strcpy(ctx->username, username);
+	if(password)
+		strcpy(ctx->password, password);
+
+	nd->contexts = g_slist_prepend(nd->contexts, ctx);
+	return ctx;
+}
+
+void isi_gpds_context_destroy(struct isi_gpds_context *ctx) {
+	if(!ctx)
+		return;
+
+	/* the modem would keep the context up for a pipe that is gone */
+	context_drop_handle(ctx);
+
+	if(ctx->status_req)
+		g_isi_request_cancel(ctx->status_req);
+	context_release(ctx);
+
+	ctx->gpds->contexts = g_slist_remove(ctx->gpds->contexts, ctx);
+	isi_cb_data_free(ctx->activate);
+	isi_cb_data_free(ctx->deactivate);
+	isi_cb_data_free(ctx->counters_req);
+	isi_cb_data_free(ctx->counters_sub);
+	isi_cb_data_free(ctx->deactivated_sub);
+	free(ctx);
+}
+
+enum isi_gpds_context_state isi_gpds_context_get_state(struct isi_gpds_context *ctx) {
+	return ctx->state;
+}
+
+GIsiPEP* isi_gpds_context_get_pep(struct isi_gpds_context *ctx) {
+	return ctx->state == ISI_GPDS_CONTEXT_ACTIVE ? ctx->pep : NULL;
+}
+
+void isi_gpds_context_activate(struct isi_gpds_context *ctx, isi_gpds_activate_cb cb, void *data) {
+	uint8_t msg[gpds_context_id_create_req_len];
+	struct gpds_context_id_create_req req;
+	struct isi_cb_data *cbd;
+
+	if(ctx->state != ISI_GPDS_CONTEXT_INACTIVE || ctx->cleanup) {
+		cb(TRUE, NULL, data);
+		return;
+	}
+
+	cbd = isi_cb_data_new(ctx, cb, data);
+	if(!cbd)
+		goto error;
+
+	/* the pipe and the context id are set up in parallel */
+	if(context_open_pipe(ctx))
+		goto error;
+
+	gpds_context_id_create_req_pack(msg, &req);
+	ctx->req = g_isi_request_make(ctx->gpds->client, msg, sizeof(msg), GPDS_TIMEOUT, context_id_create_resp_cb, ctx);
+	if(!ctx->req)
+		goto error;
+
+	ctx->state = ISI_GPDS_CONTEXT_ACTIVATING;
+	ctx->activate = cbd;
+	return;
+
+	error:
+		context_release(ctx);
+		isi_cb_data_free(cbd);
+		cb(TRUE, NULL, data);
+}
+
+static gboolean context_deactivate_resp_cb(GIsiClient *client, const void *restrict data, size_t len, uint16_t object, void *opaque) {
+	struct isi_gpds_context *ctx = opaque;
+	struct gpds_context_deactivate_resp resp;
+	gboolean ok = gpds_context_deactivate_resp_decode(data, len, &resp) && resp.status == GPDS_OK;
+
+	ctx->req = NULL;
+
+	/* the local side is torn down either way */
+	context_release(ctx);
+	context_notify_deactivate(ctx, !ok);
+	return TRUE;
+}
+
+void isi_gpds_context_deactivate(struct isi_gpds_context *ctx, isi_gpds_deactivate_cb cb, void *data) {
+	uint8_t msg[gpds_context_deactivate_req_len];
+	struct gpds_context_deactivate_req req = { .cid = ctx->handle };
+	struct isi_cb_data *cbd;
+
+	if(ctx->state == ISI_GPDS_CONTEXT_INACTIVE && !ctx->cleanup) {
+		cb(FALSE, data);
+		return;
+	}
+
+	if(ctx->state != ISI_GPDS_CONTEXT_ACTIVE || ctx->cleanup) {
+		cb(TRUE, data);
+		return;
+	}
+
+	cbd = isi_cb_data_new(ctx, cb, data);
+	if(!cbd) {
+		cb(TRUE, data);
+		return;
+	}
+
+	ctx->state = ISI_GPDS_CONTEXT_DEACTIVATING;
+	ctx->deactivate = cbd;
+
+	gpds_context_deactivate_req_pack(msg, &req);
+	context_send(ctx, msg, sizeof(msg), context_deactivate_resp_cb);
+}
+
+int isi_gpds_context_send(struct isi_gpds_context *ctx, const void *data, size_t len) {
+	struct isi_gpds *nd = ctx->gpds;
+	struct gpds_packet *pkt;
+
+	if(ctx->state != ISI_GPDS_CONTEXT_ACTIVE)
+		return -ENOTCONN;
+	if(len > G_ISI_PEP_MTU)
+		return -EMSGSIZE;
+	if(g_queue_get_length(&ctx->txq) >= ISI_GPDS_TX_QUEUE_MAX)
+		return -ENOBUFS;
+
+	pkt = g_try_malloc(sizeof(*pkt) + len);
+	if(!pkt)
+		return -ENOMEM;
+
+	pkt->len = len;
+	memcpy(pkt->data, data, len);
+	g_queue_push_tail(&ctx->txq, pkt);
+
+	if(!ctx->tx_pending) {
+		ctx->tx_pending = TRUE;
+		nd->tx_active = g_list_append(nd->tx_active, ctx);
+	}
+
+	if(!nd->tx_source)
+		nd->tx_source = g_isi_idle_add(nd->modem->context, gpds_tx_run, nd);
+	return 0;
+}
+
+unsigned isi_gpds_context_get_queue_depth(struct isi_gpds_context *ctx) {
+	return g_queue_get_length(&ctx->txq);
+}
+
+void isi_gpds_context_set_weight(struct isi_gpds_context *ctx, unsigned weight) {
+	ctx->weight = CLAMP(weight, 1, ISI_GPDS_WEIGHT_MAX);
+}
+
+void isi_gpds_context_subscribe_deactivated(struct isi_gpds_context *ctx, isi_gpds_deactivate_cb cb, void *data) {
+	struct isi_cb_data *cbd = isi_cb_data_new(ctx, cb, data);
+	if(!cbd) {
+		cb(TRUE, data);
+		return;
+	}
+
+	isi_cb_data_free(ctx->deactivated_sub);
+	ctx->deactivated_sub = cbd;
+}
+
+void isi_gpds_context_unsubscribe_deactivated(struct isi_gpds_context *ctx) {
+	isi_cb_data_free(ctx->deactivated_sub);
+	ctx->deactivated_sub = NULL;
+}
+
+static gboolean context_status_resp_cb(GIsiClient *client, const void *restrict data, size_t len, uint16_t object, void *opaque) {
+	struct isi_gpds_context *ctx = opaque;
+	struct gpds_context_status_resp resp;
+	struct isi_gpds_counters counters;
+	struct isi_cb_data *cbd = ctx->counters_req;
+	isi_gpds_counters_cb cb = cbd->callback;
+	void *user_data = cbd->data;
+
+	ctx->status_req = NULL;
+	ctx->counters_req = NULL;
+	isi_cb_data_free(cbd);
+
+	if(!gpds_context_status_resp_decode(data, len, &resp)) {
+		cb(TRUE, NULL, user_data);
+		return TRUE;
+	}
+
+	counters.tx_bytes = resp.tx_bytes;
+	counters.rx_bytes = resp.rx_bytes;
+	context_update_counters(ctx, resp.tx_bytes, resp.rx_bytes);
+	cb(FALSE, &counters, user_data);
+	return TRUE;
+}
+
+void isi_gpds_context_request_counters(struct isi_gpds_context *ctx, isi_gpds_counters_cb cb, void *data) {
+	uint8_t msg[gpds_context_status_req_len];
+	struct gpds_context_status_req req = { .cid = ctx->handle };
+	struct isi_cb_data *cbd;
+
+	if(ctx->state != ISI_GPDS_CONTEXT_ACTIVE || ctx->status_req) {
+		cb(TRUE, NULL, data);
+		return;
+	}
+
+	cbd = isi_cb_data_new(ctx, cb, data);
+	if(!cbd)
+		goto error;
+
+	gpds_context_status_req_pack(msg, &req);
+	ctx->status_req = g_isi_request_make(ctx->gpds->client, msg, sizeof(msg), GPDS_TIMEOUT, context_status_resp_cb, ctx);
+	if(!ctx->status_req)
+		goto error;
+
+	ctx->counters_req = cbd;
+	return;
+
+	error:
+		isi_cb_data_free(cbd);
+		cb(TRUE, NULL, data);
+}
+
+void isi_gpds_context_subscribe_counters(struct isi_gpds_context *ctx, isi_gpds_counters_cb cb, void *data) {
+	struct isi_cb_data *cbd = isi_cb_data_new(ctx, cb, data);
+	if(!cbd) {
+		cb(TRUE, NULL, data);
+		return;
+	}
+
+	isi_cb_data_free(ctx->counters_sub);
+	ctx->counters_sub = cbd;
+}
+
+void isi_gpds_context_unsubscribe_counters(struct isi_gpds_context *ctx) {
+	isi_cb_data_free(ctx->counters_sub);
+	ctx->counters_sub = NULL;
+}
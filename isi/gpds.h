@@ -1,17 +1,125 @@
 #include <glib.h>
 #include <stdint.h>
+#include <net/if.h>
+#include <netinet/in.h>
 #include "opcodes/gpds.h"
 #include "gisi/client.h"
+#include "gisi/pep.h"
+#include "gisi/pipe.h"
 #include "modem.h"
 
 #ifndef _ISI_GPDS_H
 #define _ISI_GPDS_H
 
+enum isi_gpds_context_state {
+	ISI_GPDS_CONTEXT_INACTIVE,
+	ISI_GPDS_CONTEXT_ACTIVATING,
+	ISI_GPDS_CONTEXT_ACTIVE,
+	ISI_GPDS_CONTEXT_DEACTIVATING
+};
+
+struct isi_gpds_context_settings {
+	char ifname[IF_NAMESIZE];
+	char ip[INET_ADDRSTRLEN];
+	char primary_dns[INET_ADDRSTRLEN];
+	char secondary_dns[INET_ADDRSTRLEN];
+};
+
+struct isi_gpds_counters {
+	guint32 tx_bytes;
+	guint32 rx_bytes;
+};
+
+/* transmit queues, packets are sent in rounds of weight * ISI_GPDS_TX_QUANTUM
+ * packets per context with one batched write each */
+#define ISI_GPDS_TX_QUEUE_MAX	256
+#define ISI_GPDS_TX_QUANTUM	16
+#define ISI_GPDS_WEIGHT_MAX	16
+
 struct isi_gpds {
 	GIsiClient *client;
+	struct isi_modem *modem;
+	GSList *contexts;
+
+	/* contexts with queued packets, in round-robin order */
+	GList *tx_active;
+	guint tx_source;
 };
 
+struct isi_gpds_context {
+	struct isi_gpds *gpds;
+	char apn[GPDS_MAX_APN_STRING_LENGTH + 1];
+	char username[GPDS_MAX_USERNAME_LENGTH + 1];
+	char password[GPDS_MAX_PASSWORD_LENGTH + 1];
+	guint8 type;
+	enum isi_gpds_context_state state;
+
+	/* modem side context id, valid while has_handle is set */
+	guint8 handle;
+	gboolean has_handle;
+
+	/* data path, taken from the modem pipe pool if there is one */
+	GIsiPEP *pep;
+	GIsiPipe *pipe;
+	GIsiPipePool *pool;
+	gboolean pep_ready;
+	gboolean pipe_ready;
+	guint cleanup;
+
+	GIsiRequest *req;
+	GIsiRequest *status_req;
+	struct isi_gpds_context_settings settings;
+	struct isi_gpds_counters counters;
+
+	GQueue txq;
+	unsigned weight;
+	gboolean tx_pending;
+	gboolean tx_blocked;
+
+	struct isi_cb_data *activate;
+	struct isi_cb_data *deactivate;
+	struct isi_cb_data *counters_req;
+	struct isi_cb_data *counters_sub;
+	struct isi_cb_data *deactivated_sub;
+};
+
+/* callbacks */
+typedef void (*isi_gpds_activate_cb)(gboolean error, struct isi_gpds_context_settings *settings, void *data);
+typedef void (*isi_gpds_deactivate_cb)(gboolean error, void *data);
+typedef void (*isi_gpds_counters_cb)(gboolean error, struct isi_gpds_counters *counters, void *data);
+
+/* subsystem */
 struct isi_gpds* isi_gpds_create(struct isi_modem *modem, isi_subsystem_reachable_cb cb, void *data);
 void isi_gpds_destroy(struct isi_gpds *nd);
 
+/* contexts, username and password may be NULL */
+struct isi_gpds_context* isi_gpds_context_create(struct isi_gpds *nd, const char *apn, const char *username, const char *password);
+void isi_gpds_context_destroy(struct isi_gpds_context *ctx);
+enum isi_gpds_context_state isi_gpds_context_get_state(struct isi_gpds_context *ctx);
+
+/* the host end point of an active context, NULL while inactive */
+GIsiPEP* isi_gpds_context_get_pep(struct isi_gpds_context *ctx);
+
+/* activation, the callback gets the interface and addresses of the context */
+void isi_gpds_context_activate(struct isi_gpds_context *ctx, isi_gpds_activate_cb cb, void *data);
+void isi_gpds_context_deactivate(struct isi_gpds_context *ctx, isi_gpds_deactivate_cb cb, void *data);
+
+/* deactivation by the network, the callback is called without error */
+void isi_gpds_context_subscribe_deactivated(struct isi_gpds_context *ctx, isi_gpds_deactivate_cb cb, void *data);
+void isi_gpds_context_unsubscribe_deactivated(struct isi_gpds_context *ctx);
+
+/* transmit, packets are copied and queued until the scheduler writes them.
+ * Returns 0, -ENOTCONN if the context is not active or -ENOBUFS if the
+ * queue is full. */
+int isi_gpds_context_send(struct isi_gpds_context *ctx, const void *data, size_t len);
+unsigned isi_gpds_context_get_queue_depth(struct isi_gpds_context *ctx);
+
+/* share of the transmit rounds relative to other contexts, 1 to ISI_GPDS_WEIGHT_MAX */
+void isi_gpds_context_set_weight(struct isi_gpds_context *ctx, unsigned weight);
+
+/* byte counters of the context as reported by the modem */
+void isi_gpds_context_request_counters(struct isi_gpds_context *ctx, isi_gpds_counters_cb cb, void *data);
+void isi_gpds_context_subscribe_counters(struct isi_gpds_context *ctx, isi_gpds_counters_cb cb, void *data);
+void isi_gpds_context_unsubscribe_counters(struct isi_gpds_context *ctx);
+
 #endif
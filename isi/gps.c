@@ -14,6 +14,7 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 #include <errno.h>
+#include <math.h>
 #include <string.h>
 
 #include "opcodes/gps.h"
@@ -21,14 +22,317 @@
 #include "modem.h"
 #include "debug.h"
 #include "gisi/iter.h"
+#include "descriptor.h"
 #include "helper.h"
 
+/* centimeter per second to kilometer per hour */
+#define CMS_TO_KMH 0.036
+
+/* full circle in 2^32 steps */
+#define GPS_ANGLE_SCALE (360.0 / 4294967296.0)
+
+ISI_MSG_DEFINE(gps_power_req, GPS_POWER_REQ, GPS_POWER_REQ_LAYOUT, GPS_POWER_REQ_LEN)
+ISI_MSG_DEFINE(gps_power_resp, GPS_POWER_RESP, GPS_POWER_RESP_LAYOUT, GPS_POWER_RESP_LEN)
+ISI_MSG_DEFINE(gps_status_ind, GPS_STATUS_IND, GPS_STATUS_IND_LAYOUT, GPS_STATUS_IND_LEN)
+ISI_MSG_DEFINE(gps_data_ind, GPS_DATA_IND, GPS_DATA_IND_LAYOUT, GPS_DATA_IND_LEN)
+
+ISI_SB_DEFINE(gps_data_position, GPS_DATA_POSITION_LAYOUT, GPS_DATA_POSITION_LEN)
+ISI_SB_DEFINE(gps_time_date, GPS_TIME_DATE_LAYOUT, GPS_TIME_DATE_LEN)
+ISI_SB_DEFINE(gps_movement, GPS_MOVEMENT_LAYOUT, GPS_MOVEMENT_LEN)
+ISI_SB_DEFINE(gps_satellite_info, GPS_SATELLITE_INFO_LAYOUT, GPS_SATELLITE_INFO_LEN)
+ISI_SB_DEFINE(gps_cell_info_gsm, GPS_CELL_INFO_GSM_LAYOUT, GPS_CELL_INFO_GSM_LEN)
+ISI_SB_DEFINE(gps_cell_info_wcdma, GPS_CELL_INFO_WCDMA_LAYOUT, GPS_CELL_INFO_WCDMA_LEN)
+
+/* satellite entries are packed without sub-block header */
+enum { gps_satellite_len = GPS_SATELLITE_LEN };
+ISI_LAYOUT_STRUCT(gps_satellite, GPS_SATELLITE_LAYOUT);
+GPS_SATELLITE_LAYOUT(ISI_FIELD_CHECK, ISI_CONST_CHECK, gps_satellite)
+
+static inline void gps_satellite_decode(const uint8_t *p, struct gps_satellite *out) {
+	GPS_SATELLITE_LAYOUT(ISI_FIELD_LOAD, ISI_CONST_SKIP, gps_satellite)
+}
+
+static inline double gps_angle(uint32_t raw) {
+	double angle = raw * GPS_ANGLE_SCALE;
+	return angle > 180.0 ? angle - 360.0 : angle;
+}
+
+static void gps_decode_position(const GIsiSubBlockIter *iter, struct isi_gps_data *fix) {
+	struct gps_data_position pos;
+
+	if(!gps_data_position_decode(iter, &pos))
+		return;
+
+	fix->latitude = gps_angle(pos.latitude);
+	fix->longitude = gps_angle(pos.longitude);
+	fix->eph = pos.eph / 100.0;
+	fix->altitude = ((int)pos.altitude - (int)pos.altitude_correction) / 2;
+	fix->epv = pos.epv / 2;
+	fix->present |= ISI_GPS_HAS_POSITION;
+}
+
+static void gps_decode_time(const GIsiSubBlockIter *iter, struct isi_gps_data *fix) {
+	struct gps_time_date td;
+
+	if(!gps_time_date_decode(iter, &td))
+		return;
+
+	fix->year = td.year;
+	fix->month = td.month;
+	fix->day = td.day;
+	fix->hour = td.hour;
+	fix->minute = td.minute;
+	fix->second = td.msec / 1000.0;
+	fix->present |= ISI_GPS_HAS_TIME;
+}
+
+static void gps_decode_movement(const GIsiSubBlockIter *iter, struct isi_gps_data *fix) {
+	struct gps_movement mv;
+
+	if(!gps_movement_decode(iter, &mv))
+		return;
+
+	fix->course = mv.course / 100.0;
+	fix->epd = mv.epd / 100.0;
+	fix->speed = mv.speed * CMS_TO_KMH;
+	fix->eps = mv.eps * CMS_TO_KMH;
+	fix->climb = (int16_t)mv.climb * CMS_TO_KMH;
+	fix->epc = mv.epc * CMS_TO_KMH;
+	fix->present |= ISI_GPS_HAS_MOVEMENT;
+}
+
+static void gps_decode_satellites(const GIsiSubBlockIter *iter, struct isi_gps_data *fix) {
+	struct isi_gps_satellites *sats = &fix->satellites;
+	struct gps_satellite_info info;
+	struct gps_satellite sat;
+	const void *raw;
+	unsigned i, count;
+
+	if(!gps_satellite_info_decode(iter, &info))
+		return;
+
+	/* entries beyond the sub-block or the fix are dropped */
+	count = MIN(info.count, ISI_GPS_MAX_SATELLITES);
+	count = MIN(count, (g_isi_sb_iter_get_len(iter) - GPS_SATELLITE_INFO_LEN) / GPS_SATELLITE_LEN);
+
+	if(count && !g_isi_sb_iter_get_struct(iter, &raw, count * GPS_SATELLITE_LEN, GPS_SATELLITE_INFO_LEN))
+		return;
+
+	for(i = 0; i < count; i++) {
+		gps_satellite_decode((const uint8_t *)raw + i * GPS_SATELLITE_LEN, &sat);
+		sats->prn[i] = sat.prn;
+		sats->used[i] = sat.used != 0;
+		sats->snr[i] = sat.strength / 100.0f;
+		sats->elevation[i] = sat.elevation / 100.0f;
+		sats->azimuth[i] = sat.azimuth / 100.0f;
+	}
+
+	sats->count = count;
+	fix->present |= ISI_GPS_HAS_SATELLITES;
+}
+
+void isi_gps_satellites_snr_stats(const struct isi_gps_satellites *sats, struct isi_gps_snr_stats *stats) {
+	float sum = 0, used_sum = 0, min = G_MAXFLOAT, max = 0;
+	unsigned i, used = 0, n = MIN(sats->count, ISI_GPS_MAX_SATELLITES);
+
+	/* branch free, so the loop vectorizes */
+	for(i = 0; i < n; i++) {
+		float snr = sats->snr[i];
+		sum += snr;
+		used_sum += snr * sats->used[i];
+		used += sats->used[i];
+		min = snr < min ? snr : min;
+		max = snr > max ? snr : max;
+	}
+
+	stats->visible = n;
+	stats->used = used;
+	stats->min = n ? min : 0;
+	stats->max = max;
+	stats->mean = n ? sum / n : 0;
+	stats->used_mean = used ? used_sum / used : 0;
+}
+
+/* invert a symmetric positive definite 4x4 matrix in place */
+static gboolean gps_invert4(double m[4][4]) {
+	double inv[4][4] = { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 }, { 0, 0, 0, 1 } };
+	int i, j, k;
+
+	for(i = 0; i < 4; i++) {
+		double pivot = m[i][i];
+
+		if(fabs(pivot) < 1e-12)
+			return FALSE;
+
+		for(j = 0; j < 4; j++) {
+			m[i][j] /= pivot;
+			inv[i][j] /= pivot;
+		}
+
+		for(k = 0; k < 4; k++) {
+			double f = m[k][i];
+
+			if(k == i)
+				continue;
+
+			for(j = 0; j < 4; j++) {
+				m[k][j] -= f * m[i][j];
+				inv[k][j] -= f * inv[i][j];
+			}
+		}
+	}
+
+	memcpy(m, inv, sizeof(inv));
+	return TRUE;
+}
+
+gboolean isi_gps_satellites_dop(const struct isi_gps_satellites *sats, struct isi_gps_dop *dop) {
+	float x[ISI_GPS_MAX_SATELLITES], y[ISI_GPS_MAX_SATELLITES], z[ISI_GPS_MAX_SATELLITES], w[ISI_GPS_MAX_SATELLITES];
+	double sxx = 0, sxy = 0, sxz = 0, sx = 0, syy = 0, syz = 0, sy = 0, szz = 0, sz = 0, sw = 0;
+	double q[4][4];
+	unsigned i, n = MIN(sats->count, ISI_GPS_MAX_SATELLITES);
+
+	/* line of sight unit vectors, unused satellites get weight 0 */
+	for(i = 0; i < n; i++) {
+		float el = sats->elevation[i] * (float) (G_PI / 180.0);
+		float az = sats->azimuth[i] * (float) (G_PI / 180.0);
+		w[i] = sats->used[i];
+		x[i] = cosf(el) * sinf(az) * w[i];
+		y[i] = cosf(el) * cosf(az) * w[i];
+		z[i] = sinf(el) * w[i];
+	}
+
+	for(i = 0; i < n; i++) {
+		sxx += x[i] * x[i];
+		sxy += x[i] * y[i];
+		sxz += x[i] * z[i];
+		sx += x[i];
+		syy += y[i] * y[i];
+		syz += y[i] * z[i];
+		sy += y[i];
+		szz += z[i] * z[i];
+		sz += z[i];
+		sw += w[i];
+	}
+
+	if(sw < 4)
+		return FALSE;
+
+	q[0][0] = sxx; q[0][1] = sxy; q[0][2] = sxz; q[0][3] = sx;
+	q[1][0] = sxy; q[1][1] = syy; q[1][2] = syz; q[1][3] = sy;
+	q[2][0] = sxz; q[2][1] = syz; q[2][2] = szz; q[2][3] = sz;
+	q[3][0] = sx;  q[3][1] = sy;  q[3][2] = sz;  q[3][3] = sw;
+
+	if(!gps_invert4(q))
+		return FALSE;
+
+	dop->hdop = sqrt(q[0][0] + q[1][1]);
+	dop->vdop = sqrt(q[2][2]);
+	dop->pdop = sqrt(q[0][0] + q[1][1] + q[2][2]);
+	dop->tdop = sqrt(q[3][3]);
+	dop->gdop = sqrt(q[0][0] + q[1][1] + q[2][2] + q[3][3]);
+	return TRUE;
+}
+
+static void gps_decode_cell_gsm(const GIsiSubBlockIter *iter, struct isi_gps_data *fix) {
+	struct gps_cell_info_gsm cell;
+
+	if(!gps_cell_info_gsm_decode(iter, &cell))
+		return;
+
+	fix->mcc = cell.mcc;
+	fix->mnc = cell.mnc;
+	fix->lac = cell.lac;
+	fix->cid = cell.cid;
+	fix->present |= ISI_GPS_HAS_CELL_GSM;
+}
+
+static void gps_decode_cell_wcdma(const GIsiSubBlockIter *iter, struct isi_gps_data *fix) {
+	struct gps_cell_info_wcdma cell;
+
+	if(!gps_cell_info_wcdma_decode(iter, &cell))
+		return;
+
+	fix->mcc = cell.mcc;
+	fix->mnc = cell.mnc;
+	fix->lac = 0;
+	fix->cid = cell.ucid;
+	fix->present |= ISI_GPS_HAS_CELL_WCDMA;
+}
+
+/* sub-block id to ISI_GPS_HAS_* flag */
+static guint32 gps_sb_flag(int id) {
+	switch(id) {
+		case GPS_DATA_POSITION:
+			return ISI_GPS_HAS_POSITION;
+		case GPS_TIME_DATE:
+			return ISI_GPS_HAS_TIME;
+		case GPS_MOVEMENT:
+			return ISI_GPS_HAS_MOVEMENT;
+		case GPS_SATELLITE_INFO:
+			return ISI_GPS_HAS_SATELLITES;
+		case GPS_CELL_INFO_GSM:
+			return ISI_GPS_HAS_CELL_GSM;
+		case GPS_CELL_INFO_WCDMA:
+			return ISI_GPS_HAS_CELL_WCDMA;
+		default:
+			return 0;
+	}
+}
+
+gboolean isi_gps_data_decode_mask(const void *data, size_t len, guint32 mask, struct isi_gps_data *fix) {
+	struct gps_data_ind ind;
+	GIsiSubBlockIter iter;
+
+	fix->present = 0;
+
+	if(!gps_data_ind_decode(data, len, &ind))
+		return FALSE;
+
+	for(g_isi_sb_iter_init_full(&iter, data, len, GPS_DATA_IND_LEN, TRUE, ind.sub_blocks);
+			g_isi_sb_iter_is_valid(&iter);
+			g_isi_sb_iter_next(&iter)) {
+		int id = g_isi_sb_iter_get_id(&iter);
+
+		if(!(gps_sb_flag(id) & mask))
+			continue;
+
+		switch(id) {
+			case GPS_DATA_POSITION:
+				gps_decode_position(&iter, fix);
+				break;
+			case GPS_TIME_DATE:
+				gps_decode_time(&iter, fix);
+				break;
+			case GPS_MOVEMENT:
+				gps_decode_movement(&iter, fix);
+				break;
+			case GPS_SATELLITE_INFO:
+				gps_decode_satellites(&iter, fix);
+				break;
+			case GPS_CELL_INFO_GSM:
+				gps_decode_cell_gsm(&iter, fix);
+				break;
+			case GPS_CELL_INFO_WCDMA:
+				gps_decode_cell_wcdma(&iter, fix);
+				break;
+		}
+	}
+
+	return TRUE;
+}
+
+gboolean isi_gps_data_decode(const void *data, size_t len, struct isi_gps_data *fix) {
+	return isi_gps_data_decode_mask(data, len, ~0U, fix);
+}
+
 static void gps_status_ind_cb(GIsiClient *client, const void *restrict data, size_t len, uint16_t object, void *opaque) {
 	const unsigned char *msg = data;
 	struct isi_cb_data *cbd = opaque;
 	struct isi_gps *nd = cbd->subsystem;
 	isi_gps_status_cb cb = cbd->callback;
 	void *user_data = cbd->data;
+	struct gps_status_ind ind;
 
 	if(!cb) {
 		g_warning("no callback defined!");
@@ -40,11 +344,25 @@ static void gps_status_ind_cb(GIsiClient *client, const void *restrict data, siz
 		goto error;
 	}
 
-	/* TODO: analyze gps status pkg */
+	if(!gps_status_ind_decode(msg, len, &ind))
+		goto error;
+
+	switch(ind.status) {
+		case GPS_DISABLED:
+			cb(ISI_GPS_STATUS_DISABLED, user_data);
+			return;
+		case GPS_NOT_LOCKED:
+			cb(ISI_GPS_STATUS_NOT_LOCKED, user_data);
+			return;
+		case GPS_LOCKED:
+			cb(ISI_GPS_STATUS_LOCKED, user_data);
+			return;
+		default:
+			break;
+	}
 
 	error:
 		cb(ISI_GPS_STATUS_ERROR, user_data);
-
 }
 
 void isi_gps_status_subscribe(struct isi_gps *nd, isi_gps_status_cb cb, void *user_data) {
@@ -59,39 +377,263 @@ void isi_gps_status_unsubscribe(struct isi_gps *nd) {
 	g_isi_unsubscribe(nd->client, GPS_STATUS_IND);
 }
 
+static struct isi_gps_ring_slot* gps_ring_slot(struct isi_gps_ring *ring, guint32 number) {
+	return &ring->slots[number % ISI_GPS_RING_SIZE];
+}
+
+static void gps_push_cell(struct isi_cell_stream *cells, const struct isi_gps_data *fix) {
+	struct isi_cell_record rec;
+
+	if(!(fix->present & (ISI_GPS_HAS_CELL_GSM | ISI_GPS_HAS_CELL_WCDMA)))
+		return;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.source = ISI_CELL_SOURCE_GPS;
+	rec.rat = fix->present & ISI_GPS_HAS_CELL_WCDMA ? ISI_CELL_RAT_WCDMA : ISI_CELL_RAT_GSM;
+	rec.mcc = fix->mcc;
+	rec.mnc = fix->mnc;
+	rec.lac = fix->lac;
+	rec.cid = fix->cid;
+	isi_cell_stream_push(cells, &rec);
+}
+
+void isi_gps_set_cell_stream(struct isi_gps *nd, struct isi_cell_stream *stream) {
+	nd->cells = stream;
+}
+
+struct isi_gps_ring* isi_gps_get_ring(struct isi_gps *nd) {
+	return &nd->ring;
+}
+
+guint32 isi_gps_ring_head(struct isi_gps_ring *ring) {
+	return (guint32) g_atomic_int_get(&ring->head);
+}
+
+gboolean isi_gps_ring_read(struct isi_gps_ring *ring, guint32 number, struct isi_gps_data *fix) {
+	struct isi_gps_ring_slot *slot = gps_ring_slot(ring, number);
+	gint seq;
+
+	if(number == 0)
+		return FALSE;
+
+	do {
+		seq = g_atomic_int_get(&slot->seq);
+		if(seq & 1)
+			continue;
+
+		if((guint32) g_atomic_int_get(&slot->number) != number)
+			return FALSE;
+
+		memcpy(fix, &slot->fix, sizeof(*fix));
+	} while((seq & 1) || g_atomic_int_get(&slot->seq) != seq);
+
+	return TRUE;
+}
+
+gboolean isi_gps_ring_latest(struct isi_gps_ring *ring, struct isi_gps_data *fix, guint32 *number) {
+	guint32 head;
+
+	/* retry if the latest fix got overwritten while copying */
+	do {
+		head = isi_gps_ring_head(ring);
+		if(head == 0)
+			return FALSE;
+	} while(!isi_gps_ring_read(ring, head, fix));
+
+	if(number)
+		*number = head;
+	return TRUE;
+}
+
 static void gps_data_ind_cb(GIsiClient *client, const void *restrict data, size_t len, uint16_t object, void *opaque) {
 	const unsigned char *msg = data;
-	struct isi_cb_data *cbd = opaque;
-	struct isi_gps *nd = cbd->subsystem;
-	isi_gps_data_cb cb = cbd->callback;
-	void *user_data = cbd->data;
+	struct isi_gps *nd = opaque;
+	struct isi_gps_ring *ring = &nd->ring;
+	struct isi_gps_ring_slot *slot;
+	guint32 number = isi_gps_ring_head(ring) + 1;
+	gboolean valid;
 
-	if(!cb) {
-		g_warning("no callback defined!");
-		return;
+	if(!msg) {
+		g_warning("ISI client error: %d", g_isi_client_error(client));
+		goto error;
 	}
 
-	if(!msg) {
+	if(!nd->decode_mask)
+		return;
+
+	if(number == 0)
+		number = 1;
+
+	/* the single writer, readers see an odd seq while the slot changes */
+	slot = gps_ring_slot(ring, number);
+	g_atomic_int_inc(&slot->seq);
+	g_atomic_int_set(&slot->number, 0);
+	valid = isi_gps_data_decode_mask(msg, len, nd->decode_mask, &slot->fix);
+	if(valid)
+		g_atomic_int_set(&slot->number, number);
+	g_atomic_int_inc(&slot->seq);
+
+	if(!valid)
+		goto error;
+
+	g_atomic_int_set(&ring->head, number);
+
+	if(nd->cells)
+		gps_push_cell(nd->cells, &slot->fix);
+
+	if(nd->data_cb)
+		nd->data_cb(FALSE, &slot->fix, nd->data_user);
+	return;
+
+	error:
+		if(nd->data_cb)
+			nd->data_cb(TRUE, NULL, nd->data_user);
+}
+
+static void gps_power_send(struct isi_gps *nd);
+
+static gboolean gps_power_resp_cb(GIsiClient *client, const void *restrict data, size_t len, uint16_t object, void *opaque) {
+	struct isi_gps *nd = opaque;
+	struct isi_cb_data *cbd = nd->power_cbd;
+	struct gps_power_resp resp;
+
+	if(!data) {
 		g_warning("ISI client error: %d", g_isi_client_error(client));
 		goto error;
 	}
 
-	/* TODO: analyze gps data pkg */
+	if(!gps_power_resp_decode(data, len, &resp))
+		return FALSE;
+
+	nd->power_req = NULL;
+	nd->power = nd->power_sent;
+
+	/* the target changed while the request was on its way */
+	if(nd->power != nd->power_target) {
+		gps_power_send(nd);
+		return TRUE;
+	}
+
+	nd->power_cbd = NULL;
+	if(cbd) {
+		((isi_gps_power_cb) cbd->callback)(FALSE, cbd->data);
+		isi_cb_data_free(cbd);
+	}
+
+	return TRUE;
 
 	error:
-		cb(TRUE, NULL, user_data);
+		nd->power_req = NULL;
+		nd->power_cbd = NULL;
+		if(cbd) {
+			((isi_gps_power_cb) cbd->callback)(TRUE, cbd->data);
+			isi_cb_data_free(cbd);
+		}
+		return TRUE;
 }
 
-void isi_gps_data_subscribe(struct isi_gps *nd, isi_gps_data_cb cb, void *user_data) {
-	struct isi_cb_data *cbd = isi_cb_data_new(nd, cb, user_data);
-	if(!cbd || g_isi_subscribe(nd->client, GPS_DATA_IND, gps_data_ind_cb, cbd)) {
+static void gps_power_send(struct isi_gps *nd) {
+	uint8_t msg[gps_power_req_len];
+	struct gps_power_req req;
+	struct isi_cb_data *cbd;
+
+	req.state = nd->power_target ? GPS_POWER_ON : GPS_POWER_OFF;
+	gps_power_req_pack(msg, &req);
+
+	nd->power_sent = nd->power_target;
+	nd->power_req = g_isi_request_make(nd->client, msg, sizeof(msg), GPS_TIMEOUT, gps_power_resp_cb, nd);
+	if(nd->power_req)
+		return;
+
+	cbd = nd->power_cbd;
+	nd->power_cbd = NULL;
+	if(cbd) {
+		((isi_gps_power_cb) cbd->callback)(TRUE, cbd->data);
 		isi_cb_data_free(cbd);
-		cb(TRUE, 0, user_data);
 	}
 }
 
+/* requests are serialized, a new target is sent once the pending one is answered */
+static void gps_power_update(struct isi_gps *nd, gboolean on) {
+	nd->power_target = on;
+
+	if(nd->power_req)
+		return;
+
+	if(nd->power == on) {
+		struct isi_cb_data *cbd = nd->power_cbd;
+		nd->power_cbd = NULL;
+		if(cbd) {
+			((isi_gps_power_cb) cbd->callback)(FALSE, cbd->data);
+			isi_cb_data_free(cbd);
+		}
+		return;
+	}
+
+	gps_power_send(nd);
+}
+
+void isi_gps_set_power(struct isi_gps *nd, gboolean on, isi_gps_power_cb cb, void *user_data) {
+	struct isi_cb_data *cbd = isi_cb_data_new(nd, cb, user_data);
+
+	if(!cbd) {
+		cb(TRUE, user_data);
+		return;
+	}
+
+	/* superseded by this request */
+	if(nd->power_cbd) {
+		((isi_gps_power_cb) nd->power_cbd->callback)(TRUE, nd->power_cbd->data);
+		isi_cb_data_free(nd->power_cbd);
+	}
+
+	nd->power_cbd = cbd;
+	gps_power_update(nd, on);
+}
+
+gboolean isi_gps_get_power(struct isi_gps *nd) {
+	return nd->power;
+}
+
+static void gps_auto_power(struct isi_gps *nd) {
+	if(!nd->auto_power)
+		return;
+
+	gps_power_update(nd, nd->data_cb || nd->holds);
+}
+
+void isi_gps_set_auto_power(struct isi_gps *nd, gboolean enable) {
+	nd->auto_power = enable;
+	gps_auto_power(nd);
+}
+
+void isi_gps_hold(struct isi_gps *nd) {
+	nd->holds++;
+	gps_auto_power(nd);
+}
+
+void isi_gps_release(struct isi_gps *nd) {
+	if(nd->holds == 0)
+		return;
+
+	nd->holds--;
+	gps_auto_power(nd);
+}
+
+void isi_gps_set_decode_mask(struct isi_gps *nd, guint32 mask) {
+	nd->decode_mask = mask;
+}
+
+void isi_gps_data_subscribe(struct isi_gps *nd, isi_gps_data_cb cb, void *user_data) {
+	nd->data_cb = cb;
+	nd->data_user = user_data;
+	gps_auto_power(nd);
+}
+
 void isi_gps_data_unsubscribe(struct isi_gps *nd) {
-	g_isi_unsubscribe(nd->client, GPS_DATA_IND);
+	nd->data_cb = NULL;
+	nd->data_user = NULL;
+	gps_auto_power(nd);
 }
 
 void gps_reachable_cb(GIsiClient *client, gboolean alive, uint16_t object, void *user_data) {
@@ -120,25 +662,55 @@ struct isi_gps* isi_gps_create(struct isi_modem *modem, isi_subsystem_reachable_
 	if(!nd || !cbd || !modem->idx)
 		goto error;
 
-	nd->client = g_isi_client_create(modem->idx, PN_NETWORK);
+	nd->client = isi_modem_client_create(modem, PN_GPS);
 	if(!nd->client)
 		goto error;
 
+	nd->decode_mask = ~0U;
+
+	/* the ring is fed whether there is a data callback or not */
+	if(g_isi_subscribe(nd->client, GPS_DATA_IND, gps_data_ind_cb, nd))
+		goto error;
+
 	g_isi_verify(nd->client, gps_reachable_cb, cbd);
 
 	return nd;
 
 	error:
 		cb(TRUE, user_data);
-		if(nd)
+		if(nd) {
+			g_isi_client_destroy(nd->client);
 			free(nd);
+		}
 		isi_cb_data_free(cbd);
 		return NULL;
 }
 
 void isi_gps_destroy(struct isi_gps *nd) {
+	struct isi_cb_data *cbd;
+
 	if(!nd)
 		return;
+
+	/* the receiver was pending or on, because auto power wanted it */
+	if(nd->auto_power && (nd->power || (nd->power_req && nd->power_sent))) {
+		uint8_t msg[gps_power_req_len];
+		struct gps_power_req req = { .state = GPS_POWER_OFF };
+
+		gps_power_req_pack(msg, &req);
+		g_isi_request_make(nd->client, msg, sizeof(msg), 0, NULL, NULL);
+	}
+
+	if(nd->power_req)
+		g_isi_request_cancel(nd->power_req);
+
+	cbd = nd->power_cbd;
+	nd->power_cbd = NULL;
+	if(cbd) {
+		((isi_gps_power_cb) cbd->callback)(TRUE, cbd->data);
+		isi_cb_data_free(cbd);
+	}
+
 	g_isi_client_destroy(nd->client);
 	free(nd);
 }
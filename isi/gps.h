@@ -3,13 +3,20 @@
 #include "opcodes/gps.h"
 #include "gisi/client.h"
 #include "modem.h"
+#include "cell.h"
 
 #ifndef _ISI_GPS_H
 #define _ISI_GPS_H
 
-struct isi_gps {
-	GIsiClient *client;
-};
+#define ISI_GPS_MAX_SATELLITES 32
+
+/* parts of struct isi_gps_data set by the last GPS_DATA_IND */
+#define ISI_GPS_HAS_POSITION	(1 << 0)
+#define ISI_GPS_HAS_TIME	(1 << 1)
+#define ISI_GPS_HAS_MOVEMENT	(1 << 2)
+#define ISI_GPS_HAS_SATELLITES	(1 << 3)
+#define ISI_GPS_HAS_CELL_GSM	(1 << 4)
+#define ISI_GPS_HAS_CELL_WCDMA	(1 << 5)
 
 typedef enum {
 	ISI_GPS_STATUS_ERROR,
@@ -18,26 +25,122 @@ typedef enum {
 	ISI_GPS_STATUS_LOCKED
 } IsiGpsStatus;
 
+/* satellites as parallel arrays, entry i of each array describes the
+ * same satellite and only the first count entries are valid */
+struct isi_gps_satellites {
+	float snr[ISI_GPS_MAX_SATELLITES];
+	float elevation[ISI_GPS_MAX_SATELLITES];	/* degree */
+	float azimuth[ISI_GPS_MAX_SATELLITES];		/* degree */
+	guint8 prn[ISI_GPS_MAX_SATELLITES];
+	guint8 used[ISI_GPS_MAX_SATELLITES];		/* 1 if used for the fix */
+	guint8 count;
+};
+
+/* signal strength over all visible and over the used satellites */
+struct isi_gps_snr_stats {
+	unsigned visible;
+	unsigned used;
+	float min;
+	float max;
+	float mean;
+	float used_mean;
+};
+
+/* dilution of precision from the geometry of the used satellites */
+struct isi_gps_dop {
+	float gdop;
+	float pdop;
+	float hdop;
+	float vdop;
+	float tdop;
+};
+
+/* one fix, fields are only valid if their flag is set in present */
 struct isi_gps_data {
-	/* TODO: create structures for
-	   position
-	   time/date
-	   movement
-	   satellite info
-	   cell info gsm
-	   cell info wcdma
-	   isi_gps_data contains references to
-	   this structures or NULL if not set
-	*/
+	guint32 present;
+
+	/* position in degree and meter */
+	double latitude;
+	double longitude;
+	float eph;
+	gint32 altitude;
+	float epv;
+
+	/* UTC */
+	guint16 year;
+	guint8 month;
+	guint8 day;
+	guint8 hour;
+	guint8 minute;
+	float second;
+
+	/* course in degree, speed and climb in km/h */
+	float course;
+	float epd;
+	float speed;
+	float eps;
+	float climb;
+	float epc;
+
+	struct isi_gps_satellites satellites;
+
+	/* serving cell, cid is the UCID for WCDMA */
+	guint16 mcc;
+	guint16 mnc;
+	guint16 lac;
+	guint32 cid;
 };
 
-/* callbacks */
+/* last ISI_GPS_RING_SIZE fixes, numbered from 1. Written by the main
+ * loop only, readers on any thread copy fixes out without locking and
+ * retry if the writer got in between (seqlock) */
+#define ISI_GPS_RING_SIZE 16
+
+struct isi_gps_ring_slot {
+	volatile gint seq;	/* odd while the slot is written */
+	volatile gint number;	/* fix number stored in the slot, 0 if none */
+	struct isi_gps_data fix;
+};
+
+struct isi_gps_ring {
+	volatile gint head;	/* number of the latest fix, 0 if none */
+	struct isi_gps_ring_slot slots[ISI_GPS_RING_SIZE];
+};
+
+/* callbacks, data points into the ring and stays valid until
+ * ISI_GPS_RING_SIZE more fixes arrived */
 typedef void (*isi_gps_data_cb)(gboolean error, struct isi_gps_data *data, void *user_data);
-typedef void (*isi_gps_status_cb)(IsiGpsStatus *data, void *user_data);
+typedef void (*isi_gps_status_cb)(IsiGpsStatus status, void *user_data);
+
+typedef void (*isi_gps_power_cb)(gboolean error, void *user_data);
+
+struct isi_gps {
+	GIsiClient *client;
+
+	/* every GPS_DATA_IND is decoded in place into the next slot */
+	struct isi_gps_ring ring;
+	guint32 decode_mask;
+
+	isi_gps_data_cb data_cb;
+	void *data_user;
+
+	/* receiver power, target is what the last caller asked for */
+	gboolean power;
+	gboolean power_target;
+	gboolean power_sent;
+	GIsiRequest *power_req;
+	struct isi_cb_data *power_cbd;
+
+	/* in auto mode the receiver is on while someone uses the fixes */
+	gboolean auto_power;
+	unsigned holds;
+
+	struct isi_cell_stream *cells;
+};
 
 /* subsystem */
-struct isi_network* isi_network_create(struct isi_modem *modem, isi_subsystem_reachable_cb cb, void *user_data);
-void isi_network_destroy(struct isi_network *nd);
+struct isi_gps* isi_gps_create(struct isi_modem *modem, isi_subsystem_reachable_cb cb, void *user_data);
+void isi_gps_destroy(struct isi_gps *nd);
 
 /* methods */
 void isi_gps_status_subscribe(struct isi_gps *nd, isi_gps_status_cb cb, void *user_data);
@@ -45,4 +148,40 @@ void isi_gps_status_unsubscribe(struct isi_gps *nd);
 void isi_gps_data_subscribe(struct isi_gps *nd, isi_gps_data_cb cb, void *user_data);
 void isi_gps_data_unsubscribe(struct isi_gps *nd);
 
+/* receiver power, the callback is called once the modem confirmed the
+ * last requested state or with error if the request failed */
+void isi_gps_set_power(struct isi_gps *nd, gboolean on, isi_gps_power_cb cb, void *user_data);
+gboolean isi_gps_get_power(struct isi_gps *nd);
+
+/* switch the receiver on while there is a data callback or a hold and
+ * off otherwise. Ring readers, which are not known to the subsystem,
+ * keep the receiver on with isi_gps_hold() and isi_gps_release(). */
+void isi_gps_set_auto_power(struct isi_gps *nd, gboolean enable);
+void isi_gps_hold(struct isi_gps *nd);
+void isi_gps_release(struct isi_gps *nd);
+
+/* ISI_GPS_HAS_* flags of the sub-blocks decoded into the ring, all by
+ * default. Indications are not decoded at all with an empty mask. */
+void isi_gps_set_decode_mask(struct isi_gps *nd, guint32 mask);
+
+/* add the serving cell of every fix to stream, NULL detaches */
+void isi_gps_set_cell_stream(struct isi_gps *nd, struct isi_cell_stream *stream);
+
+/* decode a GPS_DATA_IND into fix, returns FALSE if the message is malformed */
+gboolean isi_gps_data_decode(const void *data, size_t len, struct isi_gps_data *fix);
+gboolean isi_gps_data_decode_mask(const void *data, size_t len, guint32 mask, struct isi_gps_data *fix);
+
+/* statistics over the satellites of a fix, the DOP needs at least four
+ * used satellites and returns FALSE for fewer or degenerate geometry */
+void isi_gps_satellites_snr_stats(const struct isi_gps_satellites *sats, struct isi_gps_snr_stats *stats);
+gboolean isi_gps_satellites_dop(const struct isi_gps_satellites *sats, struct isi_gps_dop *dop);
+
+/* fix ring, safe to use from any thread while the subsystem exists.
+ * Readers keep the number of the last fix they have seen and catch up
+ * with isi_gps_ring_read(), which fails for fixes already overwritten. */
+struct isi_gps_ring* isi_gps_get_ring(struct isi_gps *nd);
+guint32 isi_gps_ring_head(struct isi_gps_ring *ring);
+gboolean isi_gps_ring_read(struct isi_gps_ring *ring, guint32 number, struct isi_gps_data *fix);
+gboolean isi_gps_ring_latest(struct isi_gps_ring *ring, struct isi_gps_data *fix, guint32 *number);
+
 #endif
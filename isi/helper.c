@@ -0,0 +1,70 @@
+/*
+ * This file is GPLv2
+ * Copyright (C) 2010 Sebastian Reichel
+ */
+/* clock_gettime() is POSIX, not C99 */
+#define _POSIX_C_SOURCE 199309L
+
+#include <glib.h>
+#include <errno.h>
+#include <time.h>
+
+#include "helper.h"
+#include "gisi/slab.h"
+
+/* contexts allocated from the system at once */
+#define CB_DATA_CHUNK 64
+
+/* shared by modems running in different threads */
+G_LOCK_DEFINE_STATIC(cb_data);
+static GIsiSlab *cb_data_slab;
+
+struct isi_cb_data* isi_cb_data_new(void *subsystem, void *callback, void *data) {
+	struct isi_cb_data *output = NULL;
+
+	G_LOCK(cb_data);
+	if(!cb_data_slab)
+		cb_data_slab = g_isi_slab_new(sizeof(struct isi_cb_data), CB_DATA_CHUNK);
+	if(cb_data_slab)
+		output = g_isi_slab_alloc(cb_data_slab);
+	G_UNLOCK(cb_data);
+
+	if(!output)
+		return NULL;
+
+	output->subsystem = subsystem;
+	output->callback  = callback;
+	output->data      = data;
+	return output;
+}
+
+void isi_cb_data_free(struct isi_cb_data *data) {
+	if(!data)
+		return;
+
+	G_LOCK(cb_data);
+	g_isi_slab_free(cb_data_slab, data);
+	G_UNLOCK(cb_data);
+}
+
+int isi_cb_data_get_stats(GIsiSlabStats *stats) {
+	int err = -ENOENT;
+
+	G_LOCK(cb_data);
+	if(cb_data_slab) {
+		g_isi_slab_get_stats(cb_data_slab, stats);
+		err = 0;
+	}
+	G_UNLOCK(cb_data);
+
+	return err;
+}
+
+uint64_t isi_now_ms(void) {
+	struct timespec ts;
+
+	if(clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+		return 0;
+
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
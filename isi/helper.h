@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <stdint.h>
 
 struct isi_cb_data {
 	void *subsystem;
@@ -6,15 +7,13 @@ struct isi_cb_data {
 	void *data;
 };
 
-static inline struct isi_cb_data* isi_cb_data_new(void *subsystem, void *callback, void *data) {
-	struct isi_cb_data *output = malloc(sizeof(struct isi_cb_data));
-	output->subsystem = subsystem;
-	output->callback  = callback;
-	output->data      = data;
-	return output;
-}
+/* callback contexts come from a slab, see helper.c */
+struct isi_cb_data* isi_cb_data_new(void *subsystem, void *callback, void *data);
+void isi_cb_data_free(struct isi_cb_data *data);
 
-static inline void isi_cb_data_free(struct isi_cb_data *data) {
-	if(data)
-		free(data);
-}
+/* statistics of the context slab, which is shared by all modems */
+struct _GIsiSlabStats;
+int isi_cb_data_get_stats(struct _GIsiSlabStats *stats);
+
+/* monotonic clock in milliseconds */
+uint64_t isi_now_ms(void);
@@ -0,0 +1,215 @@
+/*
+ * This file is GPLv2
+ * Copyright (C) 2010 Sebastian Reichel
+ */
+#include <errno.h>
+#include <string.h>
+#include <net/if.h>
+
+#include "manager.h"
+#include "modem.h"
+#include "gisi/client.h"
+#include "gisi/netlink.h"
+#include "gisi/socket.h"
+
+struct isi_manager_modem {
+	struct isi_manager *mgr;
+	struct isi_modem *modem;
+	GIsiModem *idx;
+	char iface[IF_NAMESIZE];
+	gboolean announced;
+	gboolean removing;
+	guint evict;
+};
+
+static void manager_modem_remove(struct isi_manager_modem *entry);
+
+static gboolean manager_evict_cb(gpointer data) {
+	struct isi_manager_modem *entry = data;
+
+	entry->evict = 0;
+	g_hash_table_remove(entry->mgr->modems, GUINT_TO_POINTER(g_isi_modem_index(entry->idx)));
+	manager_modem_remove(entry);
+	return FALSE;
+}
+
+static void manager_address_cb(GIsiModem *idx, int error, void *data) {
+	if(error && error != -EEXIST)
+		g_debug("g_pn_netlink_set_address: %s\n", strerror(-error));
+}
+
+static void manager_route_cb(GIsiModem *idx, int error, void *data) {
+	if(error && error != -ENOTSUP)
+		g_debug("g_pn_netlink_add_route: %s\n", strerror(-error));
+}
+
+static void manager_reachable_cb(gboolean error, void *data) {
+	struct isi_manager_modem *entry = data;
+	struct isi_manager *mgr = entry->mgr;
+
+	/* verification is aborted by isi_modem_destroy */
+	if(entry->removing)
+		return;
+
+	if(error) {
+		g_warning("modem on %s is not reachable", entry->iface);
+
+		/* the modem is still calling back, a failed create cleans up itself */
+		if(entry->modem && !entry->evict)
+			entry->evict = g_isi_idle_add(NULL, manager_evict_cb, entry);
+		return;
+	}
+
+	entry->announced = TRUE;
+	if(mgr->added)
+		mgr->added(entry->modem, entry->iface, mgr->user_data);
+}
+
+static void manager_modem_add(struct isi_manager *mgr, GIsiModem *idx, const char *iface) {
+	unsigned ifindex = g_isi_modem_index(idx);
+	struct isi_manager_modem *entry;
+	int error;
+
+	if(g_hash_table_lookup(mgr->modems, GUINT_TO_POINTER(ifindex)))
+		return;
+
+	if(g_hash_table_size(mgr->modems) >= mgr->max_modems) {
+		g_warning("ignoring %s, %u modems in use", iface, mgr->max_modems);
+		return;
+	}
+
+	entry = g_try_new0(struct isi_manager_modem, 1);
+	if(!entry)
+		return;
+
+	entry->mgr = mgr;
+	entry->idx = idx;
+	g_strlcpy(entry->iface, iface, sizeof(entry->iface));
+
+	if(g_isi_ind_hub_ref(idx))
+		goto error;
+
+	g_hash_table_insert(mgr->modems, GUINT_TO_POINTER(ifindex), entry);
+
+	error = g_pn_netlink_set_address_async(idx, PN_DEV_SOS, manager_address_cb, NULL);
+	if(error)
+		manager_address_cb(idx, error, NULL);
+
+	error = g_pn_netlink_add_route_async(idx, PN_DEV_HOST, manager_route_cb, NULL);
+	if(error)
+		manager_route_cb(idx, error, NULL);
+
+	entry->modem = isi_modem_create_managed(idx, manager_reachable_cb, entry);
+	if(!entry->modem) {
+		g_hash_table_remove(mgr->modems, GUINT_TO_POINTER(ifindex));
+		g_isi_ind_hub_unref(idx);
+		g_free(entry);
+	}
+
+	return;
+
+	error:
+		g_free(entry);
+}
+
+static void manager_modem_remove(struct isi_manager_modem *entry) {
+	struct isi_manager *mgr = entry->mgr;
+
+	entry->removing = TRUE;
+	if(entry->evict)
+		g_isi_source_remove(NULL, entry->evict);
+
+	if(entry->announced && mgr->removed)
+		mgr->removed(entry->modem, entry->iface, mgr->user_data);
+
+	isi_modem_destroy(entry->modem);
+	g_isi_ind_hub_unref(entry->idx);
+	g_free(entry);
+}
+
+static void manager_netlink_cb(GIsiModem *idx, GPhonetLinkState state, char const *iface, void *data) {
+	struct isi_manager *mgr = data;
+	unsigned ifindex = g_isi_modem_index(idx);
+	struct isi_manager_modem *entry;
+
+	if(state == PN_LINK_UP) {
+		manager_modem_add(mgr, idx, iface);
+		return;
+	}
+
+	entry = g_hash_table_lookup(mgr->modems, GUINT_TO_POINTER(ifindex));
+	if(!entry || entry->removing)
+		return;
+
+	g_hash_table_remove(mgr->modems, GUINT_TO_POINTER(ifindex));
+	manager_modem_remove(entry);
+}
+
+struct isi_manager* isi_manager_create(isi_manager_added_cb added, isi_manager_removed_cb removed, void *user_data) {
+	struct isi_manager *mgr = g_try_new0(struct isi_manager, 1);
+
+	if(!mgr)
+		return NULL;
+
+	mgr->added = added;
+	mgr->removed = removed;
+	mgr->user_data = user_data;
+	mgr->max_modems = ISI_MANAGER_MAX_MODEMS;
+	mgr->modems = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	/* no interface, watches all of them */
+	mgr->link = g_pn_netlink_start(NULL, manager_netlink_cb, mgr);
+	if(!mgr->link)
+		goto error;
+
+	return mgr;
+
+	error:
+		g_hash_table_destroy(mgr->modems);
+		g_free(mgr);
+		return NULL;
+}
+
+void isi_manager_destroy(struct isi_manager *mgr) {
+	GHashTableIter iter;
+	gpointer value;
+	GSList *entries = NULL, *l;
+
+	if(!mgr)
+		return;
+
+	g_pn_netlink_stop(mgr->link);
+
+	g_hash_table_iter_init(&iter, mgr->modems);
+	while(g_hash_table_iter_next(&iter, NULL, &value))
+		entries = g_slist_prepend(entries, value);
+	g_hash_table_remove_all(mgr->modems);
+
+	for(l = entries; l; l = l->next)
+		manager_modem_remove(l->data);
+
+	g_slist_free(entries);
+	g_hash_table_destroy(mgr->modems);
+	g_free(mgr);
+}
+
+void isi_manager_set_max_modems(struct isi_manager *mgr, unsigned max) {
+	mgr->max_modems = max;
+}
+
+void isi_manager_get_stats(struct isi_manager *mgr, struct isi_manager_stats *stats) {
+	GHashTableIter iter;
+	gpointer value;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->netlink = g_pn_netlink_watchers();
+
+	g_hash_table_iter_init(&iter, mgr->modems);
+	while(g_hash_table_iter_next(&iter, NULL, &value)) {
+		struct isi_manager_modem *entry = value;
+
+		if(entry->announced)
+			stats->modems++;
+		stats->sockets += g_isi_modem_sockets(entry->idx);
+	}
+}
@@ -0,0 +1,42 @@
+#include <glib.h>
+#include "gisi/netlink.h"
+#include "modem.h"
+
+#ifndef _ISI_MANAGER_H
+#define _ISI_MANAGER_H
+
+/* default limit of modems driven by one manager */
+#define ISI_MANAGER_MAX_MODEMS 32
+
+struct isi_manager_stats {
+	unsigned modems;	/* reachable modems */
+	unsigned sockets;	/* Phonet sockets of all modems */
+	unsigned netlink;	/* netlink watchers, all on one socket */
+};
+
+/* modem is usable after added, subsystems created on it must be destroyed
+ * from removed, the modem is destroyed by the manager afterwards */
+typedef void (*isi_manager_added_cb)(struct isi_modem *modem, const char *iface, void *data);
+typedef void (*isi_manager_removed_cb)(struct isi_modem *modem, const char *iface, void *data);
+
+/* one netlink watcher and one indication socket per modem for all
+ * Phonet interfaces, modems are created and destroyed on hotplug.
+ * Unreachable modems are dropped and tried again when their link comes
+ * up the next time */
+struct isi_manager {
+	GPhonetNetlink *link;
+	GHashTable *modems;
+	unsigned max_modems;
+	isi_manager_added_cb added;
+	isi_manager_removed_cb removed;
+	void *user_data;
+};
+
+struct isi_manager* isi_manager_create(isi_manager_added_cb added, isi_manager_removed_cb removed, void *user_data);
+void isi_manager_destroy(struct isi_manager *mgr);
+
+/* interfaces beyond the limit are ignored until a modem goes away */
+void isi_manager_set_max_modems(struct isi_manager *mgr, unsigned max);
+void isi_manager_get_stats(struct isi_manager *mgr, struct isi_manager_stats *stats);
+
+#endif
@@ -11,12 +11,16 @@
 
 #include "gisi/modem.h"
 #include "opcodes/mtc.h"
+#include "opcodes/gpds.h"
 
 #include "debug.h"
 #include "modem.h"
 #include "gisi/netlink.h"
 #include "helper.h"
 
+/* requests per slab chunk, enough for all subsystems of a modem */
+#define MODEM_SLAB_CHUNK 32
+
 void mtc_state_cb(GIsiClient *client, const void *restrict data, size_t len, uint16_t object, void *opaque) {
 	const unsigned char *msg = data;
 	struct isi_modem *isi = opaque;
@@ -137,7 +141,7 @@ static void netlink_status_cb(GIsiModem *idx, GPhonetLinkState state, char const
 
 	if(state == PN_LINK_UP) {
 		modem->idx = idx;
-		modem->client = g_isi_client_create(idx, PN_MTC);
+		modem->client = isi_modem_client_create(modem, PN_MTC);
 
 		if(!modem->client) {
 			cb(TRUE, user_data);
@@ -155,8 +159,22 @@ static void netlink_status_cb(GIsiModem *idx, GPhonetLinkState state, char const
 	}
 }
 
+static void netlink_address_cb(GIsiModem *idx, int error, void *data) {
+	if(error && error != -EEXIST)
+		g_debug("g_pn_netlink_set_address: %s\n", strerror(-error));
+}
+
+static void netlink_route_cb(GIsiModem *idx, int error, void *data) {
+	if(error && error != -ENOTSUP)
+		g_debug("g_pn_netlink_add_route: %s\n", strerror(-error));
+}
+
 struct isi_modem* isi_modem_create(char *interface, isi_subsystem_reachable_cb cb, void *user_data) {
-	struct isi_modem *modem = malloc(sizeof(struct isi_modem));
+	return isi_modem_create_with_context(interface, NULL, cb, user_data);
+}
+
+struct isi_modem* isi_modem_create_with_context(char *interface, GMainContext *context, isi_subsystem_reachable_cb cb, void *user_data) {
+	struct isi_modem *modem = calloc(sizeof(struct isi_modem), 1);
 	struct isi_cb_data *cbd = isi_cb_data_new(modem, cb, user_data);
 	int error;
 
@@ -164,35 +182,115 @@ struct isi_modem* isi_modem_create(char *interface, isi_subsystem_reachable_cb c
 		goto error;
 
 	modem->idx = g_isi_modem_by_name(interface);
-	modem->link = g_pn_netlink_start(modem->idx, netlink_status_cb, cbd);
-	modem->client = NULL;
+	modem->context = context ? g_main_context_ref(context) : NULL;
+	modem->req_slab = g_isi_slab_new(g_isi_request_size(), MODEM_SLAB_CHUNK);
+	modem->link = g_pn_netlink_start_with_context(modem->idx, netlink_status_cb, cbd, context);
 
-	if(!modem->link)
+	if(!modem->link || !modem->req_slab)
 		goto error;
 	
-	error = g_pn_netlink_set_address(modem->idx, PN_DEV_SOS);
-	if(error && error != -EEXIST)
-		g_debug("g_pn_netlink_set_address: %s\n", strerror(-error));
+	/* both are pipelined, the acks only get logged */
+	error = g_pn_netlink_set_address_async_with_context(modem->idx, PN_DEV_SOS, netlink_address_cb, NULL, context);
+	if(error)
+		netlink_address_cb(modem->idx, error, NULL);
 
-	error = g_pn_netlink_add_route(modem->idx, PN_DEV_HOST);
-	if(error && error != -ENOTSUP)
-		g_debug("g_pn_netlink_add_route: %s\n", strerror(-error));
+	error = g_pn_netlink_add_route_async_with_context(modem->idx, PN_DEV_HOST, netlink_route_cb, NULL, context);
+	if(error)
+		netlink_route_cb(modem->idx, error, NULL);
+
+	return modem;
+
+	error:
+		if(modem) {
+			if(modem->link)
+				g_pn_netlink_stop(modem->link);
+			g_isi_slab_destroy(modem->req_slab);
+			if(modem->context)
+				g_main_context_unref(modem->context);
+			free(modem);
+		}
+		isi_cb_data_free(cbd);
+		cb(TRUE, user_data);
+		return NULL;
+}
+
+struct isi_modem* isi_modem_create_managed(GIsiModem *idx, isi_subsystem_reachable_cb cb, void *user_data) {
+	return isi_modem_create_managed_with_context(idx, NULL, cb, user_data);
+}
+
+struct isi_modem* isi_modem_create_managed_with_context(GIsiModem *idx, GMainContext *context, isi_subsystem_reachable_cb cb, void *user_data) {
+	struct isi_modem *modem = calloc(sizeof(struct isi_modem), 1);
+	struct isi_cb_data *cbd = isi_cb_data_new(modem, cb, user_data);
+
+	if(!modem || !cbd)
+		goto error;
+
+	modem->idx = idx;
+	modem->context = context ? g_main_context_ref(context) : NULL;
+	modem->req_slab = g_isi_slab_new(g_isi_request_size(), MODEM_SLAB_CHUNK);
+	modem->client = isi_modem_client_create(modem, PN_MTC);
+
+	if(!modem->req_slab || !modem->client)
+		goto error;
 
+	g_isi_verify(modem->client, modem_reachable_cb, cbd);
 	return modem;
 
 	error:
-		if(modem)
+		if(modem) {
+			g_isi_client_destroy(modem->client);
+			g_isi_slab_destroy(modem->req_slab);
+			if(modem->context)
+				g_main_context_unref(modem->context);
 			free(modem);
+		}
 		isi_cb_data_free(cbd);
 		cb(TRUE, user_data);
 		return NULL;
 }
 
 void isi_modem_destroy(struct isi_modem *modem) {
+	if(modem->link)
+		g_pn_netlink_stop(modem->link);
+	g_isi_pipe_pool_destroy(modem->pipe_pool);
 	g_isi_client_destroy(modem->client);
+	g_isi_slab_destroy(modem->req_slab);
+	if(modem->context)
+		g_main_context_unref(modem->context);
 	free(modem);
 }
 
+void isi_modem_set_io_thread(struct isi_modem *modem, GIsiIOThread *io) {
+	modem->io = io;
+}
+
+GIsiClient* isi_modem_client_create(struct isi_modem *modem, uint8_t resource) {
+	GIsiClient *client;
+
+	if(modem->io)
+		client = g_isi_client_create_threaded(modem->idx, resource, modem->io);
+	else
+		client = g_isi_client_create_with_context(modem->idx, resource, modem->context);
+
+	if(client)
+		g_isi_client_set_slab(client, modem->req_slab);
+
+	return client;
+}
+
+gboolean isi_modem_get_request_stats(struct isi_modem *modem, GIsiSlabStats *stats) {
+	if(!modem->req_slab)
+		return FALSE;
+
+	g_isi_slab_get_stats(modem->req_slab, stats);
+	return TRUE;
+}
+
+void isi_modem_set_request_stats_notification(struct isi_modem *modem, GIsiSlabStatsFunc cb, void *user_data) {
+	if(modem->req_slab)
+		g_isi_slab_set_stats_func(modem->req_slab, cb, user_data);
+}
+
 void isi_modem_set_powerstatus_notification(struct isi_modem *modem, isi_powerstatus_cb cb, void *user_data) {
 	modem->powerstatus = cb;
 	modem->user_data = user_data;
@@ -225,3 +323,21 @@ int isi_modem_disable(struct isi_modem *modem) {
 
 	return -EINPROGRESS;
 }
+
+int isi_modem_set_pipe_pool(struct isi_modem *modem, unsigned size) {
+	/* active GPDS contexts still use their pipes */
+	if(modem->pipe_pool && g_isi_pipe_pool_taken(modem->pipe_pool))
+		return -EBUSY;
+
+	g_isi_pipe_pool_destroy(modem->pipe_pool);
+	modem->pipe_pool = NULL;
+
+	if(!size)
+		return 0;
+
+	modem->pipe_pool = g_isi_pipe_pool_create_with_context(modem->idx, size, PN_OBJ_PEP_GPRS, PN_PEP_TYPE_COMMON, PN_PEP_TYPE_GPRS, modem->context);
+	if(!modem->pipe_pool)
+		return -errno;
+
+	return 0;
+}
@@ -1,5 +1,7 @@
 #include "gisi/client.h"
 #include "gisi/netlink.h"
+#include "gisi/pipepool.h"
+#include "gisi/slab.h"
 
 #ifndef _ISI_MODEM_H
 #define _ISI_MODEM_H
@@ -15,13 +17,44 @@ struct isi_modem {
 	gboolean power;
 	isi_powerstatus_cb powerstatus;
 	void *user_data;
+	GIsiPipePool *pipe_pool;
+	GIsiSlab *req_slab;
+	GMainContext *context;
+	GIsiIOThread *io;
 };
 
 struct isi_modem* isi_modem_create(char *interface, isi_subsystem_reachable_cb cb, void *user_data);
+/* for a link that is already up and watched by someone else, e.g. isi_manager */
+struct isi_modem* isi_modem_create_managed(GIsiModem *idx, isi_subsystem_reachable_cb cb, void *user_data);
+
+/* The modem and all subsystems created on it dispatch from context
+ * (NULL for the default one) and must only be used from the thread
+ * running it, so modems can be spread over threads. Link state is read
+ * by a thread of its own, so call g_thread_init() before creating any
+ * modem. */
+struct isi_modem* isi_modem_create_with_context(char *interface, GMainContext *context, isi_subsystem_reachable_cb cb, void *user_data);
+struct isi_modem* isi_modem_create_managed_with_context(GIsiModem *idx, GMainContext *context, isi_subsystem_reachable_cb cb, void *user_data);
 void isi_modem_set_powerstatus_notification(struct isi_modem *modem, isi_powerstatus_cb cb, void *user_data);
 gboolean isi_modem_get_powerstatus(struct isi_modem *modem);
+/* subsystems of the modem have to be destroyed before it */
 void isi_modem_destroy(struct isi_modem *modem);
 int isi_modem_enable(struct isi_modem *modem);
 int isi_modem_disable(struct isi_modem *modem);
 
+/* keep size GPRS pipes created ahead of data context activation, 0 disables it.
+ * Fails with -EBUSY while GPDS contexts use pipes of the current pool. */
+int isi_modem_set_pipe_pool(struct isi_modem *modem, unsigned size);
+
+/* Serve the sockets and request timeouts of subsystems created from now
+ * on by io, their callbacks still run from the modem's context. Clients
+ * of the modem must be destroyed before io. NULL switches back. */
+void isi_modem_set_io_thread(struct isi_modem *modem, GIsiIOThread *io);
+
+/* client whose requests are allocated from the modem's request slab */
+GIsiClient* isi_modem_client_create(struct isi_modem *modem, uint8_t resource);
+
+/* request allocator statistics, the callback is called whenever the slab grows */
+gboolean isi_modem_get_request_stats(struct isi_modem *modem, GIsiSlabStats *stats);
+void isi_modem_set_request_stats_notification(struct isi_modem *modem, GIsiSlabStatsFunc cb, void *user_data);
+
 #endif
@@ -11,8 +11,33 @@
 #include "modem.h"
 #include "debug.h"
 #include "gisi/iter.h"
+#include "gisi/socket.h"
+#include "descriptor.h"
 #include "helper.h"
 
+ISI_MSG_DEFINE(net_set_manual_req, NET_SET_REQ, NET_SET_MANUAL_REQ_LAYOUT, NET_SET_MANUAL_REQ_LEN)
+ISI_MSG_DEFINE(net_set_auto_req, NET_SET_REQ, NET_SET_AUTO_REQ_LAYOUT, NET_SET_AUTO_REQ_LEN)
+ISI_MSG_DEFINE(net_oper_name_read_req, NET_OPER_NAME_READ_REQ, NET_OPER_NAME_READ_REQ_LAYOUT, NET_OPER_NAME_READ_REQ_LEN)
+
+/* requests without parameters are sent from read-only memory */
+ISI_MSG_TEMPLATE(net_reg_status_get_req, NET_REG_STATUS_GET_REQ, NET_REG_STATUS_GET_REQ_LAYOUT, NET_REG_STATUS_GET_REQ_LEN)
+ISI_MSG_TEMPLATE(net_rssi_get_req, NET_RSSI_GET_REQ, NET_RSSI_GET_REQ_LAYOUT, NET_RSSI_GET_REQ_LEN)
+ISI_MSG_TEMPLATE(net_available_get_req, NET_AVAILABLE_GET_REQ, NET_AVAILABLE_GET_REQ_LAYOUT, NET_AVAILABLE_GET_REQ_LEN)
+
+ISI_MSG_DEFINE(net_reg_status_get_resp, NET_REG_STATUS_GET_RESP, NET_RESP_LAYOUT, NET_RESP_LEN)
+ISI_MSG_DEFINE(net_rssi_get_resp, NET_RSSI_GET_RESP, NET_RESP_LAYOUT, NET_RESP_LEN)
+ISI_MSG_DEFINE(net_set_resp, NET_SET_RESP, NET_RESP_LAYOUT, NET_RESP_LEN)
+ISI_MSG_DEFINE(net_oper_name_read_resp, NET_OPER_NAME_READ_RESP, NET_OPER_NAME_READ_RESP_LAYOUT, NET_OPER_NAME_READ_RESP_LEN)
+ISI_MSG_DEFINE(net_available_get_resp, NET_AVAILABLE_GET_RESP, NET_RESP_LAYOUT, NET_RESP_LEN)
+
+ISI_SB_DEFINE(net_reg_info_common, NET_REG_INFO_COMMON_LAYOUT, NET_REG_INFO_COMMON_LEN)
+ISI_SB_DEFINE(net_gsm_reg_info, NET_GSM_REG_INFO_LAYOUT, NET_GSM_REG_INFO_LEN)
+ISI_SB_DEFINE(net_rssi_current, NET_RSSI_CURRENT_LAYOUT, NET_RSSI_CURRENT_LEN)
+ISI_SB_DEFINE(net_gsm_operator_info, NET_GSM_OPERATOR_INFO_LAYOUT, NET_GSM_OPERATOR_INFO_LEN)
+ISI_SB_DEFINE(net_oper_name_info, NET_OPER_NAME_INFO_LAYOUT, NET_OPER_NAME_INFO_LEN)
+ISI_SB_DEFINE(net_avail_network_info_common, NET_AVAIL_NETWORK_INFO_COMMON_LAYOUT, NET_AVAIL_NETWORK_INFO_COMMON_LEN)
+ISI_SB_DEFINE(net_detailed_network_info, NET_DETAILED_NETWORK_INFO_LAYOUT, NET_DETAILED_NETWORK_INFO_LEN)
+
 gboolean decode_reg_status(struct isi_network *nd, const guint8 *msg, size_t len, struct network_status *st) {
 	enum net_reg_status *status = &st->status;
 	guint16 *lac = &st->lac;
@@ -28,37 +53,27 @@ gboolean decode_reg_status(struct isi_network *nd, const guint8 *msg, size_t len
 		switch (g_isi_sb_iter_get_id(&iter)) {
 
 			case NET_REG_INFO_COMMON: {
-				guint8 byte = 0;
-
-				if (!g_isi_sb_iter_get_byte(&iter, &byte, 2))
-					return FALSE;
+				struct net_reg_info_common info;
 
-				if (!g_isi_sb_iter_get_byte(&iter,
-							&nd->last_reg_mode, 3))
+				if (!net_reg_info_common_decode(&iter, &info))
 					return FALSE;
 
-				*status = byte;
+				*status = info.status;
+				nd->last_reg_mode = info.mode;
 
 				/* FIXME: decode alpha tag(s) */
 				break;
 			}
 
 			case NET_GSM_REG_INFO: {
-				guint16 word = 0;
-				guint32 dword = 0;
-				guint8 egprs = 0;
-				guint8 hsdpa = 0;
-				guint8 hsupa = 0;
-
-				if (!g_isi_sb_iter_get_word(&iter, &word, 2) ||
-					!g_isi_sb_iter_get_dword(&iter, &dword, 4) ||
-					!g_isi_sb_iter_get_byte(&iter, &egprs, 17) ||
-					!g_isi_sb_iter_get_byte(&iter, &hsdpa, 20) ||
-					!g_isi_sb_iter_get_byte(&iter, &hsupa, 21))
+				struct net_gsm_reg_info info;
+
+				if (!net_gsm_reg_info_decode(&iter, &info))
 					return FALSE;
 
-				*ci = (int)dword & 0x0000FFFF;
-				*lac = (int)word;
+				*ci = (int)info.cid & 0x0000FFFF;
+				nd->cell_id = info.cid;
+				*lac = (int)info.lac;
 
 				switch (nd->rat) {
 
@@ -67,18 +82,18 @@ gboolean decode_reg_status(struct isi_network *nd, const guint8 *msg, size_t len
 					*tech = 0;
 					if (nd->gsm_compact)
 						*tech = 1;
-					else if (egprs)
+					else if (info.egprs)
 						*tech = 3;
 					break;
 
 				case NET_UMTS_RAT:
 
 					*tech = 2;
-					if (hsdpa)
+					if (info.hsdpa)
 						*tech = 4;
-					if (hsupa)
+					if (info.hsupa)
 						*tech = 5;
-					if (hsdpa && hsupa)
+					if (info.hsdpa && info.hsupa)
 						*tech = 6;
 					break;
 
@@ -130,6 +145,57 @@ static inline int isi_status_to_at_status(guint8 status) {
 	}
 }
 
+static gboolean parse_reg_status(struct isi_network *nd, const unsigned char *msg, size_t len, struct network_status *st) {
+	st->status = -1;
+	st->lac = -1;
+	st->cid = -1;
+	st->technology = -1;
+
+	/* package too small */
+	if(!msg || len < 3)
+		return FALSE;
+
+	/* check if we received a status package */
+	if(msg[0] != NET_REG_STATUS_IND && msg[0] != NET_REG_STATUS_GET_RESP)
+		return FALSE;
+
+	if(msg[0] == NET_REG_STATUS_GET_RESP) {
+		struct net_reg_status_get_resp resp;
+
+		if(!net_reg_status_get_resp_decode(msg, len, &resp))
+			return FALSE;
+
+		if(resp.cause != NET_CAUSE_OK) {
+			g_warning("Request failed: %s", net_isi_cause_name(resp.cause));
+			return FALSE;
+		}
+	}
+
+	if(!decode_reg_status(nd, msg+3, len-3, st))
+		return FALSE;
+
+	/* info message */
+	g_message("Status: %s, LAC: 0x%X, CID: 0x%X, Technology: %d",
+	          net_status_name(st->status), st->lac, st->cid, st->technology);
+
+	nd->status = *st;
+	nd->status_time = isi_now_ms();
+
+	if(nd->cells && st->lac != 0xFFFF) {
+		struct isi_cell_record rec;
+
+		memset(&rec, 0, sizeof(rec));
+		rec.source = ISI_CELL_SOURCE_NETWORK;
+		rec.rat = nd->rat == NET_UMTS_RAT ? ISI_CELL_RAT_WCDMA : ISI_CELL_RAT_GSM;
+		rec.lac = st->lac;
+		rec.cid = nd->cell_id;
+		rec.strength = nd->strength;
+		isi_cell_stream_push(nd->cells, &rec);
+	}
+
+	return TRUE;
+}
+
 void reg_status_ind_cb(GIsiClient *client, const void *restrict data, size_t len, uint16_t object, void *opaque) {
 	const unsigned char *msg = data;
 	struct isi_cb_data *cbd = opaque;
@@ -137,10 +203,6 @@ void reg_status_ind_cb(GIsiClient *client, const void *restrict data, size_t len
 	isi_network_status_cb cb = cbd->callback;
 	void *user_data = cbd->data;
 	struct network_status st;
-	st.status = -1;
-	st.lac = -1;
-	st.cid = -1;
-	st.technology = -1;
 
 	if(!cb) {
 		g_warning("no callback defined!");
@@ -152,23 +214,7 @@ void reg_status_ind_cb(GIsiClient *client, const void *restrict data, size_t len
 		goto error;
 	}
 
-	/* package too small */
-	if(len < 3)
-		goto error;
-
-	/* check if we received a status package */
-	if(msg[0] != NET_REG_STATUS_IND && msg[0] != NET_REG_STATUS_GET_RESP)
-		goto error;
-
-	if(msg[0] == NET_REG_STATUS_GET_RESP && msg[1] != NET_CAUSE_OK) {
-		g_warning("Request failed: %s", net_isi_cause_name(msg[1]));
-		goto error;
-	}
-
-	if(decode_reg_status(nd, msg+3, len-3, &st)) {
-		/* info message */
-		g_message("Status: %s, LAC: 0x%X, CID: 0x%X, Technology: %d",
-		          net_status_name(st.status), st.lac, st.cid, st.technology);
+	if(parse_reg_status(nd, msg, len, &st)) {
 		cb(FALSE, &st, user_data);
 		return;
 	}
@@ -177,20 +223,117 @@ void reg_status_ind_cb(GIsiClient *client, const void *restrict data, size_t len
 		cb(TRUE, NULL, user_data);
 }
 
+static void reg_status_watch_cb(GIsiClient *client, const void *restrict data, size_t len, uint16_t object, void *opaque) {
+	struct isi_network *nd = opaque;
+	struct network_status st;
+
+	if(nd->status_sub)
+		reg_status_ind_cb(client, data, len, object, nd->status_sub);
+	else
+		parse_reg_status(nd, data, len, &st);
+}
+
 gboolean reg_status_resp_cb(GIsiClient *client, const void *restrict data, size_t len, uint16_t object, void *opaque) {
 	reg_status_ind_cb(client, data, len, object, opaque);
 	isi_cb_data_free(opaque);
 	return TRUE;
 }
 
-void isi_network_request_status(struct isi_network *nd, isi_network_status_cb cb, void *user_data) {
+static gboolean snapshot_is_fresh(struct isi_network *nd, guint64 time) {
+	return nd->max_age && time && isi_now_ms() - time <= nd->max_age;
+}
+
+static int network_watch_status(struct isi_network *nd) {
+	int ret;
+
+	if(nd->status_watch)
+		return 0;
+
+	ret = g_isi_subscribe(nd->client, NET_REG_STATUS_IND, reg_status_watch_cb, nd);
+	if(!ret)
+		nd->status_watch = TRUE;
+	return ret;
+}
+
+static void network_unwatch_status(struct isi_network *nd) {
+	if(!nd->status_watch || nd->status_sub || nd->max_age || nd->cells)
+		return;
+
+	g_isi_unsubscribe(nd->client, NET_REG_STATUS_IND);
+	nd->status_watch = FALSE;
+	nd->status_time = 0;
+}
+
+/* answer like the response cache does, never from within the request */
+static gboolean snapshot_deliver_cb(gpointer data) {
+	struct isi_network *nd = data;
+	struct network_status st = nd->status;
+	guint8 strength = nd->strength;
+	GSList *status = nd->status_waiters;
+	GSList *l, *strengths = nd->strength_waiters;
+
+	/* callbacks may request again or destroy nd */
+	nd->snapshot_source = 0;
+	nd->status_waiters = NULL;
+	nd->strength_waiters = NULL;
+
+	for(l = status; l; l = l->next) {
+		struct isi_cb_data *cbd = l->data;
+		isi_network_status_cb cb = cbd->callback;
+		struct network_status copy = st;
+
+		cb(FALSE, &copy, cbd->data);
+		isi_cb_data_free(cbd);
+	}
+	g_slist_free(status);
+
+	for(l = strengths; l; l = l->next) {
+		struct isi_cb_data *cbd = l->data;
+		isi_network_strength_cb cb = cbd->callback;
+
+		cb(FALSE, strength, cbd->data);
+		isi_cb_data_free(cbd);
+	}
+	g_slist_free(strengths);
+
+	return FALSE;
+}
+
+static void snapshot_waiters_free(GSList *waiters) {
+	GSList *l;
+
+	for(l = waiters; l; l = l->next)
+		isi_cb_data_free(l->data);
+	g_slist_free(waiters);
+}
+
+static gboolean snapshot_answer(struct isi_network *nd, GSList **waiters, void *cb, void *user_data) {
 	struct isi_cb_data *cbd = isi_cb_data_new(nd, cb, user_data);
 
-	const unsigned char msg[] = {
-		NET_REG_STATUS_GET_REQ
-	};
+	if(!cbd)
+		return FALSE;
+
+	if(!nd->snapshot_source)
+		nd->snapshot_source = g_isi_idle_add(nd->modem->context, snapshot_deliver_cb, nd);
+	if(!nd->snapshot_source) {
+		isi_cb_data_free(cbd);
+		return FALSE;
+	}
+
+	*waiters = g_slist_append(*waiters, cbd);
+	return TRUE;
+}
 
-	if(!cbd || !g_isi_request_make(nd->client, msg, sizeof(msg), NETWORK_TIMEOUT, reg_status_resp_cb, cbd)) {
+void isi_network_request_status(struct isi_network *nd, isi_network_status_cb cb, void *user_data) {
+	struct isi_cb_data *cbd;
+
+	if(snapshot_is_fresh(nd, nd->status_time) &&
+			snapshot_answer(nd, &nd->status_waiters, cb, user_data))
+		return;
+
+	cbd = isi_cb_data_new(nd, cb, user_data);
+
+	if(!cbd || !g_isi_request_make(nd->client, net_reg_status_get_req, sizeof(net_reg_status_get_req), NETWORK_TIMEOUT, reg_status_resp_cb, cbd)) {
 		isi_cb_data_free(cbd);
 		cb(TRUE, NULL, user_data);
 	}
@@ -198,31 +341,57 @@ void isi_network_request_status(struct isi_network *nd, isi_network_status_cb cb
 
 void isi_network_subscribe_status(struct isi_network *nd, isi_network_status_cb cb, void *user_data) {
 	struct isi_cb_data *cbd = isi_cb_data_new(nd, cb, user_data);
-	if(!cbd || g_isi_subscribe(nd->client, NET_REG_STATUS_IND, reg_status_ind_cb, cbd)) {
+	if(!cbd || network_watch_status(nd)) {
 		isi_cb_data_free(cbd);
 		cb(TRUE, 0, user_data);
+		return;
 	}
+
+	isi_cb_data_free(nd->status_sub);
+	nd->status_sub = cbd;
 }
 
 void isi_network_unsubscribe_status(struct isi_network *nd) {
-	g_isi_unsubscribe(nd->client, NET_REG_STATUS_IND);
+	isi_cb_data_free(nd->status_sub);
+	nd->status_sub = NULL;
+	network_unwatch_status(nd);
 }
 
-void network_rssi_ind_cb(GIsiClient *client, const void *restrict data, size_t len, uint16_t object, void *opaque) {
-	const unsigned char *msg = data;
-	struct isi_cb_data *cbd = opaque;
-	struct isi_network *nd = cbd->subsystem;
-	isi_network_strength_cb cb = cbd->callback;
-	void *user_data = cbd->data;
+/* 0 is reported while the strength is unknown */
+static int rssi_to_strength(guint8 rssi) {
+	return rssi != 0 ? rssi : -1;
+}
 
-	if(!msg || len < 3 || msg[0] != NET_RSSI_IND) {
-		cb(TRUE, 0, user_data);
+static gboolean parse_rssi_ind(struct isi_network *nd, const unsigned char *msg, size_t len) {
+	int strength;
+
+	if(!msg || len < 3 || msg[0] != NET_RSSI_IND)
+		return FALSE;
+
+	strength = rssi_to_strength(msg[1]);
+	g_message("Strength: %d", strength);
+
+	nd->strength = strength;
+	nd->strength_time = isi_now_ms();
+	return TRUE;
+}
+
+static void network_rssi_watch_cb(GIsiClient *client, const void *restrict data, size_t len, uint16_t object, void *opaque) {
+	struct isi_network *nd = opaque;
+	isi_network_strength_cb cb;
+
+	if(!parse_rssi_ind(nd, data, len)) {
+		if(nd->strength_sub) {
+			cb = nd->strength_sub->callback;
+			cb(TRUE, 0, nd->strength_sub->data);
+		}
 		return;
 	}
 
-	g_message("Strength: %d", msg[1]);
-
-	cb(FALSE, msg[1], user_data);
+	if(nd->strength_sub) {
+		cb = nd->strength_sub->callback;
+		cb(FALSE, nd->strength, nd->strength_sub->data);
+	}
 }
 
 gboolean network_rssi_resp_cb(GIsiClient *client, const void *restrict data, size_t len, uint16_t object, void *opaque) {
@@ -233,6 +402,7 @@ gboolean network_rssi_resp_cb(GIsiClient *client, const void *restrict data, siz
 	void *user_data = cbd->data;
 	isi_cb_data_free(cbd);
 
+	struct net_rssi_get_resp resp;
 	GIsiSubBlockIter iter;
 	int strength = -1;
 
@@ -242,14 +412,14 @@ gboolean network_rssi_resp_cb(GIsiClient *client, const void *restrict data, siz
 		return TRUE;
 	}
 
-	if (len < 3 || msg[0] != NET_RSSI_GET_RESP) {
+	if (!net_rssi_get_resp_decode(msg, len, &resp)) {
 		cb(TRUE, 0, user_data);
-		return FALSE;
+		return TRUE;
 	}
 
-	if (msg[1] != NET_CAUSE_OK) {
+	if (resp.cause != NET_CAUSE_OK) {
 		g_warning("Request failed: %s (0x%02X)",
-			net_isi_cause_name(msg[1]), msg[1]);
+			net_isi_cause_name(resp.cause), resp.cause);
 		cb(TRUE, 0, user_data);
 		return TRUE;
 	}
@@ -259,15 +429,15 @@ gboolean network_rssi_resp_cb(GIsiClient *client, const void *restrict data, siz
 	while (g_isi_sb_iter_is_valid(&iter)) {
 		switch (g_isi_sb_iter_get_id(&iter)) {
 			case NET_RSSI_CURRENT: {
-				guint8 rssi = 0;
+				struct net_rssi_current info;
 
-				if (!g_isi_sb_iter_get_byte(&iter, &rssi, 2)) {
-					g_debug("Could not get next byte!");
+				if (!net_rssi_current_decode(&iter, &info)) {
+					g_debug("Truncated RSSI sub-block");
 					cb(TRUE, 0, user_data);
 					return TRUE;
 				}
 
-				strength = rssi != 0 ? rssi : -1;
+				strength = rssi_to_strength(info.rssi);
 				break;
 			}
 
@@ -281,20 +451,45 @@ gboolean network_rssi_resp_cb(GIsiClient *client, const void *restrict data, siz
 	}
 
 	g_message("Strength: %d", strength);
+
+	nd->strength = strength;
+	nd->strength_time = isi_now_ms();
+
 	cb(FALSE, strength, user_data);
 	return TRUE;
 }
 
+static int network_watch_strength(struct isi_network *nd) {
+	int ret;
+
+	if(nd->strength_watch)
+		return 0;
+
+	ret = g_isi_subscribe(nd->client, NET_RSSI_IND, network_rssi_watch_cb, nd);
+	if(!ret)
+		nd->strength_watch = TRUE;
+	return ret;
+}
+
+static void network_unwatch_strength(struct isi_network *nd) {
+	if(!nd->strength_watch || nd->strength_sub || nd->max_age)
+		return;
+
+	g_isi_unsubscribe(nd->client, NET_RSSI_IND);
+	nd->strength_watch = FALSE;
+	nd->strength_time = 0;
+}
+
 void isi_network_request_strength(struct isi_network *nd, isi_network_strength_cb cb, void *user_data) {
-	struct isi_cb_data *cbd = isi_cb_data_new(nd, cb, user_data);
+	struct isi_cb_data *cbd;
+
+	if(snapshot_is_fresh(nd, nd->strength_time) &&
+			snapshot_answer(nd, &nd->strength_waiters, cb, user_data))
+		return;
 
-	const unsigned char msg[] = {
-		NET_RSSI_GET_REQ,
-		NET_CS_GSM,
-		NET_CURRENT_CELL_RSSI
-	};
+	cbd = isi_cb_data_new(nd, cb, user_data);
 
-	if(cbd && g_isi_request_make(nd->client, msg, sizeof(msg), NETWORK_TIMEOUT, network_rssi_resp_cb, cbd))
+	if(cbd && g_isi_request_make(nd->client, net_rssi_get_req, sizeof(net_rssi_get_req), NETWORK_TIMEOUT, network_rssi_resp_cb, cbd))
 		return;
 
 	cb(TRUE, 0, user_data);
@@ -303,14 +498,32 @@ void isi_network_request_strength(struct isi_network *nd, isi_network_strength_c
 
 void isi_network_subscribe_strength(struct isi_network *nd, isi_network_strength_cb cb, void *user_data) {
 	struct isi_cb_data *cbd = isi_cb_data_new(nd, cb, user_data);
-	if(!cbd || g_isi_subscribe(nd->client, NET_RSSI_IND, network_rssi_ind_cb, cbd)) {
+	if(!cbd || network_watch_strength(nd)) {
 		isi_cb_data_free(cbd);
 		cb(TRUE, 0, user_data);
+		return;
 	}
+
+	isi_cb_data_free(nd->strength_sub);
+	nd->strength_sub = cbd;
 }
 
 void isi_network_unsubscribe_strength(struct isi_network *nd) {
-	g_isi_unsubscribe(nd->client, NET_RSSI_IND);
+	isi_cb_data_free(nd->strength_sub);
+	nd->strength_sub = NULL;
+	network_unwatch_strength(nd);
+}
+
+void isi_network_set_status_max_age(struct isi_network *nd, unsigned max_age) {
+	nd->max_age = max_age;
+
+	if(max_age) {
+		network_watch_status(nd);
+		network_watch_strength(nd);
+	} else {
+		network_unwatch_status(nd);
+		network_unwatch_strength(nd);
+	}
 }
 
 void network_reachable_cb(GIsiClient *client, gboolean alive, uint16_t object, void *user_data) {
@@ -339,10 +552,14 @@ struct isi_network* isi_network_create(struct isi_modem *modem, isi_subsystem_re
 	if(!nd || !cbd || !modem->idx)
 		goto error;
 
-	nd->client = g_isi_client_create(modem->idx, PN_NETWORK);
+	nd->modem = modem;
+	nd->client = isi_modem_client_create(modem, PN_NETWORK);
 	if(!nd->client)
 		goto error;
 
+	g_isi_client_set_coalesce_id(nd->client, NET_REG_STATUS_GET_REQ, TRUE);
+	g_isi_client_set_coalesce_id(nd->client, NET_RSSI_GET_REQ, TRUE);
+
 	g_isi_verify(nd->client, network_reachable_cb, cbd);
 
 	return nd;
@@ -355,10 +572,25 @@ struct isi_network* isi_network_create(struct isi_modem *modem, isi_subsystem_re
 		return NULL;
 }
 
+void isi_network_set_cell_stream(struct isi_network *nd, struct isi_cell_stream *stream) {
+	nd->cells = stream;
+
+	if(stream)
+		network_watch_status(nd);
+	else
+		network_unwatch_status(nd);
+}
+
 void isi_network_destroy(struct isi_network *nd) {
 	if(!nd)
 		return;
 	g_isi_client_destroy(nd->client);
+	if(nd->snapshot_source)
+		g_isi_source_remove(nd->modem->context, nd->snapshot_source);
+	snapshot_waiters_free(nd->status_waiters);
+	snapshot_waiters_free(nd->strength_waiters);
+	isi_cb_data_free(nd->status_sub);
+	isi_cb_data_free(nd->strength_sub);
 	free(nd);
 }
 
@@ -367,17 +599,18 @@ gboolean set_manual_resp_cb(GIsiClient *client, const void *restrict data, size_
 	struct isi_cb_data *cbd = user_data;
 	struct isi_network *nd = cbd->subsystem;
 	isi_network_register_cb cb = cbd->callback;
+	struct net_set_resp resp;
 
 	if(!msg) {
 		g_warning("ISI client error: %d", g_isi_client_error(client));
 		goto error;
 	}
 
-	if(len < 3 || msg[0] != NET_SET_RESP)
+	if(!net_set_resp_decode(msg, len, &resp))
 		goto error;
 
-	if(msg[1] != NET_CAUSE_OK) {
-		g_warning("Request failed: %s", net_isi_cause_name(msg[1]));
+	if(resp.cause != NET_CAUSE_OK) {
+		g_warning("Request failed: %s", net_isi_cause_name(resp.cause));
 		goto error;
 	}
 
@@ -398,17 +631,18 @@ gboolean set_auto_resp_cb(GIsiClient *client, const void *restrict data, size_t
 	struct isi_cb_data *cbd = user_data;
 	struct isi_network *nd = cbd->subsystem;
 	isi_network_register_cb cb = cbd->callback;
+	struct net_set_resp resp;
 
 	if(!msg) {
 		g_warning("ISI client error: %d", g_isi_client_error(client));
 		goto error;
 	}
 
-	if(!msg || len < 3 || msg[0] != NET_SET_RESP)
+	if(!net_set_resp_decode(msg, len, &resp))
 		goto error;
 
-	if(msg[1] != NET_CAUSE_OK) {
-		g_debug("Request failed: %s", net_isi_cause_name(msg[1]));
+	if(resp.cause != NET_CAUSE_OK) {
+		g_debug("Request failed: %s", net_isi_cause_name(resp.cause));
 		goto error;
 	}
 
@@ -427,45 +661,31 @@ out:
 void isi_network_register_manual(struct isi_network *nd, const char *mcc, const char *mnc, isi_network_register_cb cb, void *data) {
 	struct isi_cb_data *cbd = isi_cb_data_new(nd, cb, data);
 
-	/* generate bcd */
-	char bcd[3];
-	bcd[0] = (mcc[0] - '0') | (mcc[1] - '0') << 4;
-	bcd[1] = (mcc[2] - '0');
-	bcd[1] |= (mnc[2] == '\0' ? 0x0f : (mnc[2] - '0')) << 4;
-	bcd[2] = (mnc[0] - '0') | (mnc[1] - '0') << 4;
-
-	const unsigned char msg[] = {
-		NET_SET_REQ,
-		0x00,  /* Registered in another protocol? */
-		0x02,  /* Sub-block count */
-		NET_OPERATOR_INFO_COMMON,
-		0x04,  /* Sub-block length */
-		NET_SELECT_MODE_MANUAL,
-		0x00,  /* Index not used */
-		NET_GSM_OPERATOR_INFO,
-		0x08,  /* Sub-block length */
-		bcd[0], bcd[1], bcd[2],
-		NET_GSM_BAND_INFO_NOT_AVAIL,  /* Pick any supported band */
-		0x00, 0x00  /* Filler */
-	};
-
-	g_isi_request_make(nd->client, msg, sizeof(msg), NETWORK_SET_TIMEOUT, set_manual_resp_cb, cbd);
+	uint8_t msg[net_set_manual_req_len];
+	struct net_set_manual_req req;
+
+	memset(&req, 0, sizeof(req));
+	strncpy(req.code.mcc, mcc, sizeof(req.code.mcc) - 1);
+	strncpy(req.code.mnc, mnc, sizeof(req.code.mnc) - 1);
+	net_set_manual_req_pack(msg, &req);
+
+	if(cbd && g_isi_request_make(nd->client, msg, sizeof(msg), NETWORK_SET_TIMEOUT, set_manual_resp_cb, cbd))
+		return;
+
+	cb(TRUE, data);
+	isi_cb_data_free(cbd);
 }
 
 void isi_network_register_auto(struct isi_network *nd, isi_network_register_cb cb, void *data) {
 	struct isi_cb_data *cbd = isi_cb_data_new(nd, cb, data);
 
-	const unsigned char msg[] = {
-		NET_SET_REQ,
-		0x00,  /* Registered in another protocol? */
-		0x01,  /* Sub-block count */
-		NET_OPERATOR_INFO_COMMON,
-		0x04,  /* Sub-block length */
-		nd->last_reg_mode == NET_SELECT_MODE_AUTOMATIC
+	uint8_t msg[net_set_auto_req_len];
+	struct net_set_auto_req req;
+
+	req.mode = nd->last_reg_mode == NET_SELECT_MODE_AUTOMATIC
 			? NET_SELECT_MODE_USER_RESELECTION
-			: NET_SELECT_MODE_AUTOMATIC,
-		0x00  /* Index not used */
-	};
+			: NET_SELECT_MODE_AUTOMATIC;
+	net_set_auto_req_pack(msg, &req);
 
 	if(cbd && g_isi_request_make(nd->client, msg, sizeof(msg), NETWORK_SET_TIMEOUT, set_auto_resp_cb, cbd))
 		return;
@@ -485,6 +705,7 @@ gboolean name_get_resp_cb(GIsiClient *client, const void *restrict data, size_t
 	struct isi_cb_data *cbd = user_data;
 	isi_network_operator_cb cb = cbd->callback;
 
+	struct net_oper_name_read_resp resp;
 	struct network_operator op;
 	GIsiSubBlockIter iter;
 
@@ -495,33 +716,35 @@ gboolean name_get_resp_cb(GIsiClient *client, const void *restrict data, size_t
 		goto error;
 	}
 
-	if(len < 3 || msg[0] != NET_OPER_NAME_READ_RESP)
+	if(!net_oper_name_read_resp_decode(msg, len, &resp))
 		return FALSE;
 
-	if(msg[1] != NET_CAUSE_OK) {
-		g_warning("Request failed: %s", net_isi_cause_name(msg[1]));
+	if(resp.cause != NET_CAUSE_OK) {
+		g_warning("Request failed: %s", net_isi_cause_name(resp.cause));
 		goto error;
 	}
 
-	g_isi_sb_iter_init(&iter, msg, len, 7);
+	g_isi_sb_iter_init(&iter, msg, len, net_oper_name_read_resp_len);
 
 	while(g_isi_sb_iter_is_valid(&iter)) {
 		switch(g_isi_sb_iter_get_id(&iter)) {
-			case NET_GSM_OPERATOR_INFO:
-				if(!g_isi_sb_iter_get_oper_code(&iter, op.mcc, op.mnc, 2))
+			case NET_GSM_OPERATOR_INFO: {
+				struct net_gsm_operator_info info;
+
+				if(!net_gsm_operator_info_decode(&iter, &info))
 					goto error;
+
+				memcpy(op.mcc, info.code.mcc, sizeof(op.mcc));
+				memcpy(op.mnc, info.code.mnc, sizeof(op.mnc));
 				break;
+			}
 			case NET_OPER_NAME_INFO: {
-				char *tag = NULL;
-				guint8 taglen = 0;
+				struct net_oper_name_info info;
 
-				if(!g_isi_sb_iter_get_byte(&iter, &taglen, 3)
-					|| !g_isi_sb_iter_get_alpha_tag(&iter, &tag, taglen * 2, 4))
+				if(!net_oper_name_info_decode(&iter, &info)
+					|| !g_isi_sb_iter_get_alpha_tag_buf(&iter, op.name, sizeof(op.name),
+						info.tag_len * 2, net_oper_name_info_len))
 					goto error;
-
-				strncpy(op.name, tag, ISI_MAX_OPERATOR_NAME_LENGTH);
-				op.name[ISI_MAX_OPERATOR_NAME_LENGTH] = '\0';
-				g_free(tag);
 				break;
 			}
 			default:
@@ -537,6 +760,7 @@ gboolean name_get_resp_cb(GIsiClient *client, const void *restrict data, size_t
 	goto out;
 
 error:
+	g_isi_response_uncacheable(client);
 	cb(TRUE, NULL, cbd->data);
 
 out:
@@ -547,14 +771,11 @@ out:
 void isi_network_current_operator(struct isi_network *nd, isi_network_operator_cb cb, void *data) {
 	struct isi_cb_data *cbd = isi_cb_data_new(nd, cb, data);
 
-	const unsigned char msg[] = {
-		NET_OPER_NAME_READ_REQ,
-		NET_HARDCODED_LATIN_OPER_NAME,
-		ISI_MAX_OPERATOR_NAME_LENGTH,
-		0x00, 0x00,  /* Index not used */
-		0x00,  /* Filler */
-		0x00  /* No sub-blocks */
-	};
+	uint8_t msg[net_oper_name_read_req_len];
+	struct net_oper_name_read_req req;
+
+	req.max_len = ISI_MAX_OPERATOR_NAME_LENGTH;
+	net_oper_name_read_req_pack(msg, &req);
 
 	if(cbd && g_isi_request_make(nd->client, msg, sizeof(msg), NETWORK_TIMEOUT, name_get_resp_cb, cbd))
 		return;
@@ -563,82 +784,147 @@ void isi_network_current_operator(struct isi_network *nd, isi_network_operator_c
 	isi_cb_data_free(cbd);
 }
 
-gboolean available_resp_cb(GIsiClient *client, const void *restrict data, size_t len, uint16_t object, void *user_data) {
+typedef void (*network_operator_yield)(struct network_operator *op, void *opaque);
+
+/* move iter to the next sub-block with id, FALSE if there is none */
+static gboolean available_seek(GIsiSubBlockIter *iter, int id) {
+	while(g_isi_sb_iter_is_valid(iter)) {
+		if(g_isi_sb_iter_get_id(iter) == id)
+			return TRUE;
+		g_isi_sb_iter_next(iter);
+	}
+
+	return FALSE;
+}
+
+/* decode the operators of a NET_AVAILABLE_GET_RESP into ops, or one by one
+ * if ops is NULL. The two sub-blocks of an operator may be apart, so one
+ * iterator walks the common and another the detailed ones in lockstep,
+ * each operator is yielded (if yield is set) once both are decoded. */
+static gboolean available_parse(const unsigned char *msg, size_t len, int total, struct network_operator *ops, network_operator_yield yield, void *opaque) {
+	GIsiSubBlockIter common;
+	GIsiSubBlockIter detail;
+	struct network_operator single;
+	int n;
+
+	g_isi_sb_iter_init(&common, msg, len, net_available_get_resp_len);
+	detail = common;
+
+	for(n = 0; n < total; n++) {
+		struct network_operator *op = ops ? ops + n : &single;
+		struct net_avail_network_info_common cinfo;
+		struct net_detailed_network_info dinfo;
+
+		if(!available_seek(&common, NET_AVAIL_NETWORK_INFO_COMMON)
+			|| !available_seek(&detail, NET_DETAILED_NETWORK_INFO))
+			return FALSE;
+
+		if(!net_avail_network_info_common_decode(&common, &cinfo)
+			|| !g_isi_sb_iter_get_alpha_tag_buf(&common, op->name, sizeof(op->name),
+				cinfo.tag_len * 2, net_avail_network_info_common_len))
+			return FALSE;
+
+		if(!net_detailed_network_info_decode(&detail, &dinfo))
+			return FALSE;
+
+		op->status = cinfo.status;
+		memcpy(op->mcc, dinfo.code.mcc, sizeof(op->mcc));
+		memcpy(op->mnc, dinfo.code.mnc, sizeof(op->mnc));
+		op->technology = dinfo.umts ? NET_TECHNOLOGY_UMTS : NET_TECHNOLOGY_EPGRS;
+
+		if(yield)
+			yield(op, opaque);
+
+		g_isi_sb_iter_next(&common);
+		g_isi_sb_iter_next(&detail);
+	}
+
+	/* more operators than announced */
+	return !available_seek(&common, NET_AVAIL_NETWORK_INFO_COMMON)
+		&& !available_seek(&detail, NET_DETAILED_NETWORK_INFO);
+}
+
+static void available_scan_yield(struct network_operator *op, void *opaque) {
+	struct isi_cb_data *cbd = opaque;
+	isi_network_operator_scan_cb cb = cbd->callback;
+
+	cb(FALSE, op, cbd->data);
+}
+
+gboolean available_scan_resp_cb(GIsiClient *client, const void *restrict data, size_t len, uint16_t object, void *user_data) {
 	const unsigned char *msg = data;
 	struct isi_cb_data *cbd = user_data;
-	isi_network_operator_list_cb cb = cbd->callback;
-	struct network_operator *list = NULL;
-	int total = 0;
-
-	GIsiSubBlockIter iter;
-	int common = 0;
-	int detail = 0;
+	isi_network_operator_scan_cb cb = cbd->callback;
+	struct net_available_get_resp resp;
 
 	if(!msg) {
 		g_warning("ISI client error: %d", g_isi_client_error(client));
 		goto error;
 	}
 
-	if(len < 3 || msg[0] != NET_AVAILABLE_GET_RESP)
+	if(!net_available_get_resp_decode(msg, len, &resp))
 		return FALSE;
 
-	if(msg[1] != NET_CAUSE_OK) {
-		g_warning("Request failed: %s", net_isi_cause_name(msg[1]));
+	if(resp.cause != NET_CAUSE_OK) {
+		g_warning("Request failed: %s", net_isi_cause_name(resp.cause));
 		goto error;
 	}
 
 	/* Each description of an operator has a pair of sub-blocks */
-	total = msg[2] / 2;
-	list = alloca(total * sizeof(struct network_operator));
+	if(!available_parse(msg, len, resp.sub_blocks / 2, NULL, available_scan_yield, cbd))
+		goto error;
 
-	g_isi_sb_iter_init(&iter, msg, len, 3);
+	cb(FALSE, NULL, cbd->data);
+	goto out;
 
-	while(g_isi_sb_iter_is_valid(&iter)) {
-		switch(g_isi_sb_iter_get_id(&iter)) {
-			case NET_AVAIL_NETWORK_INFO_COMMON: {
-				struct network_operator *op;
-				char *tag = NULL;
-				guint8 taglen = 0;
-				guint8 status = 0;
+error:
+	cb(TRUE, NULL, cbd->data);
 
-				if (!g_isi_sb_iter_get_byte(&iter, &status, 2))
-					goto error;
+out:
+	isi_cb_data_free(cbd);
+	return TRUE;
+}
 
-				if (!g_isi_sb_iter_get_byte(&iter, &taglen, 5))
-					goto error;
+void isi_network_scan_operators(struct isi_network *nd, isi_network_operator_scan_cb cb, void *data) {
+	struct isi_cb_data *cbd = isi_cb_data_new(nd, cb, data);
 
-				if (!g_isi_sb_iter_get_alpha_tag(&iter, &tag, taglen * 2, 6))
-					goto error;
+	if(cbd && g_isi_request_make(nd->client, net_available_get_req, sizeof(net_available_get_req), NETWORK_SCAN_TIMEOUT, available_scan_resp_cb, cbd))
+		return;
 
-				op = list + common++;
-				op->status = status;
+	cb(TRUE, NULL, data);
+	isi_cb_data_free(cbd);
+}
 
-				strncpy(op->name, tag, ISI_MAX_OPERATOR_NAME_LENGTH);
-				op->name[ISI_MAX_OPERATOR_NAME_LENGTH] = '\0';
-				g_free(tag);
-				break;
-			}
-			case NET_DETAILED_NETWORK_INFO: {
-				struct network_operator *op;
-				uint8_t umts = 0;
+gboolean available_resp_cb(GIsiClient *client, const void *restrict data, size_t len, uint16_t object, void *user_data) {
+	const unsigned char *msg = data;
+	struct isi_cb_data *cbd = user_data;
+	isi_network_operator_list_cb cb = cbd->callback;
+	struct network_operator *ops = NULL;
+	int total = 0;
 
-				op = list + detail++;
-				if (!g_isi_sb_iter_get_oper_code(&iter, op->mcc, op->mnc, 2) || !g_isi_sb_iter_get_byte(&iter, &umts, 7))
-					goto error;
-				op->technology = umts ? NET_TECHNOLOGY_UMTS : NET_TECHNOLOGY_EPGRS;
-				break;
-			}
-			default:
-				g_debug("Skipping sub-block: %s (%zu bytes)",
-					net_subblock_name(g_isi_sb_iter_get_id(&iter)),
-					g_isi_sb_iter_get_len(&iter));
-				break;
-		}
-		g_isi_sb_iter_next(&iter);
+	struct net_available_get_resp resp;
+
+	if(!msg) {
+		g_warning("ISI client error: %d", g_isi_client_error(client));
+		goto error;
 	}
 
-	if (common == detail && detail == total) {
-		cb(FALSE, list, total, cbd->data);
+	if(!net_available_get_resp_decode(msg, len, &resp))
+		return FALSE;
+
+	if(resp.cause != NET_CAUSE_OK) {
+		g_warning("Request failed: %s", net_isi_cause_name(resp.cause));
+		goto error;
+	}
+
+	/* Each description of an operator has a pair of sub-blocks */
+	total = resp.sub_blocks / 2;
+	ops = g_try_new0(struct network_operator, MAX(total, 1));
+	if(!ops)
+		goto error;
+
+	if (available_parse(msg, len, total, ops, NULL, NULL)) {
+		cb(FALSE, ops, total, cbd->data);
 		goto out;
 	}
 
@@ -646,6 +932,7 @@ error:
 	cb(TRUE, NULL, 0, cbd->data);
 
 out:
+	g_free(ops);
 	isi_cb_data_free(cbd);
 	return TRUE;
 }
@@ -653,20 +940,20 @@ out:
 void isi_network_list_operators(struct isi_network *nd, isi_network_operator_list_cb cb, void *data) {
 	struct isi_cb_data *cbd = isi_cb_data_new(nd, cb, data);
 
-	const unsigned char msg[] = {
-		NET_AVAILABLE_GET_REQ,
-		NET_MANUAL_SEARCH,
-		0x01,  /* Sub-block count */
-		NET_GSM_BAND_INFO,
-		0x04,  /* Sub-block length */
-		NET_GSM_BAND_ALL_SUPPORTED_BANDS,
-		0x00
-	};
-
-	if(cbd && g_isi_request_make(nd->client, msg, sizeof(msg), NETWORK_SCAN_TIMEOUT, available_resp_cb, cbd))
+	if(cbd && g_isi_request_make(nd->client, net_available_get_req, sizeof(net_available_get_req), NETWORK_SCAN_TIMEOUT, available_resp_cb, cbd))
 		return;
 
-error:
 	cb(TRUE, NULL, 0, data);
 	isi_cb_data_free(cbd);
 }
+
+void isi_network_set_cache_ttl(struct isi_network *nd, unsigned ttl) {
+	g_isi_cache_set_ttl(nd->client, NET_OPER_NAME_READ_REQ, ttl);
+	g_isi_cache_set_ttl(nd->client, NET_COMMON_MESSAGE, ttl);
+
+	if(ttl && !nd->cache_watch) {
+		/* a new registration may well mean a new operator */
+		if(!g_isi_cache_invalidate_on(nd->client, NET_REG_STATUS_IND, NET_OPER_NAME_READ_REQ))
+			nd->cache_watch = TRUE;
+	}
+}
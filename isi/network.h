@@ -3,6 +3,7 @@
 #include "opcodes/network.h"
 #include "gisi/client.h"
 #include "modem.h"
+#include "cell.h"
 
 #ifndef _ISI_NETWORK_H
 #define _ISI_NETWORK_H
@@ -28,10 +29,32 @@ struct network_operator {
 };
 
 struct isi_network {
+	struct isi_modem *modem;
 	GIsiClient *client;
 	guint8 last_reg_mode;
 	guint8 rat;
 	guint8 gsm_compact;
+	gboolean cache_watch;
+
+	/* last known state, updated from responses and indications */
+	struct network_status status;
+	guint64 status_time;
+	guint8 strength;
+	guint64 strength_time;
+	unsigned max_age;
+	gboolean status_watch;
+	gboolean strength_watch;
+	struct isi_cb_data *status_sub;
+	struct isi_cb_data *strength_sub;
+
+	/* requests answered from the snapshot, called back from idle */
+	guint snapshot_source;
+	GSList *status_waiters;
+	GSList *strength_waiters;
+
+	/* full cell id, status.cid only has the lower 16 bit */
+	guint32 cell_id;
+	struct isi_cell_stream *cells;
 };
 
 /* callbacks */
@@ -40,6 +63,7 @@ typedef void (*isi_network_strength_cb)(gboolean error, guint8 strength, void *d
 typedef void (*isi_network_register_cb)(gboolean error, void *data);
 typedef void (*isi_network_operator_cb)(gboolean error, struct network_operator *something, void *data);
 typedef void (*isi_network_operator_list_cb)(gboolean error, struct network_operator *list, int total, void *data);
+typedef void (*isi_network_operator_scan_cb)(gboolean error, struct network_operator *op, void *data);
 
 /* subsystem */
 struct isi_network* isi_network_create(struct isi_modem *modem, isi_subsystem_reachable_cb cb, void *data);
@@ -64,4 +88,22 @@ void isi_network_deregister(struct isi_network *nd, isi_network_register_cb cb,
 void isi_network_current_operator(struct isi_network *nd, isi_network_operator_cb cb, void *data);
 void isi_network_list_operators(struct isi_network *nd, isi_network_operator_list_cb cb, void *data);
 
+/* like isi_network_list_operators, but each operator is passed as soon as
+ * it is decoded. The callback gets op == NULL once the scan is complete,
+ * or error on failure, after which no more operators follow. op is only
+ * valid during the callback. */
+void isi_network_scan_operators(struct isi_network *nd, isi_network_operator_scan_cb cb, void *data);
+
+/* answer repeated operator queries from a cache for ttl seconds, 0 disables it */
+void isi_network_set_cache_ttl(struct isi_network *nd, unsigned ttl);
+
+/* answer status and strength requests from the last known state while it is
+ * younger than max_age milliseconds, 0 disables it. Local answers come from
+ * an idle source like remote ones, callbacks never run re-entrantly. */
+void isi_network_set_status_max_age(struct isi_network *nd, unsigned max_age);
+
+/* add every serving cell change to stream, NULL detaches. Keeps the
+ * registration status watched while set. */
+void isi_network_set_cell_stream(struct isi_network *nd, struct isi_cell_stream *stream);
+
 #endif
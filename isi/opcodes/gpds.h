@@ -34,6 +34,8 @@ extern "C" {
 
 #define PN_GPDS					0x31
 #define PN_PEP_TYPE_GPRS			0x04
+#define PN_PEP_TYPE_COMMON			0x00
+#define PN_OBJ_PEP_GPRS				0x30
 
 enum gpds_message_id {
 	GPDS_LL_CONFIGURE_REQ =			0x00,
@@ -231,6 +233,64 @@ enum gpds_attach_status {
 	GPDS_ATTACHED =				0x01
 };
 
+/*
+ * Message and sub-block layouts, expanded by ISI_MSG_DEFINE and
+ * ISI_SB_DEFINE from descriptor.h. Offsets count from the message id
+ * or from the start of the sub-block header respectively.
+ */
+#define GPDS_CONTEXT_ID_CREATE_REQ_LEN	1
+#define GPDS_CONTEXT_ID_CREATE_REQ_LAYOUT(F, C, X)
+
+#define GPDS_LL_CONFIGURE_REQ_LEN	4
+#define GPDS_LL_CONFIGURE_REQ_LAYOUT(F, C, X) \
+	F(X, cid, byte, 1) \
+	F(X, pipe, byte, 2) \
+	C(X, byte, 3, GPDS_LL_PLAIN)
+
+/* followed by the APN_INFO sub-block */
+#define GPDS_CONTEXT_CONFIGURE_REQ_LEN	11
+#define GPDS_CONTEXT_CONFIGURE_REQ_LAYOUT(F, C, X) \
+	F(X, cid, byte, 1) \
+	F(X, pdp_type, byte, 2) \
+	C(X, byte, 3, GPDS_CONT_TYPE_NORMAL) \
+	F(X, primary, byte, 4) \
+	C(X, byte, 6, 2)				/* sub-block count */ \
+	C(X, byte, 7, GPDS_DNS_ADDRESS_REQ_INFO) \
+	C(X, byte, 8, 4)
+
+/* followed by the USER_NAME_INFO and PASSWORD_INFO sub-blocks */
+#define GPDS_CONTEXT_AUTH_REQ_LEN	3
+#define GPDS_CONTEXT_AUTH_REQ_LAYOUT(F, C, X) \
+	F(X, cid, byte, 1) \
+	C(X, byte, 2, 2)				/* sub-block count */
+
+#define GPDS_CONTEXT_ACTIVATE_REQ_LEN	3
+#define GPDS_CONTEXT_ACTIVATE_REQ_LAYOUT(F, C, X) \
+	F(X, cid, byte, 1)
+
+#define GPDS_CONTEXT_REQ_LEN		2
+#define GPDS_CONTEXT_REQ_LAYOUT(F, C, X) \
+	F(X, cid, byte, 1)
+
+/* Common header of the context responses: context id and status */
+#define GPDS_CONTEXT_RESP_LEN		3
+#define GPDS_CONTEXT_RESP_LAYOUT(F, C, X) \
+	F(X, cid, byte, 1) \
+	F(X, status, byte, 2)
+
+/* Data counters of CONTEXT_STATUS_RESP and _IND, not verified against
+ * modem firmware */
+#define GPDS_CONTEXT_STATUS_LEN		10
+#define GPDS_CONTEXT_STATUS_LAYOUT(F, C, X) \
+	F(X, cid, byte, 1) \
+	F(X, tx_bytes, dword, 2) \
+	F(X, rx_bytes, dword, 6)
+
+/* PDP_ADDRESS_INFO, PDNS_ADDRESS_INFO and SDNS_ADDRESS_INFO */
+#define GPDS_ADDRESS_INFO_LEN		4
+#define GPDS_ADDRESS_INFO_LAYOUT(F, C, X) \
+	F(X, addr_len, byte, 3)
+
 #ifdef __cplusplus
 };
 #endif
@@ -40,12 +40,93 @@ enum gps_data_subpkg_id {
 	GPS_CELL_INFO_WCDMA	= 0x08
 };
 
+enum gps_power_state {
+	GPS_POWER_OFF		= 0x00,
+	GPS_POWER_ON		= 0x01
+};
+
 enum gps_status {
 	GPS_DISABLED		= 0x00,
 	GPS_NOT_LOCKED		= 0x01,
 	GPS_LOCKED			= 0x02
 };
 
+/* GPS_POWER_REQ carries no more than the state, the response is only
+ * checked for its id (taken from traces, not documented) */
+#define GPS_POWER_REQ_LEN		3
+#define GPS_POWER_REQ_LAYOUT(F, C, X) \
+	F(X, state, byte, 1)
+
+#define GPS_POWER_RESP_LEN		1
+#define GPS_POWER_RESP_LAYOUT(F, C, X)
+
+/* GPS_DATA_IND, sub-blocks have 16 bit id and length and start at byte 11 */
+#define GPS_DATA_IND_LEN		11
+#define GPS_DATA_IND_LAYOUT(F, C, X) \
+	F(X, sub_blocks, byte, 7)
+
+#define GPS_STATUS_IND_LEN		3
+#define GPS_STATUS_IND_LAYOUT(F, C, X) \
+	F(X, status, byte, 2)
+
+/* latitude and longitude in 1/2^32 of a full circle, eph in cm,
+ * altitude and its correction in half meters */
+#define GPS_DATA_POSITION_LEN		28
+#define GPS_DATA_POSITION_LAYOUT(F, C, X) \
+	F(X, latitude, dword, 4) \
+	F(X, longitude, dword, 8) \
+	F(X, eph, dword, 16) \
+	F(X, altitude, word, 22) \
+	F(X, epv, word, 24) \
+	F(X, altitude_correction, word, 26)
+
+/* milliseconds at 12 */
+#define GPS_TIME_DATE_LEN		14
+#define GPS_TIME_DATE_LAYOUT(F, C, X) \
+	F(X, year, word, 4) \
+	F(X, month, byte, 6) \
+	F(X, day, byte, 7) \
+	F(X, hour, byte, 9) \
+	F(X, minute, byte, 10) \
+	F(X, msec, word, 12)
+
+/* course in 1/100 degree, speed and climb in cm/s */
+#define GPS_MOVEMENT_LEN		18
+#define GPS_MOVEMENT_LAYOUT(F, C, X) \
+	F(X, course, word, 4) \
+	F(X, epd, word, 6) \
+	F(X, speed, word, 10) \
+	F(X, eps, word, 12) \
+	F(X, climb, word, 14) \
+	F(X, epc, word, 16)
+
+/* followed by GPS_SATELLITE_LEN bytes per satellite from byte 8 */
+#define GPS_SATELLITE_INFO_LEN		8
+#define GPS_SATELLITE_INFO_LAYOUT(F, C, X) \
+	F(X, count, byte, 4)
+
+/* signal strength, elevation and azimuth in 1/100 */
+#define GPS_SATELLITE_LEN		12
+#define GPS_SATELLITE_LAYOUT(F, C, X) \
+	F(X, prn, byte, 1) \
+	F(X, used, byte, 2) \
+	F(X, strength, word, 3) \
+	F(X, elevation, word, 6) \
+	F(X, azimuth, word, 8)
+
+#define GPS_CELL_INFO_GSM_LEN		12
+#define GPS_CELL_INFO_GSM_LAYOUT(F, C, X) \
+	F(X, mcc, word, 4) \
+	F(X, mnc, word, 6) \
+	F(X, lac, word, 8) \
+	F(X, cid, word, 10)
+
+#define GPS_CELL_INFO_WCDMA_LEN		12
+#define GPS_CELL_INFO_WCDMA_LAYOUT(F, C, X) \
+	F(X, mcc, word, 4) \
+	F(X, mnc, word, 6) \
+	F(X, ucid, dword, 8)
+
 #ifdef __cplusplus
 };
 #endif
@@ -67,6 +67,28 @@ enum info_version_type {
 	INFO_MCUSW = 0x01
 };
 
+
+/* Layouts for ISI_MSG_DEFINE and ISI_SB_DEFINE from descriptor.h */
+#define INFO_PRODUCT_INFO_READ_REQ_LEN	2
+#define INFO_PRODUCT_INFO_READ_REQ_LAYOUT(F, C, X) \
+	F(X, type, byte, 1)
+
+#define INFO_VERSION_READ_REQ_LEN	7
+#define INFO_VERSION_READ_REQ_LAYOUT(F, C, X) \
+	F(X, type, word, 1)
+
+#define INFO_SERIAL_NUMBER_READ_REQ_LEN	2
+#define INFO_SERIAL_NUMBER_READ_REQ_LAYOUT(F, C, X) \
+	F(X, type, byte, 1)
+
+/* Status and sub-block count precede the sub-blocks of every response */
+#define INFO_RESP_LEN			3
+
+/* All string sub-blocks: length at 3, Latin-1 text from 4 on */
+#define INFO_SB_STRING_LEN		4
+#define INFO_SB_STRING_LAYOUT(F, C, X) \
+	F(X, chars, byte, 3)
+
 #ifdef __cplusplus
 };
 #endif
@@ -212,6 +212,97 @@ enum net_isi_cause {
 	NET_CAUSE_NOT_SUPPORTED_IN_TECH = 0x17
 };
 
+
+/*
+ * Message and sub-block layouts, expanded by ISI_MSG_DEFINE and
+ * ISI_SB_DEFINE from descriptor.h. Offsets count from the message id
+ * or from the start of the sub-block header respectively.
+ */
+#define NET_REG_STATUS_GET_REQ_LEN	1
+#define NET_REG_STATUS_GET_REQ_LAYOUT(F, C, X)
+
+#define NET_RSSI_GET_REQ_LEN		3
+#define NET_RSSI_GET_REQ_LAYOUT(F, C, X) \
+	C(X, byte, 1, NET_CS_GSM) \
+	C(X, byte, 2, NET_CURRENT_CELL_RSSI)
+
+#define NET_SET_MANUAL_REQ_LEN		15
+#define NET_SET_MANUAL_REQ_LAYOUT(F, C, X) \
+	C(X, byte, 2, 2)				/* sub-block count */ \
+	C(X, byte, 3, NET_OPERATOR_INFO_COMMON) \
+	C(X, byte, 4, 4) \
+	C(X, byte, 5, NET_SELECT_MODE_MANUAL) \
+	C(X, byte, 7, NET_GSM_OPERATOR_INFO) \
+	C(X, byte, 8, 8) \
+	F(X, code, oper, 9) \
+	C(X, byte, 12, NET_GSM_BAND_INFO_NOT_AVAIL)
+
+#define NET_SET_AUTO_REQ_LEN		7
+#define NET_SET_AUTO_REQ_LAYOUT(F, C, X) \
+	C(X, byte, 2, 1)				/* sub-block count */ \
+	C(X, byte, 3, NET_OPERATOR_INFO_COMMON) \
+	C(X, byte, 4, 4) \
+	F(X, mode, byte, 5)
+
+#define NET_OPER_NAME_READ_REQ_LEN	7
+#define NET_OPER_NAME_READ_REQ_LAYOUT(F, C, X) \
+	C(X, byte, 1, NET_HARDCODED_LATIN_OPER_NAME) \
+	F(X, max_len, byte, 2)
+
+#define NET_AVAILABLE_GET_REQ_LEN	7
+#define NET_AVAILABLE_GET_REQ_LAYOUT(F, C, X) \
+	C(X, byte, 1, NET_MANUAL_SEARCH) \
+	C(X, byte, 2, 1)				/* sub-block count */ \
+	C(X, byte, 3, NET_GSM_BAND_INFO) \
+	C(X, byte, 4, 4) \
+	C(X, byte, 5, NET_GSM_BAND_ALL_SUPPORTED_BANDS)
+
+/* Common header of all responses: cause and sub-block count */
+#define NET_RESP_LEN			3
+#define NET_RESP_LAYOUT(F, C, X) \
+	F(X, cause, byte, 1) \
+	F(X, sub_blocks, byte, 2)
+
+#define NET_OPER_NAME_READ_RESP_LEN	7
+#define NET_OPER_NAME_READ_RESP_LAYOUT(F, C, X) \
+	F(X, cause, byte, 1) \
+	F(X, sub_blocks, byte, 6)
+
+#define NET_REG_INFO_COMMON_LEN		4
+#define NET_REG_INFO_COMMON_LAYOUT(F, C, X) \
+	F(X, status, byte, 2) \
+	F(X, mode, byte, 3)
+
+#define NET_GSM_REG_INFO_LEN		22
+#define NET_GSM_REG_INFO_LAYOUT(F, C, X) \
+	F(X, lac, word, 2) \
+	F(X, cid, dword, 4) \
+	F(X, egprs, byte, 17) \
+	F(X, hsdpa, byte, 20) \
+	F(X, hsupa, byte, 21)
+
+#define NET_RSSI_CURRENT_LEN		3
+#define NET_RSSI_CURRENT_LAYOUT(F, C, X) \
+	F(X, rssi, byte, 2)
+
+#define NET_GSM_OPERATOR_INFO_LEN	5
+#define NET_GSM_OPERATOR_INFO_LAYOUT(F, C, X) \
+	F(X, code, oper, 2)
+
+#define NET_OPER_NAME_INFO_LEN		4
+#define NET_OPER_NAME_INFO_LAYOUT(F, C, X) \
+	F(X, tag_len, byte, 3)
+
+#define NET_AVAIL_NETWORK_INFO_COMMON_LEN 6
+#define NET_AVAIL_NETWORK_INFO_COMMON_LAYOUT(F, C, X) \
+	F(X, status, byte, 2) \
+	F(X, tag_len, byte, 5)
+
+#define NET_DETAILED_NETWORK_INFO_LEN	8
+#define NET_DETAILED_NETWORK_INFO_LAYOUT(F, C, X) \
+	F(X, code, oper, 2) \
+	F(X, umts, byte, 7)
+
 #ifdef __cplusplus
 };
 #endif
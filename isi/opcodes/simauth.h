@@ -91,6 +91,45 @@ enum sim_auth_protection_id {
 	SIM_AUTH_PIN_PROTECTED_STATUS = 0x04
 };
 
+
+/* Layouts for ISI_MSG_DEFINE from descriptor.h, offsets count from the message id */
+#define SIM_AUTH_REQ_LEN		24
+#define SIM_AUTH_REQ_LAYOUT(F, C, X) \
+	F(X, type, byte, 1) \
+	F(X, code, code, 2) \
+	F(X, pin, code, 13)
+
+#define SIM_AUTH_UPDATE_REQ_LEN		44
+#define SIM_AUTH_UPDATE_REQ_LAYOUT(F, C, X) \
+	C(X, byte, 1, SIM_AUTH_REQ_PIN) \
+	F(X, old_pin, code, 2) \
+	F(X, new_pin, code, 13)
+
+#define SIM_AUTH_STATUS_REQ_LEN		3
+#define SIM_AUTH_STATUS_REQ_LAYOUT(F, C, X)
+
+/* The PIN is only sent when changing the protection */
+#define SIM_AUTH_PROTECTED_REQ_LEN	14
+#define SIM_AUTH_PROTECTED_REQ_LAYOUT(F, C, X) \
+	C(X, byte, 1, SIM_AUTH_REQ_PIN) \
+	F(X, status, byte, 2) \
+	F(X, pin, code, 3)
+
+#define SIM_AUTH_RESP_LEN		2
+#define SIM_AUTH_RESP_LAYOUT(F, C, X) \
+	F(X, cause, byte, 1)
+
+#define SIM_AUTH_STATUS_RESP_LEN	3
+#define SIM_AUTH_STATUS_RESP_LAYOUT(F, C, X) \
+	F(X, status, byte, 1) \
+	F(X, substatus, byte, 2)
+
+#define SIM_AUTH_STATUS_IND_LEN		4
+#define SIM_AUTH_STATUS_IND_LAYOUT(F, C, X) \
+	F(X, status, byte, 1) \
+	F(X, type, byte, 2) \
+	F(X, config, byte, 3)
+
 #ifdef __cplusplus
 };
 #endif
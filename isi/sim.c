@@ -96,7 +96,7 @@ struct isi_sim* isi_sim_create(struct isi_modem *modem, isi_subsystem_reachable_
 	if(!nd || !cbd || !modem->idx)
 		goto error;
 
-	nd->client = g_isi_client_create(modem->idx, PN_SIM);
+	nd->client = isi_modem_client_create(modem, PN_SIM);
 	if(!nd->client)
 		goto error;
 
@@ -22,8 +22,21 @@
 #include "modem.h"
 #include "debug.h"
 #include "gisi/iter.h"
+#include "descriptor.h"
 #include "helper.h"
 
+ISI_MSG_DEFINE(sim_auth_req, SIM_AUTH_REQ, SIM_AUTH_REQ_LAYOUT, SIM_AUTH_REQ_LEN)
+ISI_MSG_DEFINE(sim_auth_update_req, SIM_AUTH_UPDATE_REQ, SIM_AUTH_UPDATE_REQ_LAYOUT, SIM_AUTH_UPDATE_REQ_LEN)
+ISI_MSG_DEFINE(sim_auth_protected_req, SIM_AUTH_PROTECTED_REQ, SIM_AUTH_PROTECTED_REQ_LAYOUT, SIM_AUTH_PROTECTED_REQ_LEN)
+ISI_MSG_TEMPLATE(sim_auth_status_req, SIM_AUTH_STATUS_REQ, SIM_AUTH_STATUS_REQ_LAYOUT, SIM_AUTH_STATUS_REQ_LEN)
+
+ISI_MSG_DEFINE(sim_auth_success_resp, SIM_AUTH_SUCCESS_RESP, SIM_AUTH_RESP_LAYOUT, SIM_AUTH_RESP_LEN)
+ISI_MSG_DEFINE(sim_auth_fail_resp, SIM_AUTH_FAIL_RESP, SIM_AUTH_RESP_LAYOUT, SIM_AUTH_RESP_LEN)
+ISI_MSG_DEFINE(sim_auth_update_fail_resp, SIM_AUTH_UPDATE_FAIL_RESP, SIM_AUTH_RESP_LAYOUT, SIM_AUTH_RESP_LEN)
+ISI_MSG_DEFINE(sim_auth_protected_resp, SIM_AUTH_PROTECTED_RESP, SIM_AUTH_RESP_LAYOUT, SIM_AUTH_RESP_LEN)
+ISI_MSG_DEFINE(sim_auth_status_get_resp, SIM_AUTH_STATUS_RESP, SIM_AUTH_STATUS_RESP_LAYOUT, SIM_AUTH_STATUS_RESP_LEN)
+ISI_MSG_DEFINE(sim_auth_status_ind, SIM_AUTH_STATUS_IND, SIM_AUTH_STATUS_IND_LAYOUT, SIM_AUTH_STATUS_IND_LEN)
+
 struct isi_sim_auth* isi_sim_auth_create(struct isi_modem *modem) {
 	struct isi_sim_auth *nd = calloc(sizeof(struct isi_sim_auth), 1);
 
@@ -31,7 +44,7 @@ struct isi_sim_auth* isi_sim_auth_create(struct isi_modem *modem) {
 		return NULL;
 
 	if(modem->idx)
-		nd->client = g_isi_client_create(modem->idx, PN_SIM_AUTH);
+		nd->client = isi_modem_client_create(modem, PN_SIM_AUTH);
 
 	if(nd->client)
 		return nd;
@@ -51,52 +64,52 @@ static gboolean isi_sim_auth_resp_cb(GIsiClient *client, const void *restrict da
 	const unsigned char *msg = data;
 	struct isi_cb_data *cbd = user_data;
 	isi_sim_auth_cb cb = cbd->callback;
+	void *cb_data = cbd->data;
+	struct sim_auth_fail_resp fail;
+	struct sim_auth_success_resp success;
 
+	isi_cb_data_free(cbd);
 
 	if (!msg) {
 		g_debug("ISI client error: %d", g_isi_client_error(client));
+		cb(ISI_SIM_AUTH_ANSWER_ERR_UNKNOWN, cb_data);
 		return TRUE;
 	}
 
-	if(msg[0] == SIM_AUTH_FAIL_RESP) {
-		switch(msg[1]) {
+	if(sim_auth_fail_resp_decode(msg, len, &fail)) {
+		switch(fail.cause) {
 			case SIM_AUTH_ERROR_INVALID_PW:
-				cb(ISI_SIM_AUTH_ANSWER_ERR_INVALID, cbd->data);
+				cb(ISI_SIM_AUTH_ANSWER_ERR_INVALID, cb_data);
 				break;
 			case SIM_AUTH_ERROR_NEED_PUK:
-				cb(ISI_SIM_AUTH_ANSWER_ERR_NEED_PUK, cbd->data);
+				cb(ISI_SIM_AUTH_ANSWER_ERR_NEED_PUK, cb_data);
 				break;
 			default:
-				g_warning("UNKNOWN SIM AUTH RESPONSE: 0x080x%02x", msg[1]);
-				cb(ISI_SIM_AUTH_ANSWER_ERR_UNKNOWN, cbd->data);
+				g_warning("UNKNOWN SIM AUTH RESPONSE: 0x080x%02x", fail.cause);
+				cb(ISI_SIM_AUTH_ANSWER_ERR_UNKNOWN, cb_data);
 				break;
 		}
-	} else if(msg[0] == SIM_AUTH_SUCCESS_RESP) {
-		if(msg[1] == 0x63)
-			cb(ISI_SIM_AUTH_ANSWER_OK, cbd->data);
+	} else if(sim_auth_success_resp_decode(msg, len, &success)) {
+		if(success.cause == 0x63)
+			cb(ISI_SIM_AUTH_ANSWER_OK, cb_data);
 		else {
-			g_warning("UNKNOWN SIM AUTH RESPONSE: 0x080x%02x", msg[1]);
-			cb(ISI_SIM_AUTH_ANSWER_ERR_UNKNOWN, cbd->data);
+			g_warning("UNKNOWN SIM AUTH RESPONSE: 0x080x%02x", success.cause);
+			cb(ISI_SIM_AUTH_ANSWER_ERR_UNKNOWN, cb_data);
 		}
 	} else {
 		g_warning("UNKNOWN SIM AUTH RESPONSE");
 		print_package("SIM_PIN", msg, len);
-		cb(ISI_SIM_AUTH_ANSWER_ERR_UNKNOWN, cbd->data);
+		cb(ISI_SIM_AUTH_ANSWER_ERR_UNKNOWN, cb_data);
 	}
 
+	return TRUE;
 }
 
 void isi_sim_auth_set_pin(struct isi_sim_auth *nd, char *pin, isi_sim_auth_cb cb, void *user_data) {
 	struct isi_cb_data *cbd = isi_cb_data_new(nd, cb, user_data);
 	int len = strlen(pin);
-	int i;
-
-	unsigned char msg[] = {
-		SIM_AUTH_REQ, SIM_AUTH_REQ_PIN,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00
-	};
+	uint8_t msg[sim_auth_req_len];
+	struct sim_auth_req req;
 
 	if(len > SIM_MAX_PIN_LENGTH) {
 		cb(ISI_SIM_AUTH_ANSWER_ERR_PIN_TOO_LONG, user_data);
@@ -104,8 +117,10 @@ void isi_sim_auth_set_pin(struct isi_sim_auth *nd, char *pin, isi_sim_auth_cb cb
 		return;
 	}
 
-	/* insert the PIN into the request */
-	memcpy(msg+2, pin, len);
+	req.type = SIM_AUTH_REQ_PIN;
+	req.code = pin;
+	req.pin = "";
+	sim_auth_req_pack(msg, &req);
 
 	if(!cbd)
 		goto error;
@@ -122,14 +137,8 @@ void isi_sim_auth_set_puk(struct isi_sim_auth *nd, char *puk, char *pin, isi_sim
 	struct isi_cb_data *cbd = isi_cb_data_new(nd, cb, user_data);
 	int puklen = strlen(puk);
 	int pinlen = strlen(pin);
-	int i;
-
-	unsigned char msg[] = {
-		SIM_AUTH_REQ, SIM_AUTH_REQ_PUK,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00
-	};
+	uint8_t msg[sim_auth_req_len];
+	struct sim_auth_req req;
 
 	if(pinlen > SIM_MAX_PIN_LENGTH) {
 		cb(ISI_SIM_AUTH_ANSWER_ERR_PIN_TOO_LONG, user_data);
@@ -143,11 +152,10 @@ void isi_sim_auth_set_puk(struct isi_sim_auth *nd, char *puk, char *pin, isi_sim
 		return;
 	}
 
-	/* insert the PUK into the request */
-	memcpy(msg+2, puk, puklen);
-
-	/* insert the PIN into the request */
-	memcpy(msg+13, pin, pinlen);
+	req.type = SIM_AUTH_REQ_PUK;
+	req.code = puk;
+	req.pin = pin;
+	sim_auth_req_pack(msg, &req);
 
 	if(!cbd)
 		goto error;
@@ -164,11 +172,14 @@ static gboolean isi_sim_auth_update_resp_cb(GIsiClient *client, const void *rest
 	const unsigned char *msg = data;
 	struct isi_cb_data *cbd = user_data;
 	isi_sim_auth_cb cb = cbd->callback;
-	isi_cb_data_free(cbd);
+	struct sim_auth_update_fail_resp fail;
 
+	user_data = cbd->data;
+	isi_cb_data_free(cbd);
 
-	if (!msg) {
+	if (!msg || len < 1) {
 		g_debug("ISI client error: %d", g_isi_client_error(client));
+		cb(ISI_SIM_AUTH_ANSWER_ERR_UNKNOWN, user_data);
 		return TRUE;
 	}
 
@@ -177,7 +188,10 @@ static gboolean isi_sim_auth_update_resp_cb(GIsiClient *client, const void *rest
 			cb(ISI_SIM_AUTH_ANSWER_OK, user_data);
 			break;
 		case SIM_AUTH_UPDATE_FAIL_RESP:
-			switch(msg[1]) {
+			if(!sim_auth_update_fail_resp_decode(msg, len, &fail))
+				fail.cause = 0;
+
+			switch(fail.cause) {
 				case SIM_AUTH_ERROR_INVALID_PW:
 					cb(ISI_SIM_AUTH_ANSWER_ERR_INVALID, user_data);
 					break;
@@ -197,22 +211,16 @@ static gboolean isi_sim_auth_update_resp_cb(GIsiClient *client, const void *rest
 			cb(ISI_SIM_AUTH_ANSWER_ERR_UNKNOWN, user_data);
 			break;
 	}
+
+	return TRUE;
 }
 
 void isi_sim_update_pin(struct isi_sim_auth *nd, char *old_pin, char *new_pin, isi_sim_auth_cb cb, void *user_data) {
 	struct isi_cb_data *cbd = isi_cb_data_new(nd, cb, user_data);
 	int old_len = strlen(old_pin);
 	int new_len = strlen(new_pin);
-	int i;
-
-	unsigned char msg[] = {
-		SIM_AUTH_UPDATE_REQ, SIM_AUTH_REQ_PIN,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-	};
+	uint8_t msg[sim_auth_update_req_len];
+	struct sim_auth_update_req req;
 
 	if(old_len > SIM_MAX_PIN_LENGTH) {
 		cb(ISI_SIM_AUTH_ANSWER_ERR_PIN_TOO_LONG, user_data);
@@ -226,11 +234,9 @@ void isi_sim_update_pin(struct isi_sim_auth *nd, char *old_pin, char *new_pin, i
 		return;
 	}
 
-	/* insert the PUK into the request */
-	memcpy(msg+2, old_pin, old_len);
-
-	/* insert the PIN into the request */
-	memcpy(msg+13, new_pin, new_len);
+	req.old_pin = old_pin;
+	req.new_pin = new_pin;
+	sim_auth_update_req_pack(msg, &req);
 
 	if(!cbd)
 		goto error;
@@ -249,6 +255,7 @@ static gboolean isi_sim_auth_status_resp_cb(GIsiClient *client, const void *rest
 
 	isi_sim_auth_status_cb cb = cbd->callback;
 	void *user_data = cbd->data;
+	struct sim_auth_status_get_resp resp;
 	isi_cb_data_free(cbd);
 
 	if(!cb) {
@@ -262,7 +269,13 @@ static gboolean isi_sim_auth_status_resp_cb(GIsiClient *client, const void *rest
 		return TRUE;
 	}
 
-	switch(msg[1]) {
+	if (!sim_auth_status_get_resp_decode(msg, len, &resp)) {
+		print_package("SIM Auth Response Package", msg, len);
+		cb(ISI_SIM_AUTH_STATUS_ERROR, user_data);
+		return TRUE;
+	}
+
+	switch(resp.status) {
 		case SIM_AUTH_STATUS_RESP_NEED_PIN:
 			cb(ISI_SIM_AUTH_STATUS_NEED_PIN, user_data);
 			break;
@@ -270,7 +283,7 @@ static gboolean isi_sim_auth_status_resp_cb(GIsiClient *client, const void *rest
 			cb(ISI_SIM_AUTH_STATUS_NEED_PUK, user_data);
 			break;
 		case SIM_AUTH_STATUS_RESP_RUNNING:
-			switch(msg[2]) {
+			switch(resp.substatus) {
 				case SIM_AUTH_STATUS_RESP_RUNNING_AUTHORIZED:
 					cb(ISI_SIM_AUTH_STATUS_AUTHORIZED, user_data);
 					break;
@@ -301,14 +314,10 @@ static gboolean isi_sim_auth_status_resp_cb(GIsiClient *client, const void *rest
 void isi_sim_auth_request_status(struct isi_sim_auth *nd, isi_sim_auth_status_cb cb, void *user_data) {
 	struct isi_cb_data *cbd = isi_cb_data_new(nd, cb, user_data);
 
-	unsigned char msg[] = {
-		SIM_AUTH_STATUS_REQ, 0x00, 0x00
-	};
-
 	if(!cbd)
 		goto error;
 
-	if(g_isi_request_make(nd->client, msg, sizeof(msg), SIM_AUTH_TIMEOUT, isi_sim_auth_status_resp_cb, cbd))
+	if(g_isi_request_make(nd->client, sim_auth_status_req, sizeof(sim_auth_status_req), SIM_AUTH_TIMEOUT, isi_sim_auth_status_resp_cb, cbd))
 		return;
 
 error:
@@ -321,6 +330,7 @@ static gboolean isi_sim_auth_protection_cb(GIsiClient *client, const void *restr
 	struct isi_cb_data *cbd = opaque;
 	isi_sim_auth_status_cb cb = cbd->callback;
 	void *user_data = cbd->data;
+	struct sim_auth_protected_resp resp;
 	isi_cb_data_free(cbd);
 
 	if(!cb) {
@@ -334,13 +344,13 @@ static gboolean isi_sim_auth_protection_cb(GIsiClient *client, const void *restr
 		return TRUE;
 	}
 
-	if(msg[0] != SIM_AUTH_PROTECTED_RESP) {
+	if(!sim_auth_protected_resp_decode(msg, len, &resp)) {
 		print_package("SIM Auth Protected Response Package", msg, len);
 		cb(ISI_SIM_AUTH_STATUS_ERROR, user_data);
 		return TRUE;
 	}
 
-	switch(msg[1]) {
+	switch(resp.cause) {
 		case SIM_AUTH_PIN_PROTECTED_DISABLE:
 			cb(ISI_SIM_AUTH_STATUS_UNPROTECTED, user_data);
 			break;
@@ -359,14 +369,18 @@ static gboolean isi_sim_auth_protection_cb(GIsiClient *client, const void *restr
 void isi_sim_auth_get_pin_protection(struct isi_sim_auth *nd, isi_sim_auth_status_cb cb, void *user_data) {
 	struct isi_cb_data *cbd = isi_cb_data_new(nd, cb, user_data);
 
-	unsigned char msg[] = {
-		SIM_AUTH_PROTECTED_REQ, SIM_AUTH_REQ_PIN, SIM_AUTH_PIN_PROTECTED_STATUS
-	};
+	uint8_t msg[sim_auth_protected_req_len];
+	struct sim_auth_protected_req req;
+
+	req.status = SIM_AUTH_PIN_PROTECTED_STATUS;
+	req.pin = "";
+	sim_auth_protected_req_pack(msg, &req);
 
 	if(!cbd)
 		goto error;
 
-	if(g_isi_request_make(nd->client, msg, sizeof(msg), SIM_AUTH_TIMEOUT, isi_sim_auth_protection_cb, cbd))
+	/* Status queries carry no PIN */
+	if(g_isi_request_make(nd->client, msg, 3, SIM_AUTH_TIMEOUT, isi_sim_auth_protection_cb, cbd))
 		return;
 
 error:
@@ -377,7 +391,8 @@ error:
 void isi_sim_auth_set_pin_protection(struct isi_sim_auth *nd, char *pin, gboolean status, isi_sim_auth_status_cb cb, void *user_data) {
 	struct isi_cb_data *cbd = isi_cb_data_new(nd, cb, user_data);
 	int len = strlen(pin);
-	unsigned char *msg = malloc(len+4);
+	uint8_t msg[sim_auth_protected_req_len];
+	struct sim_auth_protected_req req;
 
 	if(len > SIM_MAX_PIN_LENGTH)
 		goto error;
@@ -385,16 +400,11 @@ void isi_sim_auth_set_pin_protection(struct isi_sim_auth *nd, char *pin, gboolea
 	if(!cbd)
 		goto error;
 
-	if(!msg)
-		goto error;
-
-	msg[0] = SIM_AUTH_PROTECTED_REQ;
-	msg[1] = SIM_AUTH_REQ_PIN;
-	msg[2] = status ? SIM_AUTH_PIN_PROTECTED_ENABLE : SIM_AUTH_PIN_PROTECTED_DISABLE;
-
-	/* insert the PIN including the \00 */
-	memcpy(msg+3, pin, len+1);
+	req.status = status ? SIM_AUTH_PIN_PROTECTED_ENABLE : SIM_AUTH_PIN_PROTECTED_DISABLE;
+	req.pin = pin;
+	sim_auth_protected_req_pack(msg, &req);
 
+	/* send the PIN including the \00 */
 	if(g_isi_request_make(nd->client, msg, len+4, SIM_AUTH_TIMEOUT, isi_sim_auth_protection_cb, cbd))
 		return;
 
@@ -409,14 +419,15 @@ void sim_auth_ind_cb(GIsiClient *client, const void *restrict data, size_t len,
 	struct isi_network *nd = cbd->subsystem;
 	isi_sim_auth_status_cb cb = cbd->callback;
 	void *user_data = cbd->data;
+	struct sim_auth_status_ind ind;
 
-	if(!msg || len < 3 || msg[0] != SIM_AUTH_STATUS_IND) {
+	if(!sim_auth_status_ind_decode(msg, len, &ind)) {
 		cb(ISI_SIM_AUTH_STATUS_ERROR, user_data);
 		return;
 	}
 
-	if(msg[3] != SIM_AUTH_IND_OK) {
-		switch(msg[3]) {
+	if(ind.config != SIM_AUTH_IND_OK) {
+		switch(ind.config) {
 			case SIM_AUTH_IND_CFG_UNPROTECTED:
 				cb(ISI_SIM_AUTH_STATUS_UNPROTECTED, user_data);
 				break;
@@ -432,9 +443,9 @@ void sim_auth_ind_cb(GIsiClient *client, const void *restrict data, size_t len,
 		return;
 	}
 
-	switch(msg[1]) {
+	switch(ind.status) {
 		case SIM_AUTH_IND_NEED_AUTH:
-			switch(msg[2]) {
+			switch(ind.type) {
 				case SIM_AUTH_IND_PIN:
 					cb(ISI_SIM_AUTH_STATUS_NEED_PIN, user_data);
 					break;
@@ -450,7 +461,7 @@ void sim_auth_ind_cb(GIsiClient *client, const void *restrict data, size_t len,
 			cb(ISI_SIM_AUTH_STATUS_NEED_NONE, user_data);
 			break;
 		case SIM_AUTH_IND_VALID:
-			switch(msg[2]) {
+			switch(ind.type) {
 				case SIM_AUTH_IND_PIN:
 					cb(ISI_SIM_AUTH_STATUS_VALID_PIN, user_data);
 					break;
@@ -463,7 +474,7 @@ void sim_auth_ind_cb(GIsiClient *client, const void *restrict data, size_t len,
 			}
 			break;
 		case SIM_AUTH_IND_INVALID:
-			switch(msg[2]) {
+			switch(ind.type) {
 				case SIM_AUTH_IND_PIN:
 					cb(ISI_SIM_AUTH_STATUS_INVALID_PIN, user_data);
 					break;